@@ -0,0 +1,420 @@
+/*
+ * Copyright (C) 2019 Fondazione Istituto Italiano di Tecnologia (IIT)
+ * All Rights Reserved.
+ * Authors: Ugo Pattacini <ugo.pattacini@iit.it>
+ */
+
+#include <yarp/os/all.h>
+#include <yarp/dev/all.h>
+#include <yarp/sig/all.h>
+#include <yarp/math/Math.h>
+#include <yarp/math/RandScalar.h>
+
+#include <cmath>
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+
+using namespace std;
+using namespace yarp::os;
+using namespace yarp::dev;
+using namespace yarp::sig;
+using namespace yarp::math;
+
+/**
+ * The samples collected by one client.
+ */
+struct LoadSamples
+{
+    vector<double> latencies;   // command to motion done [s]
+    vector<double> errors;      // tracking error [m]
+    unsigned long commands;
+    unsigned long timeouts;
+
+    LoadSamples() : commands(0), timeouts(0) { }
+};
+
+/**
+ * This class drives the Cartesian controller with a stream of
+ * targets from its own thread:
+ * -) random: one random target at a time, waiting for the motion
+ *    to be done before issuing the next one;
+ * -) circle: a circular trajectory streamed at a fixed rate, while
+ *    the distance between the current target and the end-effector
+ *    is sampled;
+ * -) burst: bursts of random targets sent back to back, where only
+ *    the last one of each burst is waited for.
+ */
+class LoadClient
+{
+    PolyDriver client;
+    ICartesianControl *arm;
+    thread worker;
+    atomic<bool> running;
+    RandScalar rnd;
+
+    string stream;
+    double trajTime,tol,timeout;
+    double reachMin,reachMax;
+    double period,radius,frequency;
+    int burst;
+
+    LoadSamples samples;
+
+    /**********************************************************/
+    Vector randomTarget()
+    {
+        // uniform over the annulus reachable by the fake robot,
+        // hence with the radius distributed as sqrt(r)
+        double r=sqrt(rnd.get(reachMin*reachMin,reachMax*reachMax));
+        double theta=rnd.get(-M_PI,M_PI);
+
+        Vector xd(3);
+        xd[0]=r*cos(theta);
+        xd[1]=r*sin(theta);
+        xd[2]=0.0;
+        return xd;
+    }
+
+    /**********************************************************/
+    void waitMotionDone(const Vector &xd, const double t0)
+    {
+        bool done=false;
+        while (running && !done)
+        {
+            arm->checkMotionDone(&done);
+            if (SystemClock::nowSystem()-t0>timeout)
+                break;
+            if (!done)
+                SystemClock::delaySystem(0.005);
+        }
+
+        if (done)
+        {
+            samples.latencies.push_back(SystemClock::nowSystem()-t0);
+
+            Vector x,o;
+            arm->getPose(x,o);
+            samples.errors.push_back(norm(xd-x));
+        }
+        else if (running)
+        {
+            samples.timeouts++;
+            arm->stopControl();
+        }
+    }
+
+    /**********************************************************/
+    void runRandom()
+    {
+        while (running)
+        {
+            Vector xd=randomTarget();
+            double t0=SystemClock::nowSystem();
+            arm->goToPositionSync(xd);
+            samples.commands++;
+            waitMotionDone(xd,t0);
+        }
+    }
+
+    /**********************************************************/
+    void runCircle()
+    {
+        double t0=SystemClock::nowSystem();
+        while (running)
+        {
+            double t=SystemClock::nowSystem();
+            double w=2.0*M_PI*frequency*(t-t0);
+
+            Vector xd(3);
+            xd[0]=0.5*(reachMin+reachMax)+radius*cos(w);
+            xd[1]=radius*sin(w);
+            xd[2]=0.0;
+
+            Vector x,o;
+            arm->getPose(x,o);
+            arm->goToPosition(xd);
+            samples.commands++;
+
+            // the very first sample is dropped as the end-effector
+            // is not yet on the circle
+            if (samples.commands>1)
+                samples.errors.push_back(norm(xd-x));
+
+            SystemClock::delaySystem(std::max(0.0,period-(SystemClock::nowSystem()-t)));
+        }
+    }
+
+    /**********************************************************/
+    void runBurst()
+    {
+        while (running)
+        {
+            // the last target of the burst is sent in sync mode
+            // so that the server has taken it over when the
+            // motion done is polled
+            for (int i=0; (i<burst) && running; i++)
+            {
+                Vector xd=randomTarget();
+                double t0=SystemClock::nowSystem();
+                if (i<burst-1)
+                    arm->goToPosition(xd);
+                else
+                    arm->goToPositionSync(xd);
+                samples.commands++;
+
+                if (i==burst-1)
+                    waitMotionDone(xd,t0);
+            }
+        }
+    }
+
+public:
+    /**********************************************************/
+    LoadClient() : arm(NULL), running(false) { }
+
+    /**********************************************************/
+    bool open(ResourceFinder &rf, const string &remote, const string &local, const int id)
+    {
+        Property option("(device cartesiancontrollerclient)");
+        option.put("remote","/"+remote);
+        option.put("local",local);
+        if (!client.open(option))
+            return false;
+
+        client.view(arm);
+
+        stream=rf.check("stream",Value("random")).asString();
+        trajTime=rf.check("traj_time",Value(2.0)).asFloat64();
+        tol=rf.check("tol",Value(1e-3)).asFloat64();
+        timeout=rf.check("timeout",Value(10.0)).asFloat64();
+        reachMin=rf.check("reach_min",Value(1.8)).asFloat64();
+        reachMax=std::max(reachMin,rf.check("reach_max",Value(2.9)).asFloat64());
+        period=rf.check("period",Value(0.02)).asFloat64();
+        radius=std::min(rf.check("radius",Value(0.5)).asFloat64(),0.5*(reachMax-reachMin));
+        frequency=rf.check("frequency",Value(0.1)).asFloat64();
+        burst=std::max(1,rf.check("burst",Value(5)).asInt32());
+
+        rnd.init(id+1);
+
+        arm->setTrajTime(trajTime);
+        arm->setInTargetTol(tol);
+        return true;
+    }
+
+    /**********************************************************/
+    void start()
+    {
+        running=true;
+        worker=thread([this]()
+        {
+            if (stream=="circle")
+                runCircle();
+            else if (stream=="burst")
+                runBurst();
+            else
+                runRandom();
+        });
+    }
+
+    /**********************************************************/
+    const LoadSamples &stop()
+    {
+        running=false;
+        if (worker.joinable())
+            worker.join();
+        if (arm!=NULL)
+            arm->stopControl();
+        return samples;
+    }
+
+    /**********************************************************/
+    void close()
+    {
+        stop();
+        if (client.isValid())
+            client.close();
+    }
+};
+
+/**********************************************************/
+string statistics(vector<double> v, const double scale)
+{
+    ostringstream str;
+    str<<fixed<<setprecision(3);
+    if (v.empty())
+    {
+        str<<setw(10)<<"-"<<setw(10)<<"-"<<setw(10)<<"-"<<setw(10)<<"-";
+        return str.str();
+    }
+
+    sort(v.begin(),v.end());
+    double mean=0.0;
+    for (auto &x:v)
+        mean+=x;
+    mean/=v.size();
+
+    str<<setw(10)<<scale*mean
+       <<setw(10)<<scale*v[v.size()/2]
+       <<setw(10)<<scale*v[std::min(v.size()-1,(size_t)(0.95*v.size()))]
+       <<setw(10)<<scale*v.back();
+    return str.str();
+}
+
+/**
+ * This load generator drives Cartesian controller servers with
+ * several concurrent clients and reports the latency from the
+ * command to the motion done, the tracking error and the
+ * throughput, per client and overall.
+ *
+ * Each client needs a server (hence a limb) of its own, since the
+ * targets, the trajectory time and the in-target tolerance of one
+ * client would otherwise override those of the others, and the
+ * motion done as well as the pose would refer to whatever target
+ * came last: with n clients, the servers <remote>_0 ... <remote>_n-1
+ * are to be launched beforehand, each with its own solver and robot,
+ * e.g. through fakeRobotStack --instance i (see cartesianLoad.xml).
+ *
+ * Options:
+ * -) --remote name: the server name, or the stem of the servers
+ *    names with more than one client (default: server)
+ * -) --remotes (name ...): the servers names, one per client, in
+ *    place of --remote and --clients
+ * -) --local name: the stem of the clients ports (default: cartesianLoad)
+ * -) --clients n: the number of concurrent clients (default: 1)
+ * -) --stream random|circle|burst: the targets stream (default: random)
+ * -) --duration s: the duration of the run (default: 30)
+ * -) --traj_time s: the trajectory time of the controller (default: 2)
+ * -) --tol m: the in-target tolerance (default: 1e-3)
+ * -) --timeout s: the timeout of one single motion (default: 10)
+ * -) --reach_min m, --reach_max m: the annulus around the base the
+ *    random targets are drawn from (default: 1.8 and 2.9, within the
+ *    reach of the three 1 [m] links under the joints limits of
+ *    fakeRobot.ini, i.e. from sqrt(3) to 3 [m])
+ * -) --period s: the streaming period of the circle (default: 0.02)
+ * -) --radius m: the radius of the circle, centered in the middle of
+ *    the annulus on the x axis (default: 0.5, up to half the annulus)
+ * -) --frequency Hz: the frequency of the circle (default: 0.1)
+ * -) --burst k: the number of targets per burst (default: 5)
+ * -) --report file: a file where to append the report as well
+ */
+int main(int argc, char *argv[])
+{
+    Network yarp;
+    if (!yarp.checkNetwork())
+    {
+        cout<<"Error: yarp server does not seem available"<<endl;
+        return 1;
+    }
+
+    ResourceFinder rf;
+    rf.configure(argc,argv);
+
+    string local=rf.check("local",Value("cartesianLoad")).asString();
+    string stream=rf.check("stream",Value("random")).asString();
+    string remote=rf.check("remote",Value("server")).asString();
+    int nClients=std::max(1,rf.check("clients",Value(1)).asInt32());
+    double duration=rf.check("duration",Value(30.0)).asFloat64();
+
+    if ((stream!="random") && (stream!="circle") && (stream!="burst"))
+    {
+        cout<<"Error: unknown stream \""<<stream<<"\""<<endl;
+        return 1;
+    }
+
+    // one server per client
+    vector<string> remotes;
+    if (Bottle *b=rf.find("remotes").asList())
+    {
+        for (size_t i=0; i<b->size(); i++)
+            remotes.push_back(b->get(i).asString());
+    }
+    else if (nClients==1)
+        remotes.push_back(remote);
+    else
+    {
+        for (int i=0; i<nClients; i++)
+            remotes.push_back(remote+"_"+to_string(i));
+    }
+
+    vector<string> sorted=remotes;
+    sort(sorted.begin(),sorted.end());
+    if (remotes.empty() || (unique(sorted.begin(),sorted.end())!=sorted.end()))
+    {
+        cout<<"Error: each client needs a server of its own"<<endl;
+        return 1;
+    }
+    nClients=(int)remotes.size();
+
+    vector<unique_ptr<LoadClient>> clients;
+    for (int i=0; i<nClients; i++)
+    {
+        clients.push_back(unique_ptr<LoadClient>(new LoadClient));
+        if (!clients.back()->open(rf,remotes[i],"/"+local+"/"+to_string(i),i))
+        {
+            cout<<"Error: unable to connect to the server "<<remotes[i]<<endl;
+            for (auto &c:clients)
+                c->close();
+            return 1;
+        }
+    }
+
+    cout<<"Running "<<nClients<<" clients with the "<<stream<<" stream for "
+        <<duration<<" [s] ..."<<endl;
+
+    double t0=SystemClock::nowSystem();
+    for (auto &c:clients)
+        c->start();
+    SystemClock::delaySystem(duration);
+
+    vector<LoadSamples> results;
+    for (auto &c:clients)
+        results.push_back(c->stop());
+    double elapsed=SystemClock::nowSystem()-t0;
+
+    for (auto &c:clients)
+        c->close();
+
+    // the report
+    ostringstream report;
+    report<<"stream "<<stream<<", "<<nClients<<" clients, "<<elapsed<<" [s]"<<endl;
+    report<<setw(12)<<"server"
+          <<setw(40)<<"latency mean/p50/p95/max [ms]"
+          <<setw(40)<<"error mean/p50/p95/max [mm]"
+          <<setw(12)<<"cmd [1/s]"<<setw(10)<<"done"<<setw(10)<<"timeouts"<<endl;
+
+    LoadSamples all;
+    for (size_t i=0; i<=results.size(); i++)
+    {
+        const LoadSamples &s=(i<results.size())?results[i]:all;
+        report<<setw(12)<<((i<results.size())?remotes[i]:string("all"))
+              <<statistics(s.latencies,1e3)
+              <<statistics(s.errors,1e3)
+              <<fixed<<setprecision(2)<<setw(12)<<s.commands/elapsed
+              <<setw(10)<<s.latencies.size()<<setw(10)<<s.timeouts<<endl;
+
+        if (i<results.size())
+        {
+            all.latencies.insert(all.latencies.end(),s.latencies.begin(),s.latencies.end());
+            all.errors.insert(all.errors.end(),s.errors.begin(),s.errors.end());
+            all.commands+=s.commands;
+            all.timeouts+=s.timeouts;
+        }
+    }
+
+    cout<<report.str();
+    if (rf.check("report"))
+    {
+        ofstream fout(rf.find("report").asString(),ios::app);
+        fout<<report.str()<<endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,637 @@
+/*
+ * Copyright (C) 2019 Fondazione Istituto Italiano di Tecnologia (IIT)
+ * All Rights Reserved.
+ * Authors: Ugo Pattacini <ugo.pattacini@iit.it>
+ */
+
+#include <yarp/os/all.h>
+#include <yarp/os/DummyConnector.h>
+#include <yarp/dev/all.h>
+#include <yarp/sig/all.h>
+#include <fakeMotorDevice.h>
+
+#include <cmath>
+#include <cstdlib>
+#include <new>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <functional>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <iomanip>
+#include <cstdint>
+#include <algorithm>
+
+using namespace std;
+using namespace yarp::os;
+using namespace yarp::dev;
+using namespace yarp::sig;
+
+namespace
+{
+    // heap allocations performed by the whole process, which
+    // include those of the yarp threads, and by the calling thread
+    atomic<unsigned long> allocations(0);
+    thread_local unsigned long threadAllocations=0;
+}
+
+/**********************************************************/
+void *operator new(size_t size)
+{
+    allocations.fetch_add(1,memory_order_relaxed);
+    threadAllocations++;
+    if (void *p=malloc(size>0?size:1))
+        return p;
+    throw bad_alloc();
+}
+
+/**********************************************************/
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+/**********************************************************/
+void operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
+
+/**
+ * This port collects the arrival times of the state streamed
+ * by the fake motor device server along with its latency, i.e.
+ * the time elapsed since the server tick stamped in the state.
+ */
+class StateMonitor: public BufferedPort<Vector>
+{
+    mutex mtx;
+    vector<double> arrivals;
+    vector<double> latencies;
+
+    /**********************************************************/
+    void onRead(Vector &state)
+    {
+        double t=SystemClock::nowSystem();
+
+        // the state is [q dq ddq t]
+        lock_guard<mutex> lg(mtx);
+        arrivals.push_back(t);
+        if (state.length()>0)
+            latencies.push_back(t-state[state.length()-1]);
+    }
+
+public:
+    /**********************************************************/
+    StateMonitor() { useCallback(); }
+
+    /**********************************************************/
+    void reset()
+    {
+        lock_guard<mutex> lg(mtx);
+        arrivals.clear();
+        latencies.clear();
+    }
+
+    /**********************************************************/
+    void get(vector<double> &periods, vector<double> &latencies)
+    {
+        lock_guard<mutex> lg(mtx);
+        periods.clear();
+        for (size_t i=1; i<arrivals.size(); i++)
+            periods.push_back(arrivals[i]-arrivals[i-1]);
+        latencies=this->latencies;
+    }
+};
+
+/**
+ * This thread fires rpc requests at the server as fast as
+ * it can, mixing bulk writes, bulk reads and single reads;
+ * the requests can be pipelined by several per message.
+ */
+class RpcLoad
+{
+    RpcClient port;
+    thread worker;
+    atomic<bool> running;
+    unsigned long requests;
+    int nJoints;
+    int pipeline;
+
+public:
+    /**********************************************************/
+    RpcLoad() : running(false), requests(0), nJoints(0), pipeline(1) { }
+
+    /**********************************************************/
+    bool open(const string &local, const string &remote, const int nJoints,
+              const int pipeline)
+    {
+        this->nJoints=nJoints;
+        this->pipeline=pipeline;
+        if (!port.open(local))
+            return false;
+        return Network::connect(port.getName(),remote,"tcp");
+    }
+
+    /**********************************************************/
+    void start()
+    {
+        requests=0;
+        running=true;
+        worker=thread([this]()
+        {
+            Bottle reqs[3];
+            reqs[0].addVocab32("vel");
+            reqs[0].addVocab32("acc");
+            Bottle &a=reqs[0].addList();
+            for (int i=0; i<nJoints; i++)
+                a.addFloat64(1e5);
+            reqs[1].addVocab32("vel");
+            reqs[1].addVocab32("gacc");
+            reqs[2].addVocab32("lim");
+            reqs[2].addVocab32("get");
+            reqs[2].addInt32(0);
+
+            // the pipelined messages cycle over the same requests
+            Bottle batch[3],reply;
+            for (int k=0; k<3; k++)
+                for (int i=0; i<pipeline; i++)
+                    batch[k].addList()=reqs[(k+i)%3];
+
+            while (running)
+            {
+                int k=(int)((requests/pipeline)%3);
+                if (pipeline>1)
+                {
+                    port.write(batch[k],reply);
+                    requests+=pipeline;
+                }
+                else
+                {
+                    port.write(reqs[k],reply);
+                    requests++;
+                }
+            }
+        });
+    }
+
+    /**********************************************************/
+    unsigned long stop()
+    {
+        running=false;
+        if (worker.joinable())
+            worker.join();
+        return requests;
+    }
+
+    /**********************************************************/
+    void close()
+    {
+        stop();
+        port.close();
+    }
+};
+
+/**********************************************************/
+void printStats(const string &label, vector<double> periods, vector<double> latencies,
+                const double Ts, const double rpcRate)
+{
+    if (periods.empty() || latencies.empty())
+    {
+        cout<<setw(10)<<label<<" no state received"<<endl;
+        return;
+    }
+
+    double mean=0.0,var=0.0,maxDev=0.0;
+    for (auto &p:periods)
+        mean+=p;
+    mean/=periods.size();
+    for (auto &p:periods)
+    {
+        var+=(p-mean)*(p-mean);
+        maxDev=std::max(maxDev,fabs(p-Ts));
+    }
+    var/=periods.size();
+
+    sort(latencies.begin(),latencies.end());
+    double p50=latencies[latencies.size()/2];
+    double p99=latencies[std::min(latencies.size()-1,(size_t)(0.99*latencies.size()))];
+
+    cout<<setw(10)<<label
+        <<setw(12)<<1e3*mean<<setw(12)<<1e3*sqrt(var)<<setw(12)<<1e3*maxDev
+        <<setw(12)<<1e3*p50<<setw(12)<<1e3*p99<<setw(12)<<1e3*latencies.back()
+        <<setw(14)<<rpcRate<<endl;
+}
+
+/**
+ * Run the server on the calling thread and read the state through
+ * the client from the same thread, counting the heap allocations
+ * during each tick once warmed up. The count that decides is scoped
+ * to the calling thread, around the server step() (the update of
+ * the state and its write to the port) and the client getters
+ * (served from the StateSnapshot), which are expected not to
+ * allocate at all. The allocations of the rest of the process
+ * during the tick, i.e. those of the yarp threads delivering the
+ * state to the client, are only reported.
+ */
+int allocBench(const string &name, const int Ts, const int nJoints, const double duration)
+{
+    Property options;
+    options.put("device","fakeyServer");
+    options.put("local",name+"/robot");
+    options.put("Ts",Ts);
+    options.put("joints",nJoints);
+    options.put("thread","external");
+
+    PolyDriver server;
+    if (!server.open(options))
+    {
+        cout<<"Error: unable to open the server"<<endl;
+        return 1;
+    }
+
+    IFakeMotorDevice *ifake;
+    server.view(ifake);
+
+    options.clear();
+    options.put("device","fakeyClient");
+    options.put("local",name+"/client");
+    options.put("remote",name+"/robot");
+
+    PolyDriver client;
+    if (!client.open(options))
+    {
+        cout<<"Error: unable to open the client"<<endl;
+        server.close();
+        return 1;
+    }
+
+    IEncodersTimed *ienc;
+    client.view(ienc);
+
+    vector<double> encs(nJoints),spds(nJoints),accs(nJoints),stamps(nJoints);
+    double period=Ts/1000.0;
+
+    // warm-up: let the first state reach the client
+    bool received=false;
+    for (int i=0; (i<1000) && !received; i++)
+    {
+        ifake->step(Time::now());
+        SystemClock::delaySystem(period);
+        received=ienc->getEncodersTimed(encs.data(),stamps.data());
+    }
+
+    if (!received)
+    {
+        cout<<"Error: no state received by the client"<<endl;
+        client.close();
+        server.close();
+        return 1;
+    }
+
+    // the step and the client reads are counted on this thread,
+    // the process-wide counter spans the whole tick, including the
+    // wait during which the state reaches the client
+    unsigned long ticks=0,stepAllocs=0,readAllocs=0,processAllocs=0;
+    double t0=SystemClock::nowSystem();
+    while (SystemClock::nowSystem()-t0<duration)
+    {
+        unsigned long p0=allocations.load();
+        unsigned long a0=threadAllocations;
+        ifake->step(Time::now());
+        unsigned long a1=threadAllocations;
+        SystemClock::delaySystem(period);
+        unsigned long a2=threadAllocations;
+        ienc->getEncodersTimed(encs.data(),stamps.data());
+        ienc->getEncoderSpeeds(spds.data());
+        ienc->getEncoderAccelerations(accs.data());
+        unsigned long a3=threadAllocations;
+        unsigned long p1=allocations.load();
+
+        stepAllocs+=a1-a0;
+        readAllocs+=a3-a2;
+        processAllocs+=(p1-p0)-(a1-a0)-(a3-a2);
+        ticks++;
+    }
+
+    client.close();
+    server.close();
+
+    cout<<nJoints<<" joints @ "<<Ts<<" [ms], "<<ticks<<" ticks"<<endl;
+    cout<<"allocations per tick: step = "<<(double)stepAllocs/ticks
+        <<", client reads = "<<(double)readAllocs/ticks
+        <<", rest of the process (yarp delivery) = "<<(double)processAllocs/ticks<<endl;
+
+    if ((stepAllocs>0) || (readAllocs>0))
+    {
+        cout<<"Error: the control loop allocates memory"<<endl;
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * One request for each [interface] [method] pair served by the
+ * server, in the order of its dispatch table.
+ */
+vector<Bottle> rpcRequests(const int nJoints)
+{
+    const char *pairs[][2]=
+    {
+        {"lim","get"}, {"lim","vget"}, {"lim","set"}, {"lim","vset"},
+        {"enc","axes"}, {"enc","set"}, {"enc","rst"},
+        {"vel","move"}, {"vel","acc"}, {"vel","gacc"}, {"vel","stop"}
+    };
+
+    vector<Bottle> reqs;
+    for (auto &p:pairs)
+    {
+        Bottle b;
+        b.addVocab32(p[0]);
+        b.addVocab32(p[1]);
+        string m=p[1];
+        if ((m=="set") && (string(p[0])=="lim"))
+        {
+            b.addInt32(0); b.addFloat64(-90.0); b.addFloat64(90.0);
+        }
+        else if (m=="vset")
+        {
+            b.addInt32(0); b.addFloat64(0.0); b.addFloat64(100.0);
+        }
+        else if ((m=="get") || (m=="vget") || (m=="stop"))
+            b.addInt32(0);
+        else if ((m=="set") || (m=="move") || (m=="acc"))
+        {
+            Bottle &l=b.addList();
+            for (int i=0; i<nJoints; i++)
+                l.addFloat64(0.0);
+        }
+        reqs.push_back(b);
+    }
+
+    return reqs;
+}
+
+/**
+ * The lookup of the handler as done by the server before the
+ * dispatch table, i.e. by chains of comparisons against vocabs
+ * encoded from strings on every request.
+ */
+int chainLookup(const Bottle &cmd)
+{
+    int codeIF=cmd.get(0).asVocab32();
+    int codeMethod=cmd.get(1).asVocab32();
+    if (codeIF==Vocab32::encode("lim"))
+    {
+        if ((codeMethod==Vocab32::encode("get")) || (codeMethod==Vocab32::encode("vget")))
+            return (codeMethod==Vocab32::encode("get"))?0:1;
+        else if ((codeMethod==Vocab32::encode("set")) || (codeMethod==Vocab32::encode("vset")))
+            return (codeMethod==Vocab32::encode("set"))?2:3;
+    }
+    else if (codeIF==Vocab32::encode("enc"))
+    {
+        if (codeMethod==Vocab32::encode("axes"))
+            return 4;
+        else if (codeMethod==Vocab32::encode("set"))
+            return 5;
+        else if (codeMethod==Vocab32::encode("rst"))
+            return 6;
+    }
+    else if (codeIF==Vocab32::encode("vel"))
+    {
+        if ((codeMethod==Vocab32::encode("move")) || (codeMethod==Vocab32::encode("acc")))
+            return (codeMethod==Vocab32::encode("move"))?7:8;
+        else if (codeMethod==Vocab32::encode("gacc"))
+            return 9;
+        else if (codeMethod==Vocab32::encode("stop"))
+            return 10;
+    }
+
+    return -1;
+}
+
+/**
+ * The lookup of the handler through the dispatch table, keyed on
+ * the pair [interface] [method] as in the server.
+ */
+class TableLookup
+{
+    vector<uint64_t> keys;
+
+    static uint64_t key(const int i, const int m)
+    {
+        return (((uint64_t)(uint32_t)i)<<32)|(uint64_t)(uint32_t)m;
+    }
+
+public:
+    /**********************************************************/
+    TableLookup(const vector<Bottle> &reqs)
+    {
+        for (auto &r:reqs)
+            keys.push_back(key(r.get(0).asVocab32(),r.get(1).asVocab32()));
+    }
+
+    /**********************************************************/
+    int operator()(const Bottle &cmd) const
+    {
+        uint64_t k=key(cmd.get(0).asVocab32(),cmd.get(1).asVocab32());
+        for (size_t i=0; i<keys.size(); i++)
+            if (keys[i]==k)
+                return (int)i;
+        return -1;
+    }
+};
+
+/**
+ * Compare in-process, with no port involved, the lookup of the rpc
+ * handlers by the chains of comparisons the server used before the
+ * dispatch table against the table itself, over one request for
+ * each handler. The whole service of the same requests by the
+ * server (decoding, dispatch and handler) is then timed as well,
+ * to tell how much the lookup weighs on it.
+ */
+int dispatchBench(const string &name, const int nJoints, const double duration)
+{
+    Property options;
+    options.put("device","fakeyServer");
+    options.put("local",name+"/robot");
+    options.put("joints",nJoints);
+    options.put("thread","external");
+
+    PolyDriver server;
+    if (!server.open(options))
+    {
+        cout<<"Error: unable to open the server"<<endl;
+        return 1;
+    }
+
+    PortReader *reader;
+    if (!server.view(reader))
+    {
+        cout<<"Error: the server does not serve the rpc"<<endl;
+        server.close();
+        return 1;
+    }
+
+    vector<Bottle> reqs=rpcRequests(nJoints);
+    TableLookup tableLookup(reqs);
+
+    // both the lookups are expected to find the same handlers
+    for (size_t i=0; i<reqs.size(); i++)
+    {
+        if ((chainLookup(reqs[i])!=(int)i) || (tableLookup(reqs[i])!=(int)i))
+        {
+            cout<<"Error: the lookups disagree on "<<reqs[i].toString()<<endl;
+            server.close();
+            return 1;
+        }
+    }
+
+    // the time per request of a loop over the requests
+    auto timeIt=[&](const function<void(const Bottle&)> &serve)
+    {
+        unsigned long n=0;
+        double t0=SystemClock::nowSystem();
+        while (SystemClock::nowSystem()-t0<duration)
+        {
+            for (auto &r:reqs)
+                serve(r);
+            n+=reqs.size();
+        }
+        return (SystemClock::nowSystem()-t0)/n;
+    };
+
+    volatile int sink=0;
+    double dtChain=timeIt([&](const Bottle &r) { sink+=chainLookup(r); });
+    double dtTable=timeIt([&](const Bottle &r) { sink+=tableLookup(r); });
+    double dtServe=timeIt([&](const Bottle &r)
+    {
+        DummyConnector con;
+        r.write(con.getWriter());
+        reader->read(con.getReader());
+    });
+
+    server.close();
+
+    cout<<nJoints<<" joints, "<<reqs.size()<<" requests, "<<duration<<" [s] per figure"<<endl;
+    cout<<fixed<<setprecision(1);
+    cout<<"handler lookup [ns/req]: if-chains = "<<1e9*dtChain
+        <<", table = "<<1e9*dtTable<<endl;
+    cout<<"whole service  [ns/req]: "<<1e9*dtServe<<endl;
+
+    return 0;
+}
+
+/**
+ * This benchmark measures the jitter of the state streamed by
+ * the fake motor device server while rpc requests are fired at
+ * it, compared with the idle streaming.
+ *
+ * Options:
+ * -) --Ts ms: the server sample time (default: 1)
+ * -) --joints n: the number of joints (default: 50)
+ * -) --duration s: the duration of each phase (default: 5)
+ * -) --rpc_threads n: the number of rpc clients (default: 4)
+ * -) --pipeline k: the number of requests sent per message by each
+ *    rpc client (default: 1, i.e. no pipelining)
+ * -) --alloc: count instead the heap allocations per tick of the
+ *    server step() and of the client getters, and fail if any is
+ *    found; the allocations of the other threads of the process,
+ *    e.g. yarp delivering the state to the client, are reported.
+ * -) --dispatch: time instead in-process the lookup of the rpc
+ *    handlers by the former chains of comparisons and by the
+ *    dispatch table, along with the whole service of the requests.
+ */
+int main(int argc, char *argv[])
+{
+    Network yarp;
+    if (!yarp.checkNetwork())
+    {
+        cout<<"Error: yarp server does not seem available"<<endl;
+        return 1;
+    }
+
+    ResourceFinder rf;
+    rf.configure(argc,argv);
+
+    int Ts=std::max(1,rf.check("Ts",Value(1)).asInt32());
+    int nJoints=std::max(1,rf.check("joints",Value(50)).asInt32());
+    double duration=rf.check("duration",Value(5.0)).asFloat64();
+    int nThreads=std::max(1,rf.check("rpc_threads",Value(4)).asInt32());
+    int pipeline=std::max(1,rf.check("pipeline",Value(1)).asInt32());
+    string name=rf.check("name",Value("/fakeMotorBench")).asString();
+
+    registerFakeMotorDevices();
+
+    if (rf.check("alloc"))
+        return allocBench(name,Ts,nJoints,duration);
+    else if (rf.check("dispatch"))
+        return dispatchBench(name,nJoints,duration);
+
+    Property options;
+    options.put("device","fakeyServer");
+    options.put("local",name+"/robot");
+    options.put("Ts",Ts);
+    options.put("joints",nJoints);
+
+    PolyDriver server;
+    if (!server.open(options))
+    {
+        cout<<"Error: unable to open the server"<<endl;
+        return 1;
+    }
+
+    StateMonitor monitor;
+    monitor.open(name+"/state:i");
+    Network::connect(name+"/robot/state:o",monitor.getName(),"tcp");
+
+    vector<unique_ptr<RpcLoad>> loads;
+    for (int i=0; i<nThreads; i++)
+    {
+        loads.push_back(unique_ptr<RpcLoad>(new RpcLoad));
+        if (!loads.back()->open(name+"/load"+to_string(i),name+"/robot/rpc",nJoints,pipeline))
+        {
+            cout<<"Error: unable to connect to the server rpc"<<endl;
+            return 1;
+        }
+    }
+
+    cout<<nJoints<<" joints @ "<<Ts<<" [ms], "<<nThreads<<" rpc clients, "
+        <<pipeline<<" requests per message, "<<duration<<" [s] per phase"<<endl;
+    cout<<setw(10)<<"phase"
+        <<setw(12)<<"period"<<setw(12)<<"std"<<setw(12)<<"max_dev"
+        <<setw(12)<<"lat_p50"<<setw(12)<<"lat_p99"<<setw(12)<<"lat_max"
+        <<setw(14)<<"rpc [req/s]"<<endl;
+    cout<<setw(10)<<""<<setw(12)<<"[ms]"<<setw(12)<<"[ms]"<<setw(12)<<"[ms]"
+        <<setw(12)<<"[ms]"<<setw(12)<<"[ms]"<<setw(12)<<"[ms]"<<endl;
+    cout<<fixed<<setprecision(3);
+
+    vector<double> periods,latencies;
+
+    // idle streaming
+    monitor.reset();
+    SystemClock::delaySystem(duration);
+    monitor.get(periods,latencies);
+    printStats("idle",periods,latencies,Ts/1000.0,0.0);
+
+    // streaming under rpc bursts
+    monitor.reset();
+    for (auto &l:loads)
+        l->start();
+    SystemClock::delaySystem(duration);
+    unsigned long requests=0;
+    for (auto &l:loads)
+        requests+=l->stop();
+    monitor.get(periods,latencies);
+    printStats("rpc",periods,latencies,Ts/1000.0,requests/duration);
+
+    for (auto &l:loads)
+        l->close();
+    monitor.close();
+    server.close();
+
+    return 0;
+}
@@ -23,6 +23,63 @@
  */
 void registerFakeMotorDevices();
 
+/**
+ * Interface to advance the fake motor device server by one cycle
+ * from an external thread, as when several parts are hosted by the
+ * same periodic thread (see the option "thread external").
+ */
+class IFakeMotorDevice
+{
+public:
+    virtual ~IFakeMotorDevice() { }
+
+    /**
+     * Read the commands, advance the motors by one sample time and
+     * stream out the state.
+     * @param time the timestamp of the new state [s], which lets
+     *             the caller run the part on a simulated clock.
+     */
+    virtual void step(const double time)=0;
+};
+
+/**
+ * Statistics of the age of the state received by the fake motor
+ * device client, i.e. the time elapsed between the server stamping
+ * the state and the client receiving it [s]. They are meaningful
+ * as long as client and server share the same clock.
+ */
+struct FakeMotorLatency
+{
+    unsigned long count;    // the number of states received
+    double last;
+    double mean;
+    double std;
+    double min;
+    double max;
+};
+
+/**
+ * Interface to instrument the fake motor device client.
+ */
+class IFakeMotorDeviceInstrumentation
+{
+public:
+    virtual ~IFakeMotorDeviceInstrumentation() { }
+
+    /**
+     * Retrieve the statistics of the age of the state since the
+     * client was opened or the statistics were reset.
+     * @param latency filled with the statistics.
+     * @return false if no state has been received yet.
+     */
+    virtual bool getStateLatency(FakeMotorLatency &latency)=0;
+
+    /**
+     * Restart the collection of the statistics.
+     */
+    virtual void resetStateLatency()=0;
+};
+
 #endif
 
 
@@ -19,23 +19,69 @@
 #define __FAKEMOTORDEVICECOMPONENTS_H__
 
 #include <mutex>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
 
 #include <yarp/os/all.h>
 #include <yarp/dev/all.h>
 #include <yarp/sig/all.h>
 
-#include <iCub/ctrl/pids.h>
+#include <fakeMotorDevice.h>
+
+#define FAKEMOT_VOCAB_IF_LIM        yarp::os::createVocab32('l','i','m')
+#define FAKEMOT_VOCAB_IF_ENC        yarp::os::createVocab32('e','n','c')
+#define FAKEMOT_VOCAB_IF_VEL        yarp::os::createVocab32('v','e','l')
+#define FAKEMOT_VOCAB_GET           yarp::os::createVocab32('g','e','t')
+#define FAKEMOT_VOCAB_SET           yarp::os::createVocab32('s','e','t')
+#define FAKEMOT_VOCAB_VGET          yarp::os::createVocab32('v','g','e','t')
+#define FAKEMOT_VOCAB_VSET          yarp::os::createVocab32('v','s','e','t')
+#define FAKEMOT_VOCAB_AXES          yarp::os::createVocab32('a','x','e','s')
+#define FAKEMOT_VOCAB_RST           yarp::os::createVocab32('r','s','t')
+#define FAKEMOT_VOCAB_MOVE          yarp::os::createVocab32('m','o','v','e')
+#define FAKEMOT_VOCAB_ACC           yarp::os::createVocab32('a','c','c')
+#define FAKEMOT_VOCAB_GACC          yarp::os::createVocab32('g','a','c','c')
+#define FAKEMOT_VOCAB_STOP          yarp::os::createVocab32('s','t','o','p')
+#define FAKEMOT_VOCAB_ACK           yarp::os::createVocab32('a','c','k')
+#define FAKEMOT_VOCAB_NACK          yarp::os::createVocab32('n','a','c','k')
+
+// the key of the rpc dispatch table, i.e. the pair [interface] [method]
+#define FAKEMOT_RPC_KEY(i,m)        ((((uint64_t)(uint32_t)(i))<<32)|(uint64_t)(uint32_t)(m))
 
 /**
  * This class implements the server part of the fake motor device driver.
- * Only the used interface methods are actually implemented.
+ *
+ * The state is streamed out at each cycle as the vector [q dq ddq t]
+ * of the joints positions, velocities and accelerations, followed by
+ * the time they refer to; velocities are received on the command port
+ * as the lists ((joints) (values)) of the commanded joints only, all
+ * the messages queued since the previous cycle being applied in
+ * order, while any other request goes through the rpc.
+ *
+ * Options:
+ * -) local name: the stem of the ports names
+ * -) Ts period: the sample time [ms] (default: 10)
+ * -) limits ((min max) ...): the joints bounds [deg]; alternatively,
+ *    joints n along with min and max give n joints with the same
+ *    bounds (default: three joints)
+ * -) dynamics integrator|first_order|second_order: how the motors
+ *    velocities respond to the commanded ones: at once (default),
+ *    through a first order lag with time constant tau [s], or
+ *    through a second order system with natural frequency wn [rad/s]
+ *    and damping ratio zeta, both discretized exactly over Ts
+ * -) thread own|external: either the server runs its own periodic
+ *    thread (default), or it is advanced by someone else through
+ *    IFakeMotorDevice::step()
  */
 class fakeMotorDeviceServer : public yarp::dev::DeviceDriver,
                               public yarp::os::PeriodicThread,
                               public yarp::os::PortReader,
                               public yarp::dev::IControlLimits,
-                              public yarp::dev::IEncoders,
-                              public yarp::dev::IVelocityControl
+                              public yarp::dev::IEncodersTimed,
+                              public yarp::dev::IVelocityControl,
+                              public IFakeMotorDevice
 {
 protected:
     yarp::os::BufferedPort<yarp::sig::Vector> statePort;
@@ -44,10 +90,112 @@ protected:
 
     std::mutex mtx;
 
-    iCub::ctrl::Integrator *motors;
+    yarp::sig::Matrix lim;
     yarp::sig::Vector vel;
+    yarp::sig::Vector acc;
+    yarp::sig::Vector q,dq,ddq;
+    yarp::sig::Matrix velLim;
+    yarp::os::Stamp stamp;
     bool configured;
 
+    enum Dynamics { INTEGRATOR, FIRST_ORDER, SECOND_ORDER };
+
+    Dynamics dynamics;
+    double Ts,tau,wn,zeta;
+    double lag,phi[2][2];
+    yarp::sig::Vector velAct,velOld,accAct;
+    bool externalThread;
+
+    // buffers handled by step() only, hence not locked
+    yarp::sig::Vector cmdVel;
+    std::vector<char> cmdMask;
+
+    /**
+     * Run f with the state locked, so that the critical sections
+     * are limited to the access to the state.
+     */
+    template<typename F>
+    bool locked(F f)
+    {
+        std::lock_guard<std::mutex> lg(mtx);
+        return f();
+    }
+
+    /**
+     * The implementation of the interfaces methods, to be called
+     * with the state locked: the public methods lock the state and
+     * forward here, while step() and the rpc handlers call these
+     * directly within their own critical sections.
+     */
+    bool getLimitsUnlocked(int axis, double *min, double *max);
+    bool setLimitsUnlocked(int axis, double min, double max);
+    bool setVelLimitsUnlocked(int axis, double min, double max);
+    bool getVelLimitsUnlocked(int axis, double *min, double *max);
+    bool getAxesUnlocked(int *ax);
+    bool getEncoderUnlocked(int j, double *v);
+    bool getEncodersUnlocked(double *encs);
+    bool getEncoderTimedUnlocked(int j, double *encs, double *time);
+    bool getEncodersTimedUnlocked(double *encs, double *time);
+    bool resetEncoderUnlocked(int j);
+    bool resetEncodersUnlocked();
+    bool setEncoderUnlocked(int j, double val);
+    bool setEncodersUnlocked(const double *vals);
+    bool getEncoderSpeedUnlocked(int j, double *sp);
+    bool getEncoderSpeedsUnlocked(double *spds);
+    bool getEncoderAccelerationUnlocked(int j, double *spds);
+    bool getEncoderAccelerationsUnlocked(double *accs);
+    bool velocityMoveUnlocked(int j, double sp);
+    bool velocityMoveUnlocked(const int n_joint, const int *joints, const double *spds);
+    bool velocityMoveUnlocked(const double *sp);
+    bool setRefAccelerationUnlocked(int j, double acc);
+    bool setRefAccelerationsUnlocked(const int n_joint, const int *joints, const double *accs);
+    bool setRefAccelerationsUnlocked(const double *accs);
+    bool getRefAccelerationUnlocked(int j, double *acc);
+    bool getRefAccelerationsUnlocked(const int n_joint, const int *joints, double *accs);
+    bool getRefAccelerationsUnlocked(double *accs);
+    bool stopUnlocked(int j);
+    bool stopUnlocked(const int n_joint, const int *joints);
+    bool stopUnlocked();
+
+    /**
+     * The rpc handlers: each one serves a [interface] [method] pair,
+     * appending the ack and the payload to the reply on success.
+     */
+    typedef bool (fakeMotorDeviceServer::*RpcHandler)(const yarp::os::Bottle &cmd,
+                                                      yarp::os::Bottle &reply);
+    struct RpcEntry
+    {
+        uint64_t key;
+        RpcHandler handler;
+    };
+
+    // the dispatch table, constant-initialized
+    static const RpcEntry rpcTable[];
+
+    bool rpcGetLimits(const yarp::os::Bottle &cmd, yarp::os::Bottle &reply);
+    bool rpcGetVelLimits(const yarp::os::Bottle &cmd, yarp::os::Bottle &reply);
+    bool rpcSetLimits(const yarp::os::Bottle &cmd, yarp::os::Bottle &reply);
+    bool rpcSetVelLimits(const yarp::os::Bottle &cmd, yarp::os::Bottle &reply);
+    bool rpcAxes(const yarp::os::Bottle &cmd, yarp::os::Bottle &reply);
+    bool rpcSetEncoders(const yarp::os::Bottle &cmd, yarp::os::Bottle &reply);
+    bool rpcResetEncoders(const yarp::os::Bottle &cmd, yarp::os::Bottle &reply);
+    bool rpcVelocityMove(const yarp::os::Bottle &cmd, yarp::os::Bottle &reply);
+    bool rpcSetAccelerations(const yarp::os::Bottle &cmd, yarp::os::Bottle &reply);
+    bool rpcGetAccelerations(const yarp::os::Bottle &cmd, yarp::os::Bottle &reply);
+    bool rpcStop(const yarp::os::Bottle &cmd, yarp::os::Bottle &reply);
+
+    /**
+     * Decode the joints and the values of a [vel] request given
+     * for one joint, for all the joints or for a group of joints.
+     */
+    bool toJointValues(const yarp::os::Bottle &cmd, std::vector<int> &joints,
+                       std::vector<double> &vals) const;
+
+    /**
+     * Serve one single request through the dispatch table.
+     */
+    void dispatch(const yarp::os::Bottle &cmd, yarp::os::Bottle &reply);
+
     void run();
     /**
      * This method decodes the requests forwarded by the client and
@@ -62,36 +210,39 @@ public:
 
     ////////////////////////////////////////////////////////////
     ////
-    //// IControlLimits Interface
+    //// IFakeMotorDevice Interface
     ////
     /**********************************************************/
-    bool getLimits(int axis, double *min, double *max);
+    void step(const double time);
 
-    // not implemented
+    ////////////////////////////////////////////////////////////
+    ////
+    //// IControlLimits Interface
+    ////
     /**********************************************************/
-    bool setLimits(int,double,double)      { return false; }
-    bool setVelLimits(int,double,double)   { return false; }
-    bool getVelLimits(int,double*,double*) { return false; }
+    bool getLimits(int axis, double *min, double *max);
+    bool setLimits(int axis, double min, double max);
+    bool setVelLimits(int axis, double min, double max);
+    bool getVelLimits(int axis, double *min, double *max);
 
     ////////////////////////////////////////////////////////////
     ////
-    //// IEncoders Interface
+    //// IEncodersTimed Interface
     ////
     /**********************************************************/
     bool getAxes(int *ax);
-
-    // not implemented
-    /**********************************************************/
-    bool getEncoder(int,double*)             { return false; }
-    bool getEncoders(double*)                { return false; }
-    bool resetEncoder(int)                   { return false; }
-    bool resetEncoders()                     { return false; }
-    bool setEncoder(int,double)              { return false; }
-    bool setEncoders(const double*)          { return false; } 
-    bool getEncoderSpeed(int,double*)        { return false; }
-    bool getEncoderSpeeds(double*)           { return false; }
-    bool getEncoderAcceleration(int,double*) { return false; }
-    bool getEncoderAccelerations(double*)    { return false; }
+    bool getEncoder(int j, double *v);
+    bool getEncoders(double *encs);
+    bool getEncoderTimed(int j, double *encs, double *time);
+    bool getEncodersTimed(double *encs, double *time);
+    bool resetEncoder(int j);
+    bool resetEncoders();
+    bool setEncoder(int j, double val);
+    bool setEncoders(const double *vals);
+    bool getEncoderSpeed(int j, double *sp);
+    bool getEncoderSpeeds(double *spds);
+    bool getEncoderAcceleration(int j, double *spds);
+    bool getEncoderAccelerations(double *accs);
 
     ////////////////////////////////////////////////////////////
     ////
@@ -99,41 +250,115 @@ public:
     ////
     /**********************************************************/
     bool velocityMove(int j, double sp);
+    bool velocityMove(const int n_joint, const int *joints, const double *spds);
+    bool velocityMove(const double *sp);
     bool setRefAcceleration(int j, double acc);
+    bool setRefAccelerations(const int n_joint, const int *joints, const double *accs);
+    bool setRefAccelerations(const double *accs);
+    bool getRefAcceleration(int j, double *acc);
+    bool getRefAccelerations(const int n_joint, const int *joints, double *accs);
+    bool getRefAccelerations(double *accs);
     bool stop(int j);
+    bool stop(const int n_joint, const int *joints);
+    bool stop();
+};
 
-    // not implemented
-    /**********************************************************/
-    bool velocityMove(const int,const int*,const double*)        { return false; }
-    bool velocityMove(const double*)                             { return false; }
-    bool setRefAccelerations(const int,const int*,const double*) { return false; }
-    bool setRefAccelerations(const double*)                      { return false; }
-    bool getRefAccelerations(const int,const int*,double*)       { return false; }
-    bool getRefAcceleration(int,double*)                         { return false; }
-    bool getRefAccelerations(double*)                            { return false; }
-    bool stop(const int,const int*)                              { return false; }
-    bool stop()                                                  { return false; }
+/**
+ * This class holds the latest state received by the client, to be
+ * written by one single producer (the callback of the state port)
+ * and read concurrently by any number of consumers without locks:
+ * readers retry whenever the producer has meanwhile overwritten
+ * the state (sequence lock). All the memory is allocated once and
+ * the elements are accessed as relaxed atomics, so that a reader
+ * racing with the producer never incurs undefined behavior but only
+ * retries.
+ */
+class StateSnapshot
+{
+protected:
+    std::unique_ptr<std::atomic<double>[]> data;   // [t q dq ddq]
+    std::atomic<uint64_t> seq;      // odd while the state is being written
+    size_t n;
+
+public:
+    StateSnapshot();
+
+    /**
+     * Allocate the state; not to be called concurrently with
+     * write() and read().
+     * @param n the number of joints.
+     */
+    void resize(const size_t n);
+
+    /**
+     * Return the number of joints.
+     */
+    size_t size() const { return n; }
+
+    /**
+     * Store a new state (producer side).
+     * @param t the timestamp [s].
+     * @param state the vector [q dq ddq ...], of which the first
+     *              3n elements are stored.
+     */
+    void write(const double t, const yarp::sig::Vector &state);
+
+    /**
+     * Retrieve a slice of the latest state (consumer side).
+     * @param offset the first element within [q dq ddq].
+     * @param len the number of elements.
+     * @param v filled with the elements.
+     * @param t filled with the timestamp; it can be NULL.
+     * @return false if no state has been received yet.
+     */
+    bool read(const size_t offset, const size_t len, double *v, double *t) const;
 };
 
 /**
  * This class implements the client part of the fake motor device driver.
- * Only the used interface methods are actually implemented.
+ *
+ * Encoders (positions, velocities and accelerations along with their
+ * timestamps) are served from the latest state received from the
+ * server, velocities are streamed, while any other request goes
+ * through the rpc, one message per call also for the group and bulk
+ * variants.
+ *
+ * Options:
+ * -) remote name: the stem of the server ports names
+ * -) local name: the stem of the client ports names
+ * -) carrier name: the carrier of all the connections, e.g. shmem
+ *    when client and server share the host, or local when they
+ *    share the process; auto picks shmem when the server runs on
+ *    the same host and the defaults otherwise
+ * -) state_carrier name, cmd_carrier name, rpc_carrier name: the
+ *    carrier of each connection, overriding carrier (defaults: udp,
+ *    tcp and tcp respectively); the commands carry only the joints
+ *    being commanded, hence a lost one would not be made up for by
+ *    the next, which is why they are not streamed over udp
+ * A connection that cannot be established through the requested
+ * carrier falls back to its default one.
  */
 class fakeMotorDeviceClient : public yarp::dev::DeviceDriver,
                               public yarp::dev::IControlLimits,
-                              public yarp::dev::IEncoders,
-                              public yarp::dev::IVelocityControl
+                              public yarp::dev::IEncodersTimed,
+                              public yarp::dev::IVelocityControl,
+                              public IFakeMotorDeviceInstrumentation
 {
 protected:
     class StatePort : public yarp::os::BufferedPort<yarp::sig::Vector>
     {
         fakeMotorDeviceClient *owner;
-        void onRead(yarp::sig::Vector &encs)
+        void onRead(yarp::sig::Vector &state)
         {
-            if (owner!=NULL)
+            double now=yarp::os::Time::now();
+
+            // the state is [q dq ddq t]
+            size_t n=(owner!=NULL)?owner->snapshot.size():0;
+            if ((owner!=NULL) && (state.length()==3*n+1))
             {
-                std::lock_guard<std::mutex> lg(owner->mtx);
-                owner->encs=encs;
+                double t=state[3*n];
+                owner->snapshot.write(t,state);
+                owner->probe(now-t);
             }
         }
     public:
@@ -145,13 +370,56 @@ protected:
     yarp::os::BufferedPort<yarp::os::Bottle> cmdPort;
     yarp::os::RpcClient                      rpcPort;
 
-    std::mutex mtx;
+    std::mutex mtxCmd;
+    std::mutex mtxProbe;
 
-    yarp::sig::Vector encs;
+    StateSnapshot snapshot;
+
+    // the latency probe
+    unsigned long latCount;
+    double latLast,latSum,latSum2,latMin,latMax;
+    size_t nJoints;
     bool configured;
 
     friend class StatePort;
 
+    /**
+     * Stream the commanded velocities to the server; to be called
+     * with mtxCmd held.
+     * @param n_joint the number of joints.
+     * @param joints the joints; NULL for the joints 0 ... n_joint-1.
+     * @param spds the velocities; NULL for zero velocities.
+     */
+    void sendVelocities(const int n_joint, const int *joints, const double *spds);
+
+    /**
+     * Account for the age of a state just received.
+     */
+    void probe(const double age);
+
+    /**
+     * Connect two ports through the given carrier, falling back
+     * to the default one if the former fails.
+     */
+    bool connect(const std::string &src, const std::string &dest,
+                 const std::string &carrier, const std::string &fallback);
+
+    /**
+     * Copy the j-th element of a block of the latest state received
+     * (0 for positions, 1 for velocities, 2 for accelerations).
+     */
+    bool getState(const size_t block, int j, double *v, double *time=NULL);
+
+    /**
+     * Copy a block of the latest state received.
+     */
+    bool getState(const size_t block, double *v, double *time=NULL);
+
+    /**
+     * Forward a request to the server expecting an ack.
+     */
+    bool sendRpc(const yarp::os::Bottle &cmd, yarp::os::Bottle *reply=NULL);
+
 public:
     fakeMotorDeviceClient();
     bool open(yarp::os::Searchable &config);
@@ -163,32 +431,28 @@ public:
     ////
     /**********************************************************/
     bool getLimits(int axis, double *min, double *max);
-
-    // not implemented
-    /**********************************************************/
-    bool setLimits(int,double,double)      { return false; }
-    bool setVelLimits(int,double,double)   { return false; }
-    bool getVelLimits(int,double*,double*) { return false; }
+    bool setLimits(int axis, double min, double max);
+    bool setVelLimits(int axis, double min, double max);
+    bool getVelLimits(int axis, double *min, double *max);
 
     ////////////////////////////////////////////////////////////
     ////
-    //// IEncoders Interface
+    //// IEncodersTimed Interface
     ////
     /**********************************************************/
     bool getAxes(int *ax);
+    bool getEncoder(int j, double *v);
     bool getEncoders(double *encs);
-
-    // not implemented
-    /**********************************************************/
-    bool getEncoder(int,double*)             { return false; }
-    bool resetEncoder(int)                   { return false; }
-    bool resetEncoders()                     { return false; }
-    bool setEncoder(int,double)              { return false; }
-    bool setEncoders(const double*)          { return false; }
-    bool getEncoderSpeed(int,double*)        { return false; }
-    bool getEncoderSpeeds(double*)           { return false; }
-    bool getEncoderAcceleration(int,double*) { return false; }
-    bool getEncoderAccelerations(double*)    { return false; }
+    bool getEncoderTimed(int j, double *encs, double *time);
+    bool getEncodersTimed(double *encs, double *time);
+    bool resetEncoder(int j);
+    bool resetEncoders();
+    bool setEncoder(int j, double val);
+    bool setEncoders(const double *vals);
+    bool getEncoderSpeed(int j, double *sp);
+    bool getEncoderSpeeds(double *spds);
+    bool getEncoderAcceleration(int j, double *spds);
+    bool getEncoderAccelerations(double *accs);
 
     ////////////////////////////////////////////////////////////
     ////
@@ -196,20 +460,25 @@ public:
     ////
     /**********************************************************/
     bool velocityMove(int j, double sp);
+    bool velocityMove(const int n_joint, const int *joints, const double *spds);
+    bool velocityMove(const double *sp);
     bool setRefAcceleration(int j, double acc);
+    bool setRefAccelerations(const int n_joint, const int *joints, const double *accs);
+    bool setRefAccelerations(const double *accs);
+    bool getRefAcceleration(int j, double *acc);
+    bool getRefAccelerations(const int n_joint, const int *joints, double *accs);
+    bool getRefAccelerations(double *accs);
     bool stop(int j);
+    bool stop(const int n_joint, const int *joints);
+    bool stop();
 
-    // not implemented
+    ////////////////////////////////////////////////////////////
+    ////
+    //// IFakeMotorDeviceInstrumentation Interface
+    ////
     /**********************************************************/
-    bool velocityMove(const int,const int*,const double*)        { return false; }
-    bool velocityMove(const double*)                             { return false; }
-    bool setRefAccelerations(const int,const int*,const double*) { return false; }
-    bool setRefAccelerations(const double*)                      { return false; }
-    bool getRefAccelerations(const int,const int*,double*)       { return false; }
-    bool getRefAcceleration(int,double*)                         { return false; }
-    bool getRefAccelerations(double*)                            { return false; }
-    bool stop(const int,const int*)                              { return false; }
-    bool stop()                                                  { return false; }
+    bool getStateLatency(FakeMotorLatency &latency);
+    void resetStateLatency();
 };
 
 #endif
@@ -18,6 +18,11 @@
 #include <private/fakeMotorDeviceComponents.h>
 
 #include <string>
+#include <vector>
+#include <atomic>
+#include <limits>
+#include <algorithm>
+#include <cmath>
 #include <stdio.h>
 
 using namespace std;
@@ -25,11 +30,73 @@ using namespace yarp::os;
 using namespace yarp::dev;
 using namespace yarp::sig;
 
+/**********************************************************/
+StateSnapshot::StateSnapshot() : seq(0), n(0)
+{
+}
+
+/**********************************************************/
+void StateSnapshot::resize(const size_t n)
+{
+    this->n=n;
+    data.reset(new atomic<double>[1+3*n]);
+    for (size_t i=0; i<1+3*n; i++)
+        data[i].store(0.0,memory_order_relaxed);
+    seq.store(0,memory_order_relaxed);
+}
+
+/**********************************************************/
+void StateSnapshot::write(const double t, const Vector &state)
+{
+    uint64_t s=seq.load(memory_order_relaxed);
+    seq.store(s+1,memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    data[0].store(t,memory_order_relaxed);
+    for (size_t i=0; i<3*n; i++)
+        data[1+i].store(state[i],memory_order_relaxed);
+
+    // publish the state only once it is complete
+    seq.store(s+2,memory_order_release);
+}
+
+/**********************************************************/
+bool StateSnapshot::read(const size_t offset, const size_t len, double *v,
+                         double *t) const
+{
+    if (offset+len>3*n)
+        return false;
+
+    while (true)
+    {
+        uint64_t s=seq.load(memory_order_acquire);
+        if (s==0)
+            return false;
+        if (s&1)
+            continue;
+
+        for (size_t i=0; i<len; i++)
+            v[i]=data[1+offset+i].load(memory_order_relaxed);
+        double t0=data[0].load(memory_order_relaxed);
+
+        // retry if the producer has meanwhile overwritten the state
+        atomic_thread_fence(memory_order_acquire);
+        if (seq.load(memory_order_relaxed)==s)
+        {
+            if (t!=NULL)
+                *t=t0;
+            return true;
+        }
+    }
+}
+
 /**********************************************************/
 fakeMotorDeviceClient::fakeMotorDeviceClient()
 {
     configured=false;
+    nJoints=0;
     statePort.setOwner(this);
+    resetStateLatency();
 }
 
 /**********************************************************/
@@ -43,21 +110,48 @@ bool fakeMotorDeviceClient::open(Searchable &config)
     statePort.open(local+"/state:i");
     cmdPort.open(local+"/cmd:o");
     rpcPort.open(local+"/rpc");
-    
-    bool ok=true;
-    ok&=Network::connect(remote+"/state:o",statePort.getName(),"udp");
-    ok&=Network::connect(cmdPort.getName(),remote+"/cmd:i","udp");
-    ok&=Network::connect(rpcPort.getName(),remote+"/rpc","tcp");
 
+    // the carriers of the connections: udp for the streams
+    // and tcp for the rpc, unless otherwise specified
+    string carrier=config.check("carrier",Value("")).asString();
+    if (carrier=="auto")
+    {
+        Contact server=Network::queryName(remote+"/rpc");
+        carrier=(server.isValid() && (server.getHost()==rpcPort.where().getHost()))?"shmem":"";
+    }
+    string stateCarrier=config.check("state_carrier",Value(carrier.empty()?"udp":carrier)).asString();
+    string cmdCarrier=config.check("cmd_carrier",Value(carrier.empty()?"tcp":carrier)).asString();
+    string rpcCarrier=config.check("rpc_carrier",Value(carrier.empty()?"tcp":carrier)).asString();
+
+    // the state snapshot is sized before the stream begins
+    bool ok=connect(rpcPort.getName(),remote+"/rpc",rpcCarrier,"tcp");
     if (ok)
     {
         configured=true;
 
+        int ax;
+        if (getAxes(&ax))
+        {
+            nJoints=(size_t)ax;
+            snapshot.resize(ax);
+        }
+        else
+            ok=false;
+    }
+
+    resetStateLatency();
+    ok&=connect(remote+"/state:o",statePort.getName(),stateCarrier,"udp");
+    ok&=connect(cmdPort.getName(),remote+"/cmd:i",cmdCarrier,"tcp");
+
+    if (ok)
+    {
         printf("Fake Motor Device Client successfully open\n");
         return true;
     }
     else
     {
+        configured=false;
+
         statePort.close();
         cmdPort.close();
         rpcPort.close();
@@ -86,6 +180,72 @@ bool fakeMotorDeviceClient::close()
     return true;
 }
 
+/**********************************************************/
+bool fakeMotorDeviceClient::connect(const string &src, const string &dest,
+                                    const string &carrier, const string &fallback)
+{
+    if (Network::connect(src,dest,carrier))
+        return true;
+
+    if (carrier==fallback)
+        return false;
+
+    printf("Unable to connect %s to %s through %s, falling back to %s\n",
+           src.c_str(),dest.c_str(),carrier.c_str(),fallback.c_str());
+    return Network::connect(src,dest,fallback);
+}
+
+/**********************************************************/
+void fakeMotorDeviceClient::probe(const double age)
+{
+    lock_guard<mutex> lg(mtxProbe);
+    latCount++;
+    latLast=age;
+    latSum+=age;
+    latSum2+=age*age;
+    latMin=std::min(latMin,age);
+    latMax=std::max(latMax,age);
+}
+
+/**********************************************************/
+bool fakeMotorDeviceClient::getStateLatency(FakeMotorLatency &latency)
+{
+    lock_guard<mutex> lg(mtxProbe);
+    if (latCount==0)
+        return false;
+
+    latency.count=latCount;
+    latency.last=latLast;
+    latency.mean=latSum/latCount;
+    latency.std=sqrt(std::max(0.0,latSum2/latCount-latency.mean*latency.mean));
+    latency.min=latMin;
+    latency.max=latMax;
+    return true;
+}
+
+/**********************************************************/
+void fakeMotorDeviceClient::resetStateLatency()
+{
+    lock_guard<mutex> lg(mtxProbe);
+    latCount=0;
+    latLast=latSum=latSum2=0.0;
+    latMin=numeric_limits<double>::max();
+    latMax=-numeric_limits<double>::max();
+}
+
+/**********************************************************/
+bool fakeMotorDeviceClient::sendRpc(const Bottle &cmd, Bottle *reply)
+{
+    Bottle rep;
+    if (reply==NULL)
+        reply=&rep;
+
+    if (rpcPort.write(cmd,*reply))
+        return (reply->get(0).asVocab32()==FAKEMOT_VOCAB_ACK);
+    else
+        return false;
+}
+
 /**********************************************************/
 bool fakeMotorDeviceClient::getLimits(int axis, double *min, double *max)
 {
@@ -93,10 +253,10 @@ bool fakeMotorDeviceClient::getLimits(int axis, double *min, double *max)
         return false;
 
     Bottle cmd,reply;
-    cmd.addVocab32("lim");
-    cmd.addVocab32("get");
+    cmd.addVocab32(FAKEMOT_VOCAB_IF_LIM);
+    cmd.addVocab32(FAKEMOT_VOCAB_GET);
     cmd.addInt32(axis);
-    if (rpcPort.write(cmd,reply))
+    if (sendRpc(cmd,&reply))
     {
         *min=reply.get(1).asFloat64();
         *max=reply.get(2).asFloat64();
@@ -107,6 +267,57 @@ bool fakeMotorDeviceClient::getLimits(int axis, double *min, double *max)
         return false;
 }
 
+/**********************************************************/
+bool fakeMotorDeviceClient::setLimits(int axis, double min, double max)
+{
+    if (!configured)
+        return false;
+
+    Bottle cmd;
+    cmd.addVocab32(FAKEMOT_VOCAB_IF_LIM);
+    cmd.addVocab32(FAKEMOT_VOCAB_SET);
+    cmd.addInt32(axis);
+    cmd.addFloat64(min);
+    cmd.addFloat64(max);
+    return sendRpc(cmd);
+}
+
+/**********************************************************/
+bool fakeMotorDeviceClient::getVelLimits(int axis, double *min, double *max)
+{
+    if (!configured || (min==NULL) || (max==NULL))
+        return false;
+
+    Bottle cmd,reply;
+    cmd.addVocab32(FAKEMOT_VOCAB_IF_LIM);
+    cmd.addVocab32(FAKEMOT_VOCAB_VGET);
+    cmd.addInt32(axis);
+    if (sendRpc(cmd,&reply))
+    {
+        *min=reply.get(1).asFloat64();
+        *max=reply.get(2).asFloat64();
+
+        return true;
+    }
+    else
+        return false;
+}
+
+/**********************************************************/
+bool fakeMotorDeviceClient::setVelLimits(int axis, double min, double max)
+{
+    if (!configured)
+        return false;
+
+    Bottle cmd;
+    cmd.addVocab32(FAKEMOT_VOCAB_IF_LIM);
+    cmd.addVocab32(FAKEMOT_VOCAB_VSET);
+    cmd.addInt32(axis);
+    cmd.addFloat64(min);
+    cmd.addFloat64(max);
+    return sendRpc(cmd);
+}
+
 /**********************************************************/
 bool fakeMotorDeviceClient::getAxes(int *ax)
 {
@@ -114,9 +325,9 @@ bool fakeMotorDeviceClient::getAxes(int *ax)
         return false;
 
     Bottle cmd,reply;
-    cmd.addVocab32("enc");
-    cmd.addVocab32("axes");
-    if (rpcPort.write(cmd,reply))
+    cmd.addVocab32(FAKEMOT_VOCAB_IF_ENC);
+    cmd.addVocab32(FAKEMOT_VOCAB_AXES);
+    if (sendRpc(cmd,&reply))
     {
         *ax=reply.get(1).asInt32();
         return true;
@@ -126,33 +337,195 @@ bool fakeMotorDeviceClient::getAxes(int *ax)
 }
 
 /**********************************************************/
-bool fakeMotorDeviceClient::getEncoders(double *encs)
+bool fakeMotorDeviceClient::getState(const size_t block, int j, double *v, double *time)
+{
+    if (!configured || (j<0) || ((size_t)j>=snapshot.size()) || (v==NULL))
+        return false;
+
+    return snapshot.read(block*snapshot.size()+j,1,v,time);
+}
+
+/**********************************************************/
+bool fakeMotorDeviceClient::getState(const size_t block, double *v, double *time)
 {
-    if (!configured || (encs==NULL))
+    if (!configured || (v==NULL))
+        return false;
+
+    double t;
+    if (!snapshot.read(block*snapshot.size(),snapshot.size(),v,&t))
         return false;
 
-    lock_guard<mutex> lg(mtx);
-    for (size_t i=0; i<this->encs.length(); i++)
-        encs[i]=this->encs[i];
+    if (time!=NULL)
+        for (size_t i=0; i<snapshot.size(); i++)
+            time[i]=t;
 
     return true;
 }
 
 /**********************************************************/
-bool fakeMotorDeviceClient::velocityMove(int j, double sp)
+bool fakeMotorDeviceClient::getEncoder(int j, double *v)
+{
+    return getState(0,j,v);
+}
+
+/**********************************************************/
+bool fakeMotorDeviceClient::getEncoders(double *encs)
+{
+    return getState(0,encs);
+}
+
+/**********************************************************/
+bool fakeMotorDeviceClient::getEncoderTimed(int j, double *encs, double *time)
+{
+    if (time==NULL)
+        return false;
+
+    return getState(0,j,encs,time);
+}
+
+/**********************************************************/
+bool fakeMotorDeviceClient::getEncodersTimed(double *encs, double *time)
+{
+    if (time==NULL)
+        return false;
+
+    return getState(0,encs,time);
+}
+
+/**********************************************************/
+bool fakeMotorDeviceClient::resetEncoder(int j)
 {
     if (!configured)
         return false;
 
-    Bottle cmd,reply;
-    cmd.addVocab32("vel");
-    cmd.addVocab32("move");
+    Bottle cmd;
+    cmd.addVocab32(FAKEMOT_VOCAB_IF_ENC);
+    cmd.addVocab32(FAKEMOT_VOCAB_RST);
     cmd.addInt32(j);
-    cmd.addFloat64(sp);
-    if (rpcPort.write(cmd,reply))
-        return true;
-    else
+    return sendRpc(cmd);
+}
+
+/**********************************************************/
+bool fakeMotorDeviceClient::resetEncoders()
+{
+    if (!configured)
         return false;
+
+    Bottle cmd;
+    cmd.addVocab32(FAKEMOT_VOCAB_IF_ENC);
+    cmd.addVocab32(FAKEMOT_VOCAB_RST);
+    return sendRpc(cmd);
+}
+
+/**********************************************************/
+bool fakeMotorDeviceClient::setEncoder(int j, double val)
+{
+    if (!configured)
+        return false;
+
+    Bottle cmd;
+    cmd.addVocab32(FAKEMOT_VOCAB_IF_ENC);
+    cmd.addVocab32(FAKEMOT_VOCAB_SET);
+    cmd.addInt32(j);
+    cmd.addFloat64(val);
+    return sendRpc(cmd);
+}
+
+/**********************************************************/
+bool fakeMotorDeviceClient::setEncoders(const double *vals)
+{
+    if (!configured || (vals==NULL))
+        return false;
+
+    Bottle cmd;
+    cmd.addVocab32(FAKEMOT_VOCAB_IF_ENC);
+    cmd.addVocab32(FAKEMOT_VOCAB_SET);
+    Bottle &b=cmd.addList();
+    for (size_t i=0; i<nJoints; i++)
+        b.addFloat64(vals[i]);
+    return sendRpc(cmd);
+}
+
+/**********************************************************/
+bool fakeMotorDeviceClient::getEncoderSpeed(int j, double *sp)
+{
+    return getState(1,j,sp);
+}
+
+/**********************************************************/
+bool fakeMotorDeviceClient::getEncoderSpeeds(double *spds)
+{
+    return getState(1,spds);
+}
+
+/**********************************************************/
+bool fakeMotorDeviceClient::getEncoderAcceleration(int j, double *spds)
+{
+    return getState(2,j,spds);
+}
+
+/**********************************************************/
+bool fakeMotorDeviceClient::getEncoderAccelerations(double *accs)
+{
+    return getState(2,accs);
+}
+
+/**********************************************************/
+void fakeMotorDeviceClient::sendVelocities(const int n_joint, const int *joints,
+                                           const double *spds)
+{
+    // only the commanded joints are streamed, so that the
+    // commands of other clients on the same part are left
+    // untouched; the messages are queued by the server,
+    // hence they are written in order
+    Bottle &cmd=cmdPort.prepare();
+    cmd.clear();
+    Bottle &j=cmd.addList();
+    Bottle &v=cmd.addList();
+    for (int i=0; i<n_joint; i++)
+    {
+        j.addInt32((joints!=NULL)?joints[i]:i);
+        v.addFloat64((spds!=NULL)?spds[i]:0.0);
+    }
+    cmdPort.write(true);
+}
+
+/**********************************************************/
+bool fakeMotorDeviceClient::velocityMove(int j, double sp)
+{
+    if (!configured || (j<0) || ((size_t)j>=nJoints))
+        return false;
+
+    lock_guard<mutex> lg(mtxCmd);
+    sendVelocities(1,&j,&sp);
+    return true;
+}
+
+/**********************************************************/
+bool fakeMotorDeviceClient::velocityMove(const int n_joint, const int *joints,
+                                         const double *spds)
+{
+    if (!configured || (joints==NULL) || (spds==NULL))
+        return false;
+
+    for (int i=0; i<n_joint; i++)
+        if ((joints[i]<0) || ((size_t)joints[i]>=nJoints))
+            return false;
+
+    lock_guard<mutex> lg(mtxCmd);
+    sendVelocities(n_joint,joints,spds);
+    return true;
+}
+
+/**********************************************************/
+bool fakeMotorDeviceClient::velocityMove(const double *sp)
+{
+    if (!configured || (sp==NULL))
+        return false;
+
+    lock_guard<mutex> lg(mtxCmd);
+    sendVelocities((int)nJoints,NULL,sp);
+    return true;
 }
 
 /**********************************************************/
@@ -161,32 +534,178 @@ bool fakeMotorDeviceClient::setRefAcceleration(int j, double acc)
     if (!configured)
         return false;
 
-    Bottle cmd,reply;
-    cmd.addVocab32("vel");
-    cmd.addVocab32("acc");
+    Bottle cmd;
+    cmd.addVocab32(FAKEMOT_VOCAB_IF_VEL);
+    cmd.addVocab32(FAKEMOT_VOCAB_ACC);
     cmd.addInt32(j);
     cmd.addFloat64(acc);
-    if (rpcPort.write(cmd,reply))
-        return true;
-    else
+    return sendRpc(cmd);
+}
+
+/**********************************************************/
+bool fakeMotorDeviceClient::setRefAccelerations(const int n_joint, const int *joints,
+                                                const double *accs)
+{
+    if (!configured || (joints==NULL) || (accs==NULL))
         return false;
+
+    Bottle cmd;
+    cmd.addVocab32(FAKEMOT_VOCAB_IF_VEL);
+    cmd.addVocab32(FAKEMOT_VOCAB_ACC);
+    Bottle &j=cmd.addList();
+    Bottle &a=cmd.addList();
+    for (int i=0; i<n_joint; i++)
+    {
+        j.addInt32(joints[i]);
+        a.addFloat64(accs[i]);
+    }
+    return sendRpc(cmd);
 }
 
 /**********************************************************/
-bool fakeMotorDeviceClient::stop(int j)
+bool fakeMotorDeviceClient::setRefAccelerations(const double *accs)
 {
-    if (!configured)
+    if (!configured || (accs==NULL))
+        return false;
+
+    Bottle cmd;
+    cmd.addVocab32(FAKEMOT_VOCAB_IF_VEL);
+    cmd.addVocab32(FAKEMOT_VOCAB_ACC);
+    Bottle &a=cmd.addList();
+    for (size_t i=0; i<nJoints; i++)
+        a.addFloat64(accs[i]);
+    return sendRpc(cmd);
+}
+
+/**********************************************************/
+bool fakeMotorDeviceClient::getRefAcceleration(int j, double *acc)
+{
+    if (!configured || (acc==NULL))
         return false;
 
     Bottle cmd,reply;
-    cmd.addVocab32("vel");
-    cmd.addVocab32("stop");
+    cmd.addVocab32(FAKEMOT_VOCAB_IF_VEL);
+    cmd.addVocab32(FAKEMOT_VOCAB_GACC);
     cmd.addInt32(j);
-    if (rpcPort.write(cmd,reply))
+    if (sendRpc(cmd,&reply))
+    {
+        *acc=reply.get(1).asFloat64();
         return true;
+    }
     else
         return false;
 }
 
+/**********************************************************/
+bool fakeMotorDeviceClient::getRefAccelerations(const int n_joint, const int *joints,
+                                                double *accs)
+{
+    if ((joints==NULL) || (accs==NULL))
+        return false;
+
+    // one round-trip for all the joints, then pick up the group
+    vector<double> all(nJoints);
+    if (!getRefAccelerations(all.data()))
+        return false;
+
+    for (int i=0; i<n_joint; i++)
+    {
+        if ((joints[i]<0) || ((size_t)joints[i]>=all.size()))
+            return false;
+        accs[i]=all[joints[i]];
+    }
+
+    return true;
+}
+
+/**********************************************************/
+bool fakeMotorDeviceClient::getRefAccelerations(double *accs)
+{
+    if (!configured || (accs==NULL))
+        return false;
+
+    Bottle cmd,reply;
+    cmd.addVocab32(FAKEMOT_VOCAB_IF_VEL);
+    cmd.addVocab32(FAKEMOT_VOCAB_GACC);
+    if (sendRpc(cmd,&reply))
+    {
+        if (Bottle *a=reply.get(1).asList())
+        {
+            if (a->size()==nJoints)
+            {
+                for (size_t i=0; i<a->size(); i++)
+                    accs[i]=a->get(i).asFloat64();
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+/**********************************************************/
+bool fakeMotorDeviceClient::stop(int j)
+{
+    if (!configured || (j<0) || ((size_t)j>=nJoints))
+        return false;
+
+    // the stop goes through the rpc to be reliable; the
+    // velocity is cleared also in the stream, otherwise a
+    // queued command would make the joint move again; the
+    // lock is released before the rpc round-trip not to
+    // stall the concurrent streaming
+    {
+        lock_guard<mutex> lg(mtxCmd);
+        sendVelocities(1,&j,NULL);
+    }
+
+    Bottle cmd;
+    cmd.addVocab32(FAKEMOT_VOCAB_IF_VEL);
+    cmd.addVocab32(FAKEMOT_VOCAB_STOP);
+    cmd.addInt32(j);
+    return sendRpc(cmd);
+}
+
+/**********************************************************/
+bool fakeMotorDeviceClient::stop(const int n_joint, const int *joints)
+{
+    if (!configured || (joints==NULL))
+        return false;
+
+    for (int i=0; i<n_joint; i++)
+        if ((joints[i]<0) || ((size_t)joints[i]>=nJoints))
+            return false;
+
+    Bottle cmd;
+    cmd.addVocab32(FAKEMOT_VOCAB_IF_VEL);
+    cmd.addVocab32(FAKEMOT_VOCAB_STOP);
+    Bottle &b=cmd.addList();
+    for (int i=0; i<n_joint; i++)
+        b.addInt32(joints[i]);
+
+    {
+        lock_guard<mutex> lg(mtxCmd);
+        sendVelocities(n_joint,joints,NULL);
+    }
+
+    return sendRpc(cmd);
+}
+
+/**********************************************************/
+bool fakeMotorDeviceClient::stop()
+{
+    if (!configured)
+        return false;
+
+    {
+        lock_guard<mutex> lg(mtxCmd);
+        sendVelocities((int)nJoints,NULL,NULL);
+    }
+
+    Bottle cmd;
+    cmd.addVocab32(FAKEMOT_VOCAB_IF_VEL);
+    cmd.addVocab32(FAKEMOT_VOCAB_STOP);
+    return sendRpc(cmd);
+}
 
 
@@ -17,20 +17,99 @@
 
 #include <private/fakeMotorDeviceComponents.h>
 
+#include <cmath>
 #include <string>
+#include <vector>
+#include <limits>
+#include <algorithm>
 #include <stdio.h>
 
 using namespace std;
 using namespace yarp::os;
 using namespace yarp::dev;
 using namespace yarp::sig;
-using namespace iCub::ctrl;
+
+namespace
+{
+    /******************************************************/
+    vector<int> toJoints(const Bottle *b)
+    {
+        vector<int> joints;
+        if (b!=NULL)
+            for (size_t i=0; i<b->size(); i++)
+                joints.push_back(b->get(i).asInt32());
+        return joints;
+    }
+
+    /******************************************************/
+    vector<double> toValues(const Bottle *b)
+    {
+        vector<double> values;
+        if (b!=NULL)
+            for (size_t i=0; i<b->size(); i++)
+                values.push_back(b->get(i).asFloat64());
+        return values;
+    }
+
+    /******************************************************/
+    void expm2(const double A[2][2], double E[2][2])
+    {
+        // scaling and squaring of the Taylor series
+        double norm=std::max(fabs(A[0][0])+fabs(A[0][1]),fabs(A[1][0])+fabs(A[1][1]));
+        int s=0;
+        while (norm>0.5)
+        {
+            norm/=2.0;
+            s++;
+        }
+
+        double M[2][2],T[2][2]={{1.0,0.0},{0.0,1.0}};
+        double scale=ldexp(1.0,-s);
+        for (int r=0; r<2; r++)
+            for (int c=0; c<2; c++)
+            {
+                M[r][c]=scale*A[r][c];
+                E[r][c]=T[r][c];
+            }
+
+        for (int k=1; k<=12; k++)
+        {
+            double P[2][2];
+            for (int r=0; r<2; r++)
+                for (int c=0; c<2; c++)
+                    P[r][c]=(T[r][0]*M[0][c]+T[r][1]*M[1][c])/k;
+            for (int r=0; r<2; r++)
+                for (int c=0; c<2; c++)
+                {
+                    T[r][c]=P[r][c];
+                    E[r][c]+=T[r][c];
+                }
+        }
+
+        for (int i=0; i<s; i++)
+        {
+            double P[2][2];
+            for (int r=0; r<2; r++)
+                for (int c=0; c<2; c++)
+                    P[r][c]=E[r][0]*E[0][c]+E[r][1]*E[1][c];
+            for (int r=0; r<2; r++)
+                for (int c=0; c<2; c++)
+                    E[r][c]=P[r][c];
+        }
+    }
+}
 
 /**********************************************************/
 fakeMotorDeviceServer::fakeMotorDeviceServer() : PeriodicThread(0.01)
 {
-    motors=NULL;
     configured=false;
+    externalThread=false;
+    Ts=0.01;
+    tau=wn=zeta=0.0;
+    dynamics=INTEGRATOR;
+    lag=0.0;
+    phi[0][0]=phi[1][1]=1.0;
+    phi[0][1]=phi[1][0]=0.0;
 }
 
 /**********************************************************/
@@ -39,36 +118,137 @@ bool fakeMotorDeviceServer::open(Searchable &config)
     printf("Opening Fake Motor Device Server ...\n");
 
     string local=config.check("local",Value("/fakeyServer")).asString();
-    int Ts=config.check("Ts",Value(10)).asInt32();
+    int period=config.check("Ts",Value(10)).asInt32();
+    if (period<=0)
+    {
+        printf("Invalid sample time %d [ms]\n",period);
+        return false;
+    }
+    Ts=(double)period/1000.0;
+
+    // the joints bounds are given in degrees
+    if (Bottle *b=config.find("limits").asList())
+    {
+        lim.resize((int)b->size(),2);
+        for (int i=0; i<lim.rows(); i++)
+        {
+            Bottle *l=b->get(i).asList();
+            if ((l==NULL) || (l->size()<2))
+            {
+                printf("Invalid limits for joint %d\n",i);
+                return false;
+            }
+            lim(i,0)=l->get(0).asFloat64();
+            lim(i,1)=l->get(1).asFloat64();
+        }
+    }
+    else if (config.check("joints"))
+    {
+        int joints=config.find("joints").asInt32();
+        if (joints<=0)
+        {
+            printf("Invalid number of joints %d\n",joints);
+            return false;
+        }
+
+        lim.resize(joints,2);
+        for (int i=0; i<lim.rows(); i++)
+        {
+            lim(i,0)=config.check("min",Value(-180.0)).asFloat64();
+            lim(i,1)=config.check("max",Value(180.0)).asFloat64();
+        }
+    }
+    else
+    {
+        // by default, the part is composed of three rotational joints
+        lim.resize(3,2);
+        lim(0,0)=-180.0; lim(0,1)=180.0;    // joint 0
+        lim(1,0)=-90.0;  lim(1,1)=90.0;     // joint 1
+        lim(2,0)=-45.0;  lim(2,1)=45.0;     // joint 2
+    }
+
+    if (lim.rows()<=0)
+    {
+        printf("The part needs at least one joint\n");
+        return false;
+    }
+
+    for (int i=0; i<lim.rows(); i++)
+    {
+        if (lim(i,0)>lim(i,1))
+        {
+            printf("Invalid limits for joint %d: min %g > max %g\n",i,lim(i,0),lim(i,1));
+            return false;
+        }
+    }
+
+    string dynamicsName=config.check("dynamics",Value("integrator")).asString();
+    tau=config.check("tau",Value(0.05)).asFloat64();
+    wn=config.check("wn",Value(30.0)).asFloat64();
+    zeta=config.check("zeta",Value(0.7)).asFloat64();
+    if (dynamicsName=="integrator")
+        dynamics=INTEGRATOR;
+    else if ((dynamicsName=="first_order") && (tau>0.0))
+        dynamics=FIRST_ORDER;
+    else if ((dynamicsName=="second_order") && (wn>0.0) && (zeta>=0.0))
+        dynamics=SECOND_ORDER;
+    else
+    {
+        printf("Invalid dynamics \"%s\"\n",dynamicsName.c_str());
+        return false;
+    }
+
+    // the dynamics are discretized exactly with the commanded
+    // velocities held over the sample, hence they stay stable
+    // whatever the sample time: the first order lag is
+    // e(k+1)=exp(-Ts/tau)*e(k), and the second order system
+    // [e;de](k+1)=expm(A*Ts)*[e;de](k), with A=[0 1; -wn^2 -2*zeta*wn]
+    // and e the actual minus the commanded velocity
+    lag=(dynamics==FIRST_ORDER)?exp(-Ts/tau):0.0;
+    double A[2][2]={{0.0,1.0},{-wn*wn,-2.0*zeta*wn}};
+    for (int r=0; r<2; r++)
+        for (int c=0; c<2; c++)
+            A[r][c]*=Ts;
+    expm2(A,phi);
+
+    externalThread=(config.check("thread",Value("own")).asString()=="external");
 
     statePort.open(local+"/state:o");
+    cmdPort.setStrict();
     cmdPort.open(local+"/cmd:i");
     rpcPort.open(local+"/rpc");
     rpcPort.setReader(*this);
- 
-    // the part is composed of three rotational joints
-    // whose bounds are given in degrees just below
-    Matrix lim(3,2);
-    lim(0,0)=-180.0; lim(0,1)=180.0;    // joint 0
-    lim(1,0)=-90.0;  lim(1,1)=90.0;     // joint 1
-    lim(2,0)=-45.0;  lim(2,1)=45.0;     // joint 2
 
     Vector q0;
     for (int i=0; i<lim.rows(); i++)
         q0.push_back((lim(i,0)+lim(i,1))/2.0);
 
     // the motors themselves are represented
-    // by pure integrators that give back joints
+    // by integrators that give back joints
     // positions when fed with joints velocities
-    motors=new Integrator((double)Ts/1000.0,q0,lim);
-    vel.resize(motors->get().length(),0.0);        
+    vel.resize(q0.length(),0.0);
+    acc=dq=ddq=velAct=velOld=accAct=cmdVel=vel;
+    cmdMask.assign(vel.length(),0);
+    q=q0;
 
-    setPeriod((double)Ts/1000.0);
-    start();
+    // no velocity limits by default
+    velLim.resize(vel.length(),2);
+    for (int i=0; i<velLim.rows(); i++)
+    {
+        velLim(i,0)=0.0;
+        velLim(i,1)=numeric_limits<double>::max();
+    }
 
     configured=true;
 
-    printf("Fake Motor Device Server successfully open\n");
+    if (!externalThread)
+    {
+        setPeriod(Ts);
+        start();
+    }
+
+    printf("Fake Motor Device Server successfully open with %d joints (%s)\n",
+           (int)vel.length(),dynamicsName.c_str());
     return true;
 }
 
@@ -78,10 +258,11 @@ bool fakeMotorDeviceServer::close()
     printf("Closing Fake Motor Device Server ...\n");
 
     if (isRunning())
-        stop();
+        PeriodicThread::stop();
 
+    // prevent an external thread from stepping further
     mtx.lock();
-    PeriodicThread::stop();
+    configured=false;
     mtx.unlock();
 
     statePort.interrupt();
@@ -92,12 +273,6 @@ bool fakeMotorDeviceServer::close()
     cmdPort.close();
     rpcPort.close();
 
-    if (motors!=NULL)
-    {
-        delete motors;
-        motors=NULL;
-    }
-
     configured=false;
 
     printf("Fake Motor Device Server successfully closed\n");
@@ -107,83 +282,404 @@ bool fakeMotorDeviceServer::close()
 /**********************************************************/
 void fakeMotorDeviceServer::run()
 {
-    lock_guard<mutex> lg(mtx);
-    if (Bottle *cmd=cmdPort.read(false))
-    {
-        if ((size_t)cmd->size()>=vel.length())
-            for (size_t i=0; i<vel.length(); i++)
-                vel[i]=cmd->get(i).asFloat64();
-    }
-
-    statePort.prepare()=motors->integrate(vel);
-    statePort.write();
+    step(Time::now());
 }
 
 /**********************************************************/
-bool fakeMotorDeviceServer::read(ConnectionReader &connection)
-{        
-    Bottle cmd,reply;
-    cmd.read(connection);
-    
-    mtx.lock();
-
-    int codeIF=cmd.get(0).asVocab32();
-    int codeMethod=cmd.get(1).asVocab32();
-
-    if (codeIF==Vocab32::encode("lim"))
+void fakeMotorDeviceServer::step(const double time)
+{
+    // the commands queued since the last step are decoded in
+    // order before locking the state: each one carries the
+    // ((joints) (values)) being commanded, the later ones
+    // overriding the earlier ones on the same joints
+    bool newCmd=false;
+    while (Bottle *cmd=cmdPort.read(false))
     {
-        if (codeMethod==Vocab32::encode("get"))
+        Bottle *joints=cmd->get(0).asList();
+        Bottle *values=cmd->get(1).asList();
+        if ((joints==NULL) || (values==NULL) || (joints->size()!=values->size()))
+            continue;
+
+        for (size_t k=0; k<joints->size(); k++)
         {
-            int axis=cmd.get(2).asInt32();
-            double min,max;
-            if (getLimits(axis,&min,&max))
+            int j=joints->get(k).asInt32();
+            if ((j>=0) && ((size_t)j<cmdVel.length()))
             {
-                reply.addVocab32("ack");
-                reply.addFloat64(min);
-                reply.addFloat64(max);
+                cmdVel[j]=values->get(k).asFloat64();
+                cmdMask[j]=1;
+                newCmd=true;
             }
         }
     }
-    else if (codeIF==Vocab32::encode("enc"))
+
+    // the state is computed in place into the buffer of the port,
+    // which gets resized only when it is handed out the first time
+    size_t n=vel.length();
+    Vector &state=statePort.prepare();
+    if (state.length()!=3*n+1)
+        state.resize(3*n+1);
+
     {
-        if (codeMethod==Vocab32::encode("axes"))
+        lock_guard<mutex> lg(mtx);
+        if (!configured)
+        {
+            statePort.unprepare();
+            return;
+        }
+
+        if (newCmd)
         {
-            int ax;
-            if (getAxes(&ax))
+            for (size_t i=0; i<n; i++)
             {
-                reply.addVocab32("ack");
-                reply.addInt32(ax);
+                if (cmdMask[i])
+                {
+                    velocityMoveUnlocked((int)i,cmdVel[i]);
+                    cmdMask[i]=0;
+                }
             }
         }
-    }
-    else if (codeIF==Vocab32::encode("vel"))
-    {
-        if (codeMethod==Vocab32::encode("move"))
+
+        // the motors velocities respond to the commanded ones
+        if (dynamics==FIRST_ORDER)
+        {
+            for (size_t i=0; i<n; i++)
+                velAct[i]=vel[i]+lag*(velAct[i]-vel[i]);
+        }
+        else if (dynamics==SECOND_ORDER)
         {
-            int axis=cmd.get(2).asInt32();
-            double sp=cmd.get(3).asFloat64();
-            if (velocityMove(axis,sp))
-                reply.addVocab32("ack");
+            for (size_t i=0; i<n; i++)
+            {
+                double e=velAct[i]-vel[i];
+                double de=accAct[i];
+                velAct[i]=vel[i]+phi[0][0]*e+phi[0][1]*de;
+                accAct[i]=phi[1][0]*e+phi[1][1]*de;
+            }
         }
-        else if (codeMethod==Vocab32::encode("acc"))
+        else
         {
-            int axis=cmd.get(2).asInt32();
-            double acc=cmd.get(3).asFloat64();
-            if (setRefAcceleration(axis,acc))
-                reply.addVocab32("ack");
+            for (size_t i=0; i<n; i++)
+                velAct[i]=vel[i];
         }
-        else if (codeMethod==Vocab32::encode("stop"))
+
+        // the velocities are integrated through the trapezoidal rule
+        // within the bounds; the velocities and accelerations are then
+        // measured from the joints positions as true encoders
+        for (size_t i=0; i<n; i++)
         {
-            int axis=cmd.get(2).asInt32();
-            if (stop(axis))
-                reply.addVocab32("ack");
+            double qn=q[i]+0.5*Ts*(velAct[i]+velOld[i]);
+            qn=std::min(std::max(qn,lim(i,0)),lim(i,1));
+            velOld[i]=velAct[i];
+
+            double dqn=(qn-q[i])/Ts;
+            ddq[i]=(dqn-dq[i])/Ts;
+            dq[i]=dqn;
+            q[i]=qn;
+
+            state[i]=q[i];
+            state[n+i]=dq[i];
+            state[2*n+i]=ddq[i];
         }
+        stamp.update(time);
+
+        // the time travels within the state rather than in the
+        // envelope, which yarp would serialize into a string
+        state[3*n]=stamp.getTime();
     }
 
-    if (reply.size()==0)
-        reply.addVocab32("nack");
+    // the state is streamed out with the lock released
+    statePort.write();
+}
 
-    mtx.unlock();
+/**********************************************************/
+const fakeMotorDeviceServer::RpcEntry fakeMotorDeviceServer::rpcTable[]=
+{
+    {FAKEMOT_RPC_KEY(FAKEMOT_VOCAB_IF_LIM,FAKEMOT_VOCAB_GET),  &fakeMotorDeviceServer::rpcGetLimits},
+    {FAKEMOT_RPC_KEY(FAKEMOT_VOCAB_IF_LIM,FAKEMOT_VOCAB_VGET), &fakeMotorDeviceServer::rpcGetVelLimits},
+    {FAKEMOT_RPC_KEY(FAKEMOT_VOCAB_IF_LIM,FAKEMOT_VOCAB_SET),  &fakeMotorDeviceServer::rpcSetLimits},
+    {FAKEMOT_RPC_KEY(FAKEMOT_VOCAB_IF_LIM,FAKEMOT_VOCAB_VSET), &fakeMotorDeviceServer::rpcSetVelLimits},
+    {FAKEMOT_RPC_KEY(FAKEMOT_VOCAB_IF_ENC,FAKEMOT_VOCAB_AXES), &fakeMotorDeviceServer::rpcAxes},
+    {FAKEMOT_RPC_KEY(FAKEMOT_VOCAB_IF_ENC,FAKEMOT_VOCAB_SET),  &fakeMotorDeviceServer::rpcSetEncoders},
+    {FAKEMOT_RPC_KEY(FAKEMOT_VOCAB_IF_ENC,FAKEMOT_VOCAB_RST),  &fakeMotorDeviceServer::rpcResetEncoders},
+    {FAKEMOT_RPC_KEY(FAKEMOT_VOCAB_IF_VEL,FAKEMOT_VOCAB_MOVE), &fakeMotorDeviceServer::rpcVelocityMove},
+    {FAKEMOT_RPC_KEY(FAKEMOT_VOCAB_IF_VEL,FAKEMOT_VOCAB_ACC),  &fakeMotorDeviceServer::rpcSetAccelerations},
+    {FAKEMOT_RPC_KEY(FAKEMOT_VOCAB_IF_VEL,FAKEMOT_VOCAB_GACC), &fakeMotorDeviceServer::rpcGetAccelerations},
+    {FAKEMOT_RPC_KEY(FAKEMOT_VOCAB_IF_VEL,FAKEMOT_VOCAB_STOP), &fakeMotorDeviceServer::rpcStop}
+};
+
+/**********************************************************/
+bool fakeMotorDeviceServer::rpcGetLimits(const Bottle &cmd, Bottle &reply)
+{
+    int axis=cmd.get(2).asInt32();
+    double min,max;
+    if (!locked([&]() { return getLimitsUnlocked(axis,&min,&max); }))
+        return false;
+
+    reply.addVocab32(FAKEMOT_VOCAB_ACK);
+    reply.addFloat64(min);
+    reply.addFloat64(max);
+    return true;
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::rpcGetVelLimits(const Bottle &cmd, Bottle &reply)
+{
+    int axis=cmd.get(2).asInt32();
+    double min,max;
+    if (!locked([&]() { return getVelLimitsUnlocked(axis,&min,&max); }))
+        return false;
+
+    reply.addVocab32(FAKEMOT_VOCAB_ACK);
+    reply.addFloat64(min);
+    reply.addFloat64(max);
+    return true;
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::rpcSetLimits(const Bottle &cmd, Bottle &reply)
+{
+    int axis=cmd.get(2).asInt32();
+    double min=cmd.get(3).asFloat64();
+    double max=cmd.get(4).asFloat64();
+    if (!locked([&]() { return setLimitsUnlocked(axis,min,max); }))
+        return false;
+
+    reply.addVocab32(FAKEMOT_VOCAB_ACK);
+    return true;
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::rpcSetVelLimits(const Bottle &cmd, Bottle &reply)
+{
+    int axis=cmd.get(2).asInt32();
+    double min=cmd.get(3).asFloat64();
+    double max=cmd.get(4).asFloat64();
+    if (!locked([&]() { return setVelLimitsUnlocked(axis,min,max); }))
+        return false;
+
+    reply.addVocab32(FAKEMOT_VOCAB_ACK);
+    return true;
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::rpcAxes(const Bottle &cmd, Bottle &reply)
+{
+    int ax;
+    if (!locked([&]() { return getAxesUnlocked(&ax); }))
+        return false;
+
+    reply.addVocab32(FAKEMOT_VOCAB_ACK);
+    reply.addInt32(ax);
+    return true;
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::rpcSetEncoders(const Bottle &cmd, Bottle &reply)
+{
+    bool ok;
+    const Value &arg=cmd.get(2);
+    if (arg.isList())
+    {
+        vector<double> vals=toValues(arg.asList());
+        ok=(vals.size()==vel.length()) && locked([&]() { return setEncodersUnlocked(vals.data()); });
+    }
+    else
+    {
+        int axis=arg.asInt32();
+        double val=cmd.get(3).asFloat64();
+        ok=locked([&]() { return setEncoderUnlocked(axis,val); });
+    }
+
+    if (ok)
+        reply.addVocab32(FAKEMOT_VOCAB_ACK);
+    return ok;
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::rpcResetEncoders(const Bottle &cmd, Bottle &reply)
+{
+    bool all=cmd.get(2).isNull();
+    int axis=cmd.get(2).asInt32();
+    if (!locked([&]() { return all?resetEncodersUnlocked():resetEncoderUnlocked(axis); }))
+        return false;
+
+    reply.addVocab32(FAKEMOT_VOCAB_ACK);
+    return true;
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::toJointValues(const Bottle &cmd, vector<int> &joints,
+                                          vector<double> &vals) const
+{
+    // j v | (v0 ... vn-1) | (j ...) (v ...)
+    const Value &arg=cmd.get(2);
+    if (arg.isList() && cmd.get(3).isList())
+    {
+        joints=toJoints(arg.asList());
+        vals=toValues(cmd.get(3).asList());
+    }
+    else if (arg.isList())
+    {
+        vals=toValues(arg.asList());
+        joints.resize(vals.size());
+        for (size_t i=0; i<joints.size(); i++)
+            joints[i]=(int)i;
+        if (vals.size()!=vel.length())
+            return false;
+    }
+    else
+    {
+        joints.assign(1,arg.asInt32());
+        vals.assign(1,cmd.get(3).asFloat64());
+    }
+
+    return (joints.size()==vals.size());
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::rpcVelocityMove(const Bottle &cmd, Bottle &reply)
+{
+    vector<int> joints;
+    vector<double> vals;
+    if (!toJointValues(cmd,joints,vals))
+        return false;
+
+    int n=(int)joints.size();
+    if (!locked([&]() { return velocityMoveUnlocked(n,joints.data(),vals.data()); }))
+        return false;
+
+    reply.addVocab32(FAKEMOT_VOCAB_ACK);
+    return true;
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::rpcSetAccelerations(const Bottle &cmd, Bottle &reply)
+{
+    vector<int> joints;
+    vector<double> vals;
+    if (!toJointValues(cmd,joints,vals))
+        return false;
+
+    int n=(int)joints.size();
+    if (!locked([&]() { return setRefAccelerationsUnlocked(n,joints.data(),vals.data()); }))
+        return false;
+
+    reply.addVocab32(FAKEMOT_VOCAB_ACK);
+    return true;
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::rpcGetAccelerations(const Bottle &cmd, Bottle &reply)
+{
+    if (cmd.get(2).isNull())
+    {
+        vector<double> vals(vel.length());
+        if (!locked([&]() { return getRefAccelerationsUnlocked(vals.data()); }))
+            return false;
+
+        reply.addVocab32(FAKEMOT_VOCAB_ACK);
+        Bottle &b=reply.addList();
+        for (auto &v:vals)
+            b.addFloat64(v);
+    }
+    else
+    {
+        int axis=cmd.get(2).asInt32();
+        double val;
+        if (!locked([&]() { return getRefAccelerationUnlocked(axis,&val); }))
+            return false;
+
+        reply.addVocab32(FAKEMOT_VOCAB_ACK);
+        reply.addFloat64(val);
+    }
+
+    return true;
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::rpcStop(const Bottle &cmd, Bottle &reply)
+{
+    const Value &arg=cmd.get(2);
+    bool ok;
+    if (arg.isNull())
+        ok=locked([&]() { return stopUnlocked(); });
+    else if (arg.isList())
+    {
+        vector<int> joints=toJoints(arg.asList());
+        int n=(int)joints.size();
+        ok=locked([&]() { return stopUnlocked(n,joints.data()); });
+    }
+    else
+    {
+        int axis=arg.asInt32();
+        ok=locked([&]() { return stopUnlocked(axis); });
+    }
+
+    if (ok)
+        reply.addVocab32(FAKEMOT_VOCAB_ACK);
+    return ok;
+}
+
+/**********************************************************/
+void fakeMotorDeviceServer::dispatch(const Bottle &cmd, Bottle &reply)
+{
+    uint64_t key=FAKEMOT_RPC_KEY(cmd.get(0).asVocab32(),cmd.get(1).asVocab32());
+    for (auto &entry:rpcTable)
+    {
+        if (entry.key==key)
+        {
+            if ((this->*entry.handler)(cmd,reply))
+                return;
+            break;
+        }
+    }
+
+    reply.clear();
+    reply.addVocab32(FAKEMOT_VOCAB_NACK);
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::read(ConnectionReader &connection)
+{
+    // Protocol:
+    // [lim] [get] j            -> [ack] min max
+    // [lim] [set] j min max    -> [ack]
+    // [lim] [vget] j           -> [ack] min max
+    // [lim] [vset] j min max   -> [ack]
+    // [enc] [axes]             -> [ack] n
+    // [enc] [set] j v | (v0 ... vn-1)
+    // [enc] [rst] j | <none>
+    // [vel] [move] j sp | (sp0 ... spn-1) | (j ...) (sp ...)
+    // [vel] [acc] j a | (a0 ... an-1) | (j ...) (a ...)
+    // [vel] [gacc] j           -> [ack] a
+    // [vel] [gacc]             -> [ack] (a0 ... an-1)
+    // [vel] [stop] j | <none> | (j ...)
+    // failures are replied with [nack].
+    //
+    // Several requests can be pipelined within one message as a
+    // list of lists, i.e. ((req0) (req1) ...), which is replied
+    // with the list of the single replies ((rep0) (rep1) ...),
+    // served in order.
+    //
+    // Requests are dispatched through a table keyed on the pair
+    // [interface] [method]; they are decoded and replies are encoded
+    // outside the critical sections, which are limited to the access
+    // to the state, so that rpc bursts do not stall step().
+    Bottle cmd,reply;
+    cmd.read(connection);
+
+    if (cmd.get(0).isList())
+    {
+        for (size_t i=0; i<cmd.size(); i++)
+        {
+            Bottle &rep=reply.addList();
+            if (Bottle *req=cmd.get(i).asList())
+                dispatch(*req,rep);
+            else
+                rep.addVocab32(FAKEMOT_VOCAB_NACK);
+        }
+    }
+    else
+        dispatch(cmd,reply);
 
     if (ConnectionWriter *returnToSender=connection.getWriter())
         reply.write(*returnToSender);
@@ -192,14 +688,13 @@ bool fakeMotorDeviceServer::read(ConnectionReader &connection)
 }
 
 /**********************************************************/
-bool fakeMotorDeviceServer::getLimits(int axis, double *min, double *max)
+bool fakeMotorDeviceServer::getLimitsUnlocked(int axis, double *min, double *max)
 {
     if (!configured)
         return false;
 
-    if ((axis<(int)motors->get().length()) && (min!=NULL) && (max!=NULL))
+    if ((axis>=0) && (axis<lim.rows()) && (min!=NULL) && (max!=NULL))
     {
-        Matrix lim=motors->getLim();
         *min=lim(axis,0); *max=lim(axis,1);
         return true;
     }
@@ -208,14 +703,15 @@ bool fakeMotorDeviceServer::getLimits(int axis, double *min, double *max)
 }
 
 /**********************************************************/
-bool fakeMotorDeviceServer::getAxes(int *ax)
+bool fakeMotorDeviceServer::setLimitsUnlocked(int axis, double min, double max)
 {
-    if (!configured)
+    if (!configured || (min>max))
         return false;
 
-    if (ax!=NULL)
+    if ((axis>=0) && (axis<lim.rows()))
     {
-        *ax=(int)motors->get().length();
+        lim(axis,0)=min; lim(axis,1)=max;
+        q[axis]=std::min(std::max(q[axis],min),max);
         return true;
     }
     else
@@ -223,14 +719,14 @@ bool fakeMotorDeviceServer::getAxes(int *ax)
 }
 
 /**********************************************************/
-bool fakeMotorDeviceServer::velocityMove(int j, double sp)
+bool fakeMotorDeviceServer::getVelLimitsUnlocked(int axis, double *min, double *max)
 {
     if (!configured)
         return false;
 
-    if ((size_t)j<vel.length())
+    if ((axis>=0) && (axis<velLim.rows()) && (min!=NULL) && (max!=NULL))
     {
-        vel[j]=sp;
+        *min=velLim(axis,0); *max=velLim(axis,1);
         return true;
     }
     else
@@ -238,19 +734,496 @@ bool fakeMotorDeviceServer::velocityMove(int j, double sp)
 }
 
 /**********************************************************/
-bool fakeMotorDeviceServer::setRefAcceleration(int j, double acc)
+bool fakeMotorDeviceServer::setVelLimitsUnlocked(int axis, double min, double max)
 {
-    if (configured && ((size_t)j<vel.length()))
+    if (!configured || (min<0.0) || (min>max))
+        return false;
+
+    if ((axis>=0) && (axis<velLim.rows()))
+    {
+        velLim(axis,0)=min; velLim(axis,1)=max;
+        velocityMoveUnlocked(axis,vel[axis]);
         return true;
+    }
     else
         return false;
 }
 
 /**********************************************************/
-bool fakeMotorDeviceServer::stop(int j)
+bool fakeMotorDeviceServer::getAxesUnlocked(int *ax)
 {
-    return velocityMove(j,0.0);
+    if (!configured)
+        return false;
+
+    if (ax!=NULL)
+    {
+        *ax=(int)q.length();
+        return true;
+    }
+    else
+        return false;
 }
 
+/**********************************************************/
+bool fakeMotorDeviceServer::getEncoderUnlocked(int j, double *v)
+{
+    return getEncoderTimedUnlocked(j,v,NULL);
+}
 
+/**********************************************************/
+bool fakeMotorDeviceServer::getEncodersUnlocked(double *encs)
+{
+    return getEncodersTimedUnlocked(encs,NULL);
+}
 
+/**********************************************************/
+bool fakeMotorDeviceServer::getEncoderTimedUnlocked(int j, double *encs, double *time)
+{
+    if (!configured || (j<0) || ((size_t)j>=q.length()) || (encs==NULL))
+        return false;
+
+    *encs=q[j];
+    if (time!=NULL)
+        *time=stamp.getTime();
+    return true;
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::getEncodersTimedUnlocked(double *encs, double *time)
+{
+    if (!configured || (encs==NULL))
+        return false;
+
+    for (size_t i=0; i<q.length(); i++)
+    {
+        encs[i]=q[i];
+        if (time!=NULL)
+            time[i]=stamp.getTime();
+    }
+    return true;
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::resetEncoderUnlocked(int j)
+{
+    return setEncoderUnlocked(j,0.0);
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::resetEncodersUnlocked()
+{
+    Vector zeros(q.length(),0.0);
+    return setEncodersUnlocked(zeros.data());
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::setEncoderUnlocked(int j, double val)
+{
+    if (!configured || (j<0) || ((size_t)j>=q.length()))
+        return false;
+
+    Vector q0=q;
+    q0[j]=val;
+    return setEncodersUnlocked(q0.data());
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::setEncodersUnlocked(const double *vals)
+{
+    if (!configured || (vals==NULL))
+        return false;
+
+    // the measured velocities are kept across the jump
+    for (size_t i=0; i<q.length(); i++)
+        q[i]=std::min(std::max(vals[i],lim(i,0)),lim(i,1));
+    return true;
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::getEncoderSpeedUnlocked(int j, double *sp)
+{
+    if (!configured || (j<0) || ((size_t)j>=dq.length()) || (sp==NULL))
+        return false;
+
+    *sp=dq[j];
+    return true;
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::getEncoderSpeedsUnlocked(double *spds)
+{
+    if (!configured || (spds==NULL))
+        return false;
+
+    for (size_t i=0; i<dq.length(); i++)
+        spds[i]=dq[i];
+    return true;
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::getEncoderAccelerationUnlocked(int j, double *spds)
+{
+    if (!configured || (j<0) || ((size_t)j>=ddq.length()) || (spds==NULL))
+        return false;
+
+    *spds=ddq[j];
+    return true;
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::getEncoderAccelerationsUnlocked(double *accs)
+{
+    if (!configured || (accs==NULL))
+        return false;
+
+    for (size_t i=0; i<ddq.length(); i++)
+        accs[i]=ddq[i];
+    return true;
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::velocityMoveUnlocked(int j, double sp)
+{
+    if (!configured)
+        return false;
+
+    if ((j>=0) && ((size_t)j<vel.length()))
+    {
+        double max=velLim(j,1);
+        vel[j]=(sp>max)?max:((sp<-max)?-max:sp);
+        return true;
+    }
+    else
+        return false;
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::velocityMoveUnlocked(const int n_joint, const int *joints,
+                                         const double *spds)
+{
+    if ((joints==NULL) || (spds==NULL))
+        return false;
+
+    bool ok=true;
+    for (int i=0; i<n_joint; i++)
+        ok&=velocityMoveUnlocked(joints[i],spds[i]);
+    return ok;
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::velocityMoveUnlocked(const double *sp)
+{
+    if (sp==NULL)
+        return false;
+
+    bool ok=true;
+    for (size_t i=0; i<vel.length(); i++)
+        ok&=velocityMoveUnlocked((int)i,sp[i]);
+    return ok;
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::setRefAccelerationUnlocked(int j, double acc)
+{
+    // accelerations are stored but the motors
+    // keep on tracking the velocities at once
+    if (configured && (j>=0) && ((size_t)j<this->acc.length()))
+    {
+        this->acc[j]=acc;
+        return true;
+    }
+    else
+        return false;
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::setRefAccelerationsUnlocked(const int n_joint, const int *joints,
+                                                const double *accs)
+{
+    if ((joints==NULL) || (accs==NULL))
+        return false;
+
+    bool ok=true;
+    for (int i=0; i<n_joint; i++)
+        ok&=setRefAccelerationUnlocked(joints[i],accs[i]);
+    return ok;
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::setRefAccelerationsUnlocked(const double *accs)
+{
+    if (accs==NULL)
+        return false;
+
+    bool ok=true;
+    for (size_t i=0; i<acc.length(); i++)
+        ok&=setRefAccelerationUnlocked((int)i,accs[i]);
+    return ok;
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::getRefAccelerationUnlocked(int j, double *acc)
+{
+    if (configured && (j>=0) && ((size_t)j<this->acc.length()) && (acc!=NULL))
+    {
+        *acc=this->acc[j];
+        return true;
+    }
+    else
+        return false;
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::getRefAccelerationsUnlocked(const int n_joint, const int *joints,
+                                                double *accs)
+{
+    if ((joints==NULL) || (accs==NULL))
+        return false;
+
+    bool ok=true;
+    for (int i=0; i<n_joint; i++)
+        ok&=getRefAccelerationUnlocked(joints[i],&accs[i]);
+    return ok;
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::getRefAccelerationsUnlocked(double *accs)
+{
+    if (accs==NULL)
+        return false;
+
+    bool ok=true;
+    for (size_t i=0; i<acc.length(); i++)
+        ok&=getRefAccelerationUnlocked((int)i,&accs[i]);
+    return ok;
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::stopUnlocked(int j)
+{
+    return velocityMoveUnlocked(j,0.0);
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::stopUnlocked(const int n_joint, const int *joints)
+{
+    if (joints==NULL)
+        return false;
+
+    bool ok=true;
+    for (int i=0; i<n_joint; i++)
+        ok&=stopUnlocked(joints[i]);
+    return ok;
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::stopUnlocked()
+{
+    bool ok=true;
+    for (size_t i=0; i<vel.length(); i++)
+        ok&=stopUnlocked((int)i);
+    return ok;
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::getLimits(int axis, double *min, double *max)
+{
+    lock_guard<mutex> lg(mtx);
+    return getLimitsUnlocked(axis,min,max);
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::setLimits(int axis, double min, double max)
+{
+    lock_guard<mutex> lg(mtx);
+    return setLimitsUnlocked(axis,min,max);
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::setVelLimits(int axis, double min, double max)
+{
+    lock_guard<mutex> lg(mtx);
+    return setVelLimitsUnlocked(axis,min,max);
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::getVelLimits(int axis, double *min, double *max)
+{
+    lock_guard<mutex> lg(mtx);
+    return getVelLimitsUnlocked(axis,min,max);
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::getAxes(int *ax)
+{
+    lock_guard<mutex> lg(mtx);
+    return getAxesUnlocked(ax);
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::getEncoder(int j, double *v)
+{
+    lock_guard<mutex> lg(mtx);
+    return getEncoderUnlocked(j,v);
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::getEncoders(double *encs)
+{
+    lock_guard<mutex> lg(mtx);
+    return getEncodersUnlocked(encs);
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::getEncoderTimed(int j, double *encs, double *time)
+{
+    lock_guard<mutex> lg(mtx);
+    return getEncoderTimedUnlocked(j,encs,time);
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::getEncodersTimed(double *encs, double *time)
+{
+    lock_guard<mutex> lg(mtx);
+    return getEncodersTimedUnlocked(encs,time);
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::resetEncoder(int j)
+{
+    lock_guard<mutex> lg(mtx);
+    return resetEncoderUnlocked(j);
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::resetEncoders()
+{
+    lock_guard<mutex> lg(mtx);
+    return resetEncodersUnlocked();
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::setEncoder(int j, double val)
+{
+    lock_guard<mutex> lg(mtx);
+    return setEncoderUnlocked(j,val);
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::setEncoders(const double *vals)
+{
+    lock_guard<mutex> lg(mtx);
+    return setEncodersUnlocked(vals);
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::getEncoderSpeed(int j, double *sp)
+{
+    lock_guard<mutex> lg(mtx);
+    return getEncoderSpeedUnlocked(j,sp);
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::getEncoderSpeeds(double *spds)
+{
+    lock_guard<mutex> lg(mtx);
+    return getEncoderSpeedsUnlocked(spds);
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::getEncoderAcceleration(int j, double *spds)
+{
+    lock_guard<mutex> lg(mtx);
+    return getEncoderAccelerationUnlocked(j,spds);
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::getEncoderAccelerations(double *accs)
+{
+    lock_guard<mutex> lg(mtx);
+    return getEncoderAccelerationsUnlocked(accs);
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::velocityMove(int j, double sp)
+{
+    lock_guard<mutex> lg(mtx);
+    return velocityMoveUnlocked(j,sp);
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::velocityMove(const int n_joint, const int *joints, const double *spds)
+{
+    lock_guard<mutex> lg(mtx);
+    return velocityMoveUnlocked(n_joint,joints,spds);
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::velocityMove(const double *sp)
+{
+    lock_guard<mutex> lg(mtx);
+    return velocityMoveUnlocked(sp);
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::setRefAcceleration(int j, double acc)
+{
+    lock_guard<mutex> lg(mtx);
+    return setRefAccelerationUnlocked(j,acc);
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::setRefAccelerations(const int n_joint, const int *joints, const double *accs)
+{
+    lock_guard<mutex> lg(mtx);
+    return setRefAccelerationsUnlocked(n_joint,joints,accs);
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::setRefAccelerations(const double *accs)
+{
+    lock_guard<mutex> lg(mtx);
+    return setRefAccelerationsUnlocked(accs);
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::getRefAcceleration(int j, double *acc)
+{
+    lock_guard<mutex> lg(mtx);
+    return getRefAccelerationUnlocked(j,acc);
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::getRefAccelerations(const int n_joint, const int *joints, double *accs)
+{
+    lock_guard<mutex> lg(mtx);
+    return getRefAccelerationsUnlocked(n_joint,joints,accs);
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::getRefAccelerations(double *accs)
+{
+    lock_guard<mutex> lg(mtx);
+    return getRefAccelerationsUnlocked(accs);
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::stop(int j)
+{
+    lock_guard<mutex> lg(mtx);
+    return stopUnlocked(j);
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::stop(const int n_joint, const int *joints)
+{
+    lock_guard<mutex> lg(mtx);
+    return stopUnlocked(n_joint,joints);
+}
+
+/**********************************************************/
+bool fakeMotorDeviceServer::stop()
+{
+    lock_guard<mutex> lg(mtx);
+    return stopUnlocked();
+}
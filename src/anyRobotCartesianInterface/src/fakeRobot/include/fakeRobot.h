@@ -0,0 +1,582 @@
+/* 
+ * Copyright (C) 2011 Department of Robotics Brain and Cognitive Sciences - Istituto Italiano di Tecnologia
+ * Author: Ugo Pattacini
+ * email:  ugo.pattacini@iit.it
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * http://www.robotcub.org/icub/license/gpl.txt
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+*/
+
+#ifndef __FAKEROBOT_H__
+#define __FAKEROBOT_H__
+
+#include <cmath>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+#include <iostream>
+
+#include <yarp/os/all.h>
+#include <yarp/dev/all.h>
+
+#include <fakeMotorDevice.h>
+
+/**
+ * This thread advances all the parts of the fake robot
+ * at once, when they share the same periodic thread.
+ */
+class Stepper: public yarp::os::PeriodicThread
+{
+    std::vector<IFakeMotorDevice*> parts;
+
+public:
+    /**********************************************************/
+    Stepper(const double period) : yarp::os::PeriodicThread(period) { }
+
+    /**********************************************************/
+    void add(IFakeMotorDevice *part)
+    {
+        parts.push_back(part);
+    }
+
+    /**********************************************************/
+    void run()
+    {
+        double t=yarp::os::Time::now();
+        for (auto &part:parts)
+            part->step(t);
+    }
+};
+
+/**
+ * This port follows a consumer of the simulated clock, i.e. a
+ * module running on it that streams one message per cycle: the
+ * time stamped on the last message received is the simulated time
+ * of the last cycle the consumer has served.
+ */
+class ClockConsumer: public yarp::os::BufferedPort<yarp::os::Bottle>
+{
+    std::mutex &mtx;
+    std::condition_variable &cv;
+    const double &tNow;
+
+public:
+    std::string remote;
+    double period;
+    double stamp;
+    bool subscribed;
+
+    /**********************************************************/
+    ClockConsumer(std::mutex &mtx, std::condition_variable &cv, const double &tNow,
+                  const std::string &remote, const double period) :
+                  mtx(mtx), cv(cv), tNow(tNow), remote(remote), period(period),
+                  stamp(0.0), subscribed(false)
+    {
+        useCallback();
+    }
+
+    /**********************************************************/
+    void onRead(yarp::os::Bottle &b)
+    {
+        yarp::os::Stamp env;
+        getEnvelope(env);
+
+        // a message without stamp is taken as produced at the
+        // current time, which does not advance meanwhile
+        std::lock_guard<std::mutex> lg(mtx);
+        stamp=env.isValid()?env.getTime():tNow;
+        subscribed=true;
+        cv.notify_all();
+    }
+
+    /**********************************************************/
+    bool served(const double t, const double Ts) const
+    {
+        // the last cycle due at or before t has been run
+        return !subscribed || (stamp>t-period+0.5*Ts);
+    }
+};
+
+/**
+ * This thread advances all the parts of the fake robot on a
+ * simulated clock, which is streamed out in the format of the YARP
+ * network clock (seconds and nanoseconds), so that the other
+ * processes can follow it by means of YARP_CLOCK.
+ *
+ * The simulated time runs in one of the following modes:
+ * -) free-running, as fast as the real time factor allows, with no
+ *    feedback from the consumers of the clock: with rtf 0 the time
+ *    is streamed as fast as the parts can be advanced, hence a
+ *    controller following the clock sees it jump by many samples
+ *    between two of its cycles;
+ * -) lock-step, advancing only upon the requests [step] n received
+ *    on the trigger port, which are replied with the new time once
+ *    the n steps are done;
+ * -) gated on the consumers, i.e. the modules added through
+ *    addConsumer() with the period of their cycles: the time t+Ts is
+ *    published only once every consumer has served the last cycle
+ *    due at or before t, as told by the stamp of the message it
+ *    streams per cycle. The time thus advances as fast as the
+ *    consumers allow, and no cycle of theirs is skipped.
+ *
+ * In gated mode, a consumer is waited for only since its first
+ * message, and until then the time runs at the real time, so that
+ * the modules starting up see the usual timings; a consumer that
+ * does not serve its cycle within the gate timeout [s] of wall time
+ * is waited for no more, until it streams again.
+ */
+class SimStepper: public yarp::os::Thread, public yarp::os::PortReader
+{
+    std::vector<IFakeMotorDevice*> parts;
+    std::vector<std::unique_ptr<ClockConsumer>> consumers;
+    yarp::os::BufferedPort<yarp::os::Bottle> clockPort;
+    yarp::os::Port triggerPort;
+
+    double Ts,rtf;
+    bool lockstep;
+    double gateTimeout;
+
+    std::mutex mtx;
+    std::condition_variable cvStep,cvDone,cvGate;
+    unsigned long steps,target;
+    double t;
+
+    /**********************************************************/
+    void publish()
+    {
+        yarp::os::Bottle &clk=clockPort.prepare();
+        clk.clear();
+        clk.addInt32((int)floor(t));
+        clk.addInt32((int)((t-floor(t))*1e9));
+        clockPort.write();
+    }
+
+    /**********************************************************/
+    bool read(yarp::os::ConnectionReader &connection)
+    {
+        yarp::os::Bottle cmd,reply;
+        if (!cmd.read(connection))
+            return false;
+
+        // [step] n: advance n steps
+        // [time]  : report the current time
+        if (cmd.get(0).asVocab32()==yarp::os::Vocab32::encode("step"))
+        {
+            unsigned long n=(unsigned long)std::max(1,(cmd.size()>1)?cmd.get(1).asInt32():1);
+            std::unique_lock<std::mutex> lck(mtx);
+            target=std::max(target,steps)+n;
+            unsigned long goal=target;
+            cvStep.notify_all();
+            cvDone.wait(lck,[&]() { return (steps>=goal) || isStopping(); });
+            reply.addVocab32("ack");
+            reply.addFloat64(t);
+        }
+        else if (cmd.get(0).asVocab32()==yarp::os::Vocab32::encode("time"))
+        {
+            std::lock_guard<std::mutex> lg(mtx);
+            reply.addVocab32("ack");
+            reply.addFloat64(t);
+        }
+        else
+            reply.addVocab32("nack");
+
+        if (yarp::os::ConnectionWriter *returnToSender=connection.getWriter())
+            reply.write(*returnToSender);
+
+        return true;
+    }
+
+    /**********************************************************/
+    void connectConsumers()
+    {
+        for (auto &c:consumers)
+            if (c->getInputCount()==0)
+                yarp::os::Network::connect(c->remote,c->getName());
+    }
+
+    /**********************************************************/
+    bool allSubscribed()
+    {
+        std::lock_guard<std::mutex> lg(mtx);
+        for (auto &c:consumers)
+            if (!c->subscribed)
+                return false;
+        return true;
+    }
+
+    /**********************************************************/
+    void waitConsumers()
+    {
+        std::unique_lock<std::mutex> lck(mtx);
+        auto served=[&]()
+        {
+            for (auto &c:consumers)
+                if (!c->served(t,Ts))
+                    return false;
+            return true;
+        };
+
+        if (!cvGate.wait_for(lck,std::chrono::duration<double>(gateTimeout),
+                             [&]() { return served() || isStopping(); }))
+        {
+            for (auto &c:consumers)
+            {
+                if (!c->served(t,Ts))
+                {
+                    std::cout<<"Warning: "<<c->remote<<" did not serve the time "
+                             <<t<<" [s], not waited for until it streams again"<<std::endl;
+                    c->subscribed=false;
+                }
+            }
+        }
+    }
+
+public:
+    /**********************************************************/
+    SimStepper(const double Ts, const double rtf, const bool lockstep) :
+               Ts(Ts), rtf(rtf), lockstep(lockstep), gateTimeout(1.0),
+               steps(0), target(0), t(0.0) { }
+
+    /**********************************************************/
+    void add(IFakeMotorDevice *part)
+    {
+        parts.push_back(part);
+    }
+
+    /**
+     * Gate the time on a consumer.
+     * @param remote the port the consumer streams on once per cycle.
+     * @param period the period of the cycles of the consumer [s].
+     */
+    void addConsumer(const std::string &remote, const double period)
+    {
+        consumers.push_back(std::unique_ptr<ClockConsumer>(new ClockConsumer(mtx,cvGate,t,remote,period)));
+    }
+
+    /**********************************************************/
+    void setGateTimeout(const double timeout)
+    {
+        gateTimeout=timeout;
+    }
+
+    /**********************************************************/
+    bool open(const std::string &robot)
+    {
+        bool ok=clockPort.open("/"+robot+"/clock:o");
+        if (lockstep)
+        {
+            ok&=triggerPort.open("/"+robot+"/clock/trigger:rpc");
+            triggerPort.setReader(*this);
+        }
+        for (size_t i=0; i<consumers.size(); i++)
+            ok&=consumers[i]->open("/"+robot+"/clock/consumer/"+std::to_string(i)+":i");
+        return ok;
+    }
+
+    /**********************************************************/
+    void close()
+    {
+        if (isRunning())
+            stop();
+
+        clockPort.interrupt();
+        clockPort.close();
+        if (lockstep)
+        {
+            triggerPort.interrupt();
+            triggerPort.close();
+        }
+        for (auto &c:consumers)
+        {
+            c->interrupt();
+            c->close();
+        }
+    }
+
+    /**********************************************************/
+    void onStop()
+    {
+        std::lock_guard<std::mutex> lg(mtx);
+        cvStep.notify_all();
+        cvDone.notify_all();
+        cvGate.notify_all();
+    }
+
+    /**********************************************************/
+    void run()
+    {
+        publish();
+
+        bool gated=!consumers.empty();
+        double deadline=yarp::os::SystemClock::nowSystem();
+        double tConnect=-1.0;
+        while (!isStopping())
+        {
+            if (lockstep)
+            {
+                std::unique_lock<std::mutex> lck(mtx);
+                cvStep.wait(lck,[&]() { return (steps<target) || isStopping(); });
+                if (isStopping())
+                    break;
+            }
+
+            double pace=rtf;
+            if (gated)
+            {
+                // the consumers show up as they are launched
+                double now=yarp::os::SystemClock::nowSystem();
+                if (now-tConnect>=0.5)
+                {
+                    connectConsumers();
+                    tConnect=now;
+                }
+
+                waitConsumers();
+                if (isStopping())
+                    break;
+                if (!allSubscribed())
+                    pace=1.0;
+            }
+
+            double tn=t+Ts;
+            for (auto &part:parts)
+                part->step(tn);
+
+            {
+                std::lock_guard<std::mutex> lg(mtx);
+                t=tn;
+                steps++;
+                publish();
+            }
+            cvDone.notify_all();
+
+            // keep the pace set by the real time factor,
+            // without catching up on the steps run late
+            if (!lockstep && (pace>0.0))
+            {
+                deadline+=Ts/pace;
+                double dt=deadline-yarp::os::SystemClock::nowSystem();
+                if (dt>0.0)
+                    yarp::os::SystemClock::delaySystem(dt);
+                else
+                    deadline-=dt;
+            }
+        }
+    }
+};
+
+/**
+ * This container class launches the server part of the
+ * fake motor device in order to simulate a robot called
+ * "fake_robot" wiht the part "fake_part" composed of three
+ * actuated rotational joints, by default.
+ *
+ * The robot can be given any number of parts, each with its own
+ * joints and dynamics (see fakeMotorDeviceServer), described in
+ * the configuration file as:
+ * \code
+ * robot  fake_robot
+ * parts  (part_0 part_1)
+ * shared_thread
+ * Ts     10
+ *
+ * [part_0]
+ * joints   25
+ * dynamics first_order
+ * tau      0.05
+ *
+ * [part_1]
+ * limits   ((-90 90) (-45 45))
+ * \endcode
+ * With shared_thread, all the parts are advanced by one single
+ * periodic thread with sample time Ts [ms], rather than by one
+ * thread each.
+ *
+ * With clock sim, the parts are advanced on a simulated clock
+ * streamed out on /<robot>/clock:o; the other processes can follow
+ * it by means of YARP_CLOCK=/<robot>/clock:o. The simulated time
+ * runs rtf times faster than the wall clock (rtf 0 for as fast as
+ * possible, with no back-pressure from the consumers, hence not
+ * suitable for controllers in the loop). With clock lockstep, the
+ * simulated time advances only upon the requests [step] n on
+ * /<robot>/clock/trigger:rpc. With clock gated, the simulated time
+ * advances as fast as the consumers allow (see SimStepper), which
+ * is the mode to run controllers faster than real time:
+ * \code
+ * clock        gated
+ * consumers    ((/server/state:o 20))
+ * gate_timeout 1.0
+ * \endcode
+ * where each consumer is given by the port it streams on once per
+ * cycle and by its period [ms]; rtf, 0 by default in this mode,
+ * caps the pace.
+ */
+class Launcher: public yarp::os::RFModule
+{
+    std::vector<std::unique_ptr<yarp::dev::PolyDriver>> drivers;
+    std::unique_ptr<Stepper> stepper;
+    std::unique_ptr<SimStepper> simStepper;
+
+public:
+    /**********************************************************/
+    bool configure(yarp::os::ResourceFinder &rf)
+    {
+        std::string robot=rf.check("robot",yarp::os::Value("fake_robot")).asString();
+        std::string clock=rf.check("clock",yarp::os::Value("wall")).asString();
+        if ((clock!="wall") && (clock!="sim") && (clock!="lockstep") && (clock!="gated"))
+        {
+            std::cout<<"Error: unknown clock "<<clock<<std::endl;
+            return false;
+        }
+
+        // the simulated clock drives all the parts at once
+        bool sim=(clock!="wall");
+        bool shared=rf.check("shared_thread") || sim;
+        int Ts=rf.check("Ts",yarp::os::Value(10)).asInt32();
+
+        std::vector<std::string> parts;
+        if (yarp::os::Bottle *b=rf.find("parts").asList())
+        {
+            for (size_t i=0; i<b->size(); i++)
+                parts.push_back(b->get(i).asString());
+        }
+        else
+            parts.push_back("fake_part");
+
+        if (sim)
+        {
+            double rtf=rf.check("rtf",yarp::os::Value((clock=="gated")?0.0:1.0)).asFloat64();
+            if ((clock=="sim") && (rtf<=0.0))
+                std::cout<<"Warning: the free-running clock does not wait for its consumers, "
+                         <<"use clock gated with controllers in the loop"<<std::endl;
+            simStepper=std::unique_ptr<SimStepper>(new SimStepper((double)Ts/1000.0,rtf,clock=="lockstep"));
+
+            if (clock=="gated")
+            {
+                yarp::os::Bottle *b=rf.find("consumers").asList();
+                for (size_t i=0; (b!=NULL) && (i<b->size()); i++)
+                {
+                    yarp::os::Bottle *c=b->get(i).asList();
+                    if ((c==NULL) || (c->size()<2) || (c->get(1).asFloat64()<=0.0))
+                    {
+                        std::cout<<"Error: invalid consumer #"<<i<<std::endl;
+                        return false;
+                    }
+                    simStepper->addConsumer(c->get(0).asString(),c->get(1).asFloat64()/1000.0);
+                }
+                if ((b==NULL) || (b->size()==0))
+                {
+                    std::cout<<"Error: the gated clock needs its consumers"<<std::endl;
+                    return false;
+                }
+                simStepper->setGateTimeout(rf.check("gate_timeout",yarp::os::Value(1.0)).asFloat64());
+            }
+        }
+        else if (shared)
+            stepper=std::unique_ptr<Stepper>(new Stepper((double)Ts/1000.0));
+
+        int dof=0;
+        for (auto &part:parts)
+        {
+            yarp::os::Property options(rf.findGroup(part).tail().toString().c_str());
+            options.put("device","fakeyServer");
+            options.put("local","/"+robot+"/"+part);
+            if (shared)
+            {
+                options.put("Ts",Ts);
+                options.put("thread","external");
+            }
+
+            drivers.push_back(std::unique_ptr<yarp::dev::PolyDriver>(new yarp::dev::PolyDriver));
+            if (!drivers.back()->open(options))
+            {
+                std::cout<<"Error: unable to open the part "<<part<<std::endl;
+                close();
+                return false;
+            }
+
+            yarp::dev::IEncoders *ienc;
+            int ax=0;
+            if (drivers.back()->view(ienc))
+                ienc->getAxes(&ax);
+            dof+=ax;
+
+            if (shared)
+            {
+                IFakeMotorDevice *ifake;
+                if (!drivers.back()->view(ifake))
+                {
+                    std::cout<<"Error: the part "<<part<<" cannot be stepped"<<std::endl;
+                    close();
+                    return false;
+                }
+                if (sim)
+                    simStepper->add(ifake);
+                else
+                    stepper->add(ifake);
+            }
+        }
+
+        if (sim)
+        {
+            if (!simStepper->open(robot))
+            {
+                std::cout<<"Error: unable to open the clock ports"<<std::endl;
+                close();
+                return false;
+            }
+            simStepper->start();
+        }
+        else if (shared)
+            stepper->start();
+
+        std::cout<<"Robot "<<robot<<" with "<<parts.size()<<" parts and "
+            <<dof<<" joints in total"<<(shared?" on one thread":"")
+            <<" ("<<clock<<" clock)"<<std::endl;
+        return true;
+    }
+
+    /**********************************************************/
+    bool close()
+    {
+        // the parts must not be advanced while they are closed
+        if (stepper!=nullptr)
+        {
+            if (stepper->isRunning())
+                stepper->stop();
+            stepper.reset();
+        }
+
+        if (simStepper!=nullptr)
+        {
+            simStepper->close();
+            simStepper.reset();
+        }
+
+        for (auto &driver:drivers)
+            if (driver->isValid())
+                driver->close();
+        drivers.clear();
+
+        return true;
+    }
+
+    /**********************************************************/
+    double getPeriod()    { return 1.0;  }
+    bool   updateModule() { return true; }
+};
+
+#endif
+
@@ -18,53 +18,16 @@
 #include <yarp/os/all.h>
 #include <yarp/dev/all.h>
 #include <fakeMotorDevice.h>
+#include <fakeRobot.h>
 
 #include <iostream>
-#include <iomanip>
 
 using namespace std;
 using namespace yarp::os;
-using namespace yarp::dev;
-
-/**
- * This container class launches the server part of the
- * fake motor device in order to simulate a robot called
- * "fake_robot" wiht the part "fake_part" composed of three
- * actuated rotational joints.
- */
-class Launcher: public RFModule
-{
-    PolyDriver driver;
-
-public:
-    /**********************************************************/
-    bool configure(ResourceFinder &rf)
-    {
-        Property options;
-        options.put("device","fakeyServer");
-        options.put("local","/fake_robot/fake_part");
-
-        driver.open(options);
-        return driver.isValid();
-    }
-
-    /**********************************************************/
-    bool close()
-    {
-        if (driver.isValid())
-            driver.close();
-
-        return true;
-    }
-
-    /**********************************************************/
-    double getPeriod()    { return 1.0;  }
-    bool   updateModule() { return true; }
-};
 
 
 /**********************************************************/
-int main()
+int main(int argc, char *argv[])
 {
     Network yarp;
     if (!yarp.checkNetwork())
@@ -79,8 +42,7 @@ int main()
     
     Launcher launcher;
     ResourceFinder rf;
+    rf.setDefaultConfigFile("fakeRobot.ini");
+    rf.configure(argc,argv);
     return launcher.runModule(rf);
 }
-
-
-
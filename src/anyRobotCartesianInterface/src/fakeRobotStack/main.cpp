@@ -0,0 +1,350 @@
+/*
+ * Copyright (C) 2019 Fondazione Istituto Italiano di Tecnologia (IIT)
+ * All Rights Reserved.
+ * Authors: Ugo Pattacini <ugo.pattacini@iit.it>
+ */
+
+#include <yarp/os/all.h>
+#include <yarp/dev/all.h>
+#include <yarp/sig/all.h>
+#include <yarp/math/Math.h>
+#include <fakeMotorDevice.h>
+#include <fakeRobot.h>
+#include <fakeRobotSolver.h>
+#include <fakeRobotServer.h>
+
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace yarp::os;
+using namespace yarp::dev;
+using namespace yarp::sig;
+using namespace yarp::math;
+
+/**
+ * This module runs the fake robot, the solver and the server
+ * within one single process, i.e. the same modules launched
+ * separately by robot_server_solver.xml, configured through
+ * their own files.
+ *
+ * The fake motor device clients of the solver and the server
+ * connect to the fake robot through the carrier given by the
+ * option carrier (default: local, i.e. in-process), which skips
+ * the sockets; the connections between the solver and the server
+ * are instead handled by the Cartesian interface itself.
+ *
+ * With gated, the fake robot runs on its clock gated on the server
+ * (see SimStepper), which the whole process follows
+ * (Time::useNetworkClock()): the time advances by one sample only
+ * once the server has run the control cycle due, so that the stack
+ * runs faster than real time as long as the host keeps up, and the
+ * server does not skip any cycle. The solver is not gated, since it
+ * does not run per cycle but upon the requests of the server: the
+ * simulated time an IpOpt solve takes depends on the speed of the
+ * host, as the solve runs in wall time while the clock advances.
+ *
+ * With test, the stack runs on the gated clock and executes a
+ * scripted scenario: the targets are reached one after the other
+ * through a cartesiancontrollerclient, each within a timeout given
+ * in simulated time, and the process exits with 0 if all of them
+ * are reached within the tolerance, 1 otherwise. The timeout is to
+ * cover the solve as well as the trajectory, hence it is to be kept
+ * well above the trajectory time to make the outcome independent of
+ * the host.
+ *
+ * Options:
+ * -) --carrier name: the carrier towards the fake robot (default: local)
+ * -) --robot_from file: the fake robot configuration (default: fakeRobot.ini)
+ * -) --solver_from file: the solver configuration (default: solver.ini)
+ * -) --server_from file: the server configuration (default: server.ini)
+ * -) --instance i: suffix the names of the robot, the solver and the
+ *    server as well as the local ports of the server with _i, so that
+ *    several stacks can run side by side (e.g. fake_robot_0, solver_0
+ *    and server_0 with i=0)
+ * -) --standalone: run without the yarp server, registering the ports
+ *    within the process only; clients from other processes cannot
+ *    connect then
+ * -) --gated: run on the clock of the fake robot gated on the server
+ * -) --test: run the scenario on the gated clock and exit
+ * -) --remote name: the server driven by the scenario (default: the
+ *    server of the stack)
+ * -) --targets ((x y z) ...): the targets of the scenario [m]
+ *    (default: three targets in the workspace of the fake robot)
+ * -) --tol m: the tolerance on the reached positions (default: 0.01)
+ * -) --timeout s: the simulated time allowed per target (default: 10)
+ */
+class StackModule: public RFModule
+{
+protected:
+    ResourceFinder rfRobot,rfSolver,rfServer;
+    Launcher robot;
+    SolverModule solver;
+    ServerModule server;
+    bool robotOpen,solverOpen,serverOpen;
+    string remote;
+
+    /**********************************************************/
+    static void configureFrom(ResourceFinder &rf, const vector<string> &args)
+    {
+        // options with empty values are skipped
+        vector<char*> argv;
+        for (size_t i=0; i<args.size(); i++)
+        {
+            if ((i+1<args.size()) && (args[i].compare(0,2,"--")==0) && args[i+1].empty())
+                i++;
+            else
+                argv.push_back(const_cast<char*>(args[i].c_str()));
+        }
+        rf.configure((int)argv.size(),argv.data());
+    }
+
+public:
+    /**********************************************************/
+    StackModule() : robotOpen(false), solverOpen(false), serverOpen(false) { }
+
+    /**********************************************************/
+    bool configure(ResourceFinder &rf)
+    {
+        string carrier=rf.check("carrier",Value("local")).asString();
+        string context=rf.getContext();
+        bool gated=rf.check("gated") || rf.check("test");
+        string robotFrom=rf.check("robot_from",Value("fakeRobot.ini")).asString();
+        string solverFrom=rf.check("solver_from",Value("solver.ini")).asString();
+        string serverFrom=rf.check("server_from",Value("server.ini")).asString();
+
+        // the names as given by the configuration files
+        Property optRobot,optSolver,optServer;
+        optRobot.fromConfigFile(rf.findFileByName(robotFrom));
+        optSolver.fromConfigFile(rf.findFileByName(solverFrom));
+        optServer.fromConfigFile(rf.findFileByName(serverFrom));
+        Bottle &general=optServer.findGroup("GENERAL");
+
+        string suffix=rf.check("instance")?"_"+rf.find("instance").toString():"";
+        string robotName=optRobot.check("robot",Value("fake_robot")).asString()+suffix;
+        string solverName=optSolver.check("name",Value("solver")).asString()+suffix;
+        string serverName=general.check("ControllerName",Value("server")).asString()+suffix;
+        int serverPeriod=general.check("ControllerPeriod",Value(10)).asInt32();
+
+        // the command line overrides the configuration files
+        rfSolver.setDefault("kinematics_file","kinematics.ini");
+        configureFrom(rfSolver,{"solver","--context",context,"--from",solverFrom,
+                                "--name",solverName,"--robot",robotName,
+                                "--carrier",carrier});
+
+        rfServer.setDefault("part","fake_part");
+        rfServer.setDefault("local","server");
+        rfServer.setDefault("kinematics_file","kinematics.ini");
+        configureFrom(rfServer,{"server","--context",context,"--from",serverFrom,
+                                "--robot",robotName,"--local",suffix.empty()?"":"server"+suffix,
+                                "--name",serverName,"--solver",solverName,
+                                "--carrier",carrier});
+
+        // the clock is gated on the state the server streams
+        // at the end of each control cycle
+        vector<string> argsRobot={"fakeRobot","--context",context,"--from",robotFrom,
+                                  "--robot",robotName};
+        if (gated)
+        {
+            argsRobot.push_back("--clock");
+            argsRobot.push_back("gated");
+            argsRobot.push_back("--consumers");
+            argsRobot.push_back("((/"+serverName+"/state:o "+to_string(serverPeriod)+"))");
+        }
+        configureFrom(rfRobot,argsRobot);
+        remote=serverName;
+
+        // the robot goes first, as the solver
+        // and the server connect to it
+        if (!(robotOpen=robot.configure(rfRobot)))
+        {
+            cout<<"Error: unable to launch the fake robot"<<endl;
+            return false;
+        }
+
+        // the whole process follows the simulated time, which
+        // runs at the real time until the server shows up
+        if (gated)
+            Time::useNetworkClock("/"+robotName+"/clock:o");
+
+        if (!(solverOpen=solver.configure(rfSolver)))
+        {
+            cout<<"Error: unable to launch the solver"<<endl;
+            close();
+            return false;
+        }
+
+        if (!(serverOpen=server.configure(rfServer)))
+        {
+            cout<<"Error: unable to launch the server"<<endl;
+            close();
+            return false;
+        }
+
+        cout<<"Fake robot, solver and server running in one process ("
+            <<carrier<<" carrier, "<<(gated?"gated":"wall")<<" clock)"<<endl;
+        return true;
+    }
+
+    /**********************************************************/
+    bool interruptModule()
+    {
+        if (solverOpen)
+            solver.interruptModule();
+
+        return true;
+    }
+
+    /**********************************************************/
+    bool close()
+    {
+        // reverse order of launch; the clock keeps on
+        // advancing until the modules are closed
+        if (serverOpen)
+            server.close();
+        if (solverOpen)
+            solver.close();
+        if (robotOpen)
+            robot.close();
+
+        if (Time::isNetworkClock())
+            Time::useSystemClock();
+
+        robotOpen=solverOpen=serverOpen=false;
+        return true;
+    }
+
+    /**********************************************************/
+    string getServerName() const { return remote; }
+
+    /**********************************************************/
+    double getPeriod()    { return 1.0; }
+    bool   updateModule() { return solver.updateModule(); }
+};
+
+/**
+ * Reach the targets one after the other through the server
+ * and check the final positions; the timings are given both in
+ * simulated and in wall time.
+ */
+bool runScenario(ResourceFinder &rf, const string &remote)
+{
+    vector<Vector> targets;
+    if (Bottle *b=rf.find("targets").asList())
+    {
+        for (size_t i=0; i<b->size(); i++)
+        {
+            Bottle *t=b->get(i).asList();
+            if ((t==NULL) || (t->size()<3))
+            {
+                cout<<"Error: invalid target #"<<i<<endl;
+                return false;
+            }
+
+            Vector xd(3);
+            for (int k=0; k<3; k++)
+                xd[k]=t->get(k).asFloat64();
+            targets.push_back(xd);
+        }
+    }
+    else
+    {
+        // the workspace reachable by the fake robot
+        double defaults[3][3]={{2.0,1.0,0.0},{1.6,1.0,0.0},{2.2,1.5,0.0}};
+        for (auto &d:defaults)
+        {
+            Vector xd(3);
+            xd[0]=d[0]; xd[1]=d[1]; xd[2]=d[2];
+            targets.push_back(xd);
+        }
+    }
+
+    double tol=rf.check("tol",Value(0.01)).asFloat64();
+    double timeout=rf.check("timeout",Value(10.0)).asFloat64();
+
+    Property option("(device cartesiancontrollerclient)");
+    option.put("remote","/"+rf.check("remote",Value(remote)).asString());
+    option.put("local","/fakeRobotStack/test/"+remote);
+
+    PolyDriver client;
+    if (!client.open(option))
+    {
+        cout<<"Error: unable to connect to the server"<<endl;
+        return false;
+    }
+
+    ICartesianControl *arm;
+    client.view(arm);
+    arm->setTrajTime(2.0);
+    arm->setInTargetTol(tol/10.0);
+
+    bool ok=true;
+    cout<<fixed<<setprecision(4);
+    for (size_t i=0; i<targets.size(); i++)
+    {
+        const Vector &xd=targets[i];
+        double t0=Time::now();
+        double w0=SystemClock::nowSystem();
+        arm->goToPositionSync(xd);
+
+        bool done=false;
+        while (!done && (Time::now()-t0<timeout))
+        {
+            Time::delay(0.01);
+            arm->checkMotionDone(&done);
+        }
+
+        Vector x,o;
+        arm->getPose(x,o);
+        double err=norm(xd-x);
+        bool reached=done && (err<=tol);
+        ok&=reached;
+
+        cout<<"target #"<<i<<" ("<<xd.toString(3,3)<<"): "
+            <<(reached?"reached":"FAILED")<<", error = "<<err<<" [m], "
+            <<Time::now()-t0<<" [s] simulated, "
+            <<SystemClock::nowSystem()-w0<<" [s] wall"<<endl;
+    }
+
+    arm->stopControl();
+    client.close();
+    return ok;
+}
+
+
+/**********************************************************/
+int main(int argc, char *argv[])
+{
+    Network yarp;
+
+    ResourceFinder rf;
+    rf.configure(argc,argv);
+
+    if (rf.check("standalone"))
+        Network::setLocalMode(true);
+    else if (!yarp.checkNetwork())
+    {
+        cout<<"Error: yarp server does not seem available"<<endl;
+        return 1;
+    }
+
+    // register here the new yarp devices
+    // for dealing with the fake robot
+    registerFakeMotorDevices();
+
+    StackModule stack;
+    if (!rf.check("test"))
+        return stack.runModule(rf);
+
+    if (!stack.configure(rf))
+        return EXIT_FAILURE;
+
+    bool ok=runScenario(rf,stack.getServerName());
+    stack.close();
+
+    cout<<"Scenario "<<(ok?"passed":"failed")<<endl;
+    return (ok?EXIT_SUCCESS:EXIT_FAILURE);
+}
@@ -0,0 +1,122 @@
+/* 
+ * Copyright (C) 2011 Department of Robotics Brain and Cognitive Sciences - Istituto Italiano di Tecnologia
+ * Author: Ugo Pattacini
+ * email:  ugo.pattacini@iit.it
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * http://www.robotcub.org/icub/license/gpl.txt
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+*/
+
+#ifndef __FAKEROBOTSERVER_H__
+#define __FAKEROBOTSERVER_H__
+
+#include <string>
+#include <iostream>
+
+#include <yarp/os/all.h>
+#include <yarp/dev/all.h>
+
+/**
+ * This class launches the server.
+ */
+class ServerModule: public yarp::os::RFModule
+{
+protected:
+    yarp::dev::PolyDriver partDrv;
+    yarp::dev::PolyDriver server;
+
+public:
+    /**********************************************************/
+    bool configure(yarp::os::ResourceFinder &rf)
+    {   
+        // grab parameters from the configuration file
+        std::string robot=rf.find("robot").asString();
+        std::string part=rf.find("part").asString();
+        std::string local=rf.find("local").asString();
+        std::string pathToKin=rf.findFile("kinematics_file");
+
+        // prepare the option to open up the device driver to
+        // access the fake robot
+        yarp::os::Property optPart;
+        optPart.put("device","fakeyClient");
+        optPart.put("remote","/"+robot+"/"+part);
+        optPart.put("local","/"+local+"/"+part);
+        optPart.put("part",part);
+        optPart.put("carrier",rf.check("carrier",yarp::os::Value("")).asString());
+
+        // open the device driver
+        if (!partDrv.open(optPart))
+        {
+            std::cout<<"Error: Device driver not available!"<<std::endl;
+            close();
+            return false;
+        }
+
+        // now go on with the server driver
+        yarp::dev::PolyDriverList list;
+        list.push(&partDrv,part.c_str());
+
+        // take the parameters and fill the kinematic description
+        yarp::os::Property optServer("(device cartesiancontrollerserver)");
+        optServer.fromConfigFile(rf.findFile("from"),false);
+
+        // the names given by the command line take over those of
+        // the file, so that several servers can run side by side
+        if (rf.check("name") || rf.check("solver"))
+        {
+            yarp::os::Property general(optServer.findGroup("GENERAL").tail().toString().c_str());
+            if (rf.check("name"))
+                general.put("ControllerName",rf.find("name").asString());
+            if (rf.check("solver"))
+                general.put("SolverNameToConnect",rf.find("solver").asString());
+            optServer.unput("GENERAL");
+            optServer.addGroup("GENERAL").fromString(general.toString());
+        }
+
+        if (!server.open(optServer))
+        {
+            std::cout<<"Error: Unable to open the Cartesian Controller Server!"<<std::endl;
+            close();    
+            return false;
+        }
+
+        // attach the device driver to the server
+        yarp::dev::IMultipleWrapper *wrapper;
+        server.view(wrapper);
+        if (!wrapper->attachAll(list))
+        {
+            std::cout<<"Error: Unable to attach device drivers!"<<std::endl;
+            close();    
+            return false;
+        }
+
+        return true;
+    }
+
+    /**********************************************************/
+    bool close()
+    {
+        if (server.isValid())
+            server.close();
+
+        if (partDrv.isValid())
+            partDrv.close();
+
+        return true;
+    }
+
+    /**********************************************************/
+    double getPeriod()    { return 1.0;  }
+    bool   updateModule() { return true; }
+};
+
+#endif
+
@@ -0,0 +1,216 @@
+/* 
+ * Copyright (C) 2011 Department of Robotics Brain and Cognitive Sciences - Istituto Italiano di Tecnologia
+ * Author: Ugo Pattacini
+ * email:  ugo.pattacini@iit.it
+ * Permission is granted to copy, distribute, and/or modify this program
+ * under the terms of the GNU General Public License, version 2 or any
+ * later version published by the Free Software Foundation.
+ *
+ * A copy of the license can be found at
+ * http://www.robotcub.org/icub/license/gpl.txt
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details
+*/
+
+#ifndef __FAKEROBOTSOLVER_H__
+#define __FAKEROBOTSOLVER_H__
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <iostream>
+
+#include <yarp/os/all.h>
+#include <yarp/math/Math.h>
+#include <iCub/iKin/iKinSlv.h>
+
+#include <solverTelemetry.h>
+
+/**
+ * This class inherits from the CartesianSolver super-class
+ * implementing the solver.
+ *
+ * Each solution is timed and published through SolverTelemetry on
+ * the port /<name>/telemetry:o. The queue wait, the reply time and
+ * the iterations are run by the super-class out of reach of this
+ * class and are reported as zero; err is the residual between the
+ * target and the achieved position.
+ */
+class fakeRobotCartesianSolver : public iCub::iKin::CartesianSolver
+{
+protected:
+    iCub::iKin::iKinChain *chain;
+    SolverTelemetry telemetry;
+
+    /**
+     * This particular method serves to describe all the device
+     * drivers used by the solver to access the robot, along with
+     * the kinematic structure of the links.
+     * 
+     * @param options The parameters required by the super-class to 
+     *                get configured.
+     * @return A pointer to the descriptor or NULL if something wrong happens.
+     */
+    iCub::iKin::PartDescriptor *getPartDesc(yarp::os::Searchable &options)
+    {
+        if (!options.check("CustomKinFile"))
+        {
+            std::cout<<"Error: \"CustomKinFile\" option is missing!"<<std::endl;
+            return NULL;
+        }
+
+        std::string robot=options.check("robot",yarp::os::Value("fake_robot")).asString();
+        std::string part="fake_part";
+
+        // here we declare everything is required to open up
+        // the device driver to access the fake robot
+        yarp::os::Property optPart;
+        optPart.put("device","fakeyClient");
+        optPart.put("remote","/"+robot+"/"+part);
+        optPart.put("local","/"+slvName+"/"+part);
+        optPart.put("part",part);
+        optPart.put("carrier",options.check("carrier",yarp::os::Value("")).asString());
+
+        // we grab info on the fake robot's kinematics
+        yarp::os::Property linksOptions;
+        linksOptions.fromConfigFile(options.find("CustomKinFile").asString());
+        iCub::iKin::iKinLimb *limb=new iCub::iKin::iKinLimb(linksOptions);
+        if (!limb->isValid())
+        {
+            std::cout<<"Error: invalid links parameters!"<<std::endl;
+            delete limb;
+            return NULL;
+        }
+
+        // we fill in the descriptor fields
+        iCub::iKin::PartDescriptor *p=new iCub::iKin::PartDescriptor;
+        p->lmb=limb;                // a pointer to the iKinLimb
+        p->chn=limb->asChain();     // the associated iKinChain object
+        chain=p->chn;
+        p->cns=NULL;                // any further (linear) constraints on the joints other than the bounds? This requires some more effort
+        p->prp.push_back(optPart);  // attach the options to open the device driver of the fake part
+        p->rvs.push_back(false);    // it may happen that the motor commands to be sent are in reversed order wrt the order of kinematics links (e.g. the iCub torso); if so put here "true"
+        p->num=1;                   // only one device driver for the whole limb (see below)
+
+        // whenever a limb is actuated resorting to more than one device
+        // (e.g. for iCub: torso+arm), the following applies:
+        // 
+        // p->prp.push_back(optDevice_1);
+        // p->prp.push_back(optDevice_2);
+        // p->rvs.push_back(true);
+        // p->rvs.push_back(false);
+        // p->num=2;
+
+        return p;
+    }
+
+    /**********************************************************/
+    yarp::sig::Vector solve(yarp::sig::Vector &xd)
+    {
+        SolverStats stats;
+        double t0=yarp::os::SystemClock::nowSystem();
+        yarp::sig::Vector qd=iCub::iKin::CartesianSolver::solve(xd);
+        stats.solve=yarp::os::SystemClock::nowSystem()-t0;
+
+        yarp::sig::Vector x=chain->EndEffPosition(qd);
+        stats.error=yarp::math::norm(xd.subVector(0,2)-x);
+        telemetry.add(std::vector<SolverStats>(1,stats));
+
+        return qd;
+    }
+
+public:
+    /**********************************************************/
+    fakeRobotCartesianSolver(const std::string &name) :
+                             iCub::iKin::CartesianSolver(name), chain(NULL) { }
+
+    /**********************************************************/
+    bool openTelemetry(const size_t windowSize)
+    {
+        return telemetry.open(slvName,windowSize);
+    }
+
+    /**********************************************************/
+    ~fakeRobotCartesianSolver()
+    {
+        telemetry.close();
+    }
+};
+
+class SolverModule: public yarp::os::RFModule
+{
+protected:
+    fakeRobotCartesianSolver *solver;
+
+public:
+    /**********************************************************/
+    SolverModule() : solver(NULL) { }
+
+    /**********************************************************/
+    bool configure(yarp::os::ResourceFinder &rf)
+    {                
+        if (!rf.check("name"))
+        {
+            std::cout<<"Error: \"name\" option is missing!"<<std::endl;
+            return false;
+        }
+
+        std::string solverName=rf.find("name").asString();
+        std::string pathToKin=rf.findFile("kinematics_file");
+
+        yarp::os::Property config;
+        config.fromConfigFile(rf.findFile("from"));
+        config.put("CustomKinFile",pathToKin);
+        if (rf.check("robot"))
+            config.put("robot",rf.find("robot").asString());
+        if (rf.check("carrier"))
+            config.put("carrier",rf.find("carrier").asString());
+
+        solver=new fakeRobotCartesianSolver(solverName);
+        int window=rf.check("telemetry_window",yarp::os::Value(1000)).asInt32();
+        if (!solver->openTelemetry((size_t)std::max(1,window)) || !solver->open(config))
+        {    
+            delete solver;
+            return false;
+        }
+
+        return true;
+    }
+
+    /************************************************************************/
+    bool interruptModule()
+    {
+        if (solver!=NULL)
+            solver->interrupt();
+
+        return true;
+    }
+
+    /**********************************************************/
+    bool close()
+    {
+        delete solver;
+        return true;
+    }
+
+    /**********************************************************/
+    double getPeriod()
+    {
+        return 1.0;
+    }
+
+    /**********************************************************/
+    bool updateModule()
+    {
+        if (solver->isClosed() || solver->getTimeoutFlag())
+            return false;
+        else
+            return true;
+    }
+};
+
+#endif
+
@@ -0,0 +1,161 @@
+/**
+ * @ingroup icub_armDynStreamer
+ *
+ * Offline benchmark of the cycle of armDynStreamer: the encoders
+ * of a synthetic motion are pushed into the ring of samples one
+ * cycle after the other, and the cycle (estimator, Newton-Euler
+ * of iDynSensorArmNoTorso and outputs) is run on them with no
+ * robot nor network involved.
+ *
+ * The heap allocations of the process are counted by replacing
+ * the global operator new of this binary only, and reported per
+ * cycle and per stage along with the computation time. The
+ * process exits with failure if the stages handled by the module
+ * itself (estimator, state and torques) allocate; the allocations
+ * of the Newton-Euler and of the end-effector wrench belong to
+ * iDyn and are only reported.
+ *
+ * Options:
+ * -) --type left|right: the arm (default: right)
+ * -) --mode static|dynamic: the Newton-Euler mode (default: dynamic)
+ * -) --cycles n: the number of measured cycles (default: 10000)
+ * -) --period T: the period of the synthetic samples [s] (default: 0.001)
+ * -) --aw_lin_N n, --aw_quad_N n, --aw_D d: as in armDynStreamer
+ *
+ * \author Ugo Pattacini
+ *
+ * CopyPolicy: Released under the terms of GPL 2.0 or later
+ */
+
+#include <cstdlib>
+#include <cmath>
+#include <new>
+#include <atomic>
+#include <string>
+#include <algorithm>
+
+#include <yarp/os/all.h>
+#include <yarp/sig/Vector.h>
+
+#include <iCub/iDyn/iDyn.h>
+
+#include <awEstimator.h>
+#include <armDynCycle.h>
+
+using namespace std;
+using namespace yarp::os;
+using namespace yarp::sig;
+using namespace iCub::iDyn;
+
+
+// heap allocations performed by the process
+/****************************************************************/
+static atomic<unsigned long> allocations(0);
+
+void *operator new(size_t size)
+{
+    allocations.fetch_add(1,memory_order_relaxed);
+    if (void *ptr=malloc(size>0?size:1))
+        return ptr;
+    throw bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+    free(ptr);
+}
+
+
+/****************************************************************/
+int main(int argc, char *argv[])
+{
+    ResourceFinder rf;
+    rf.configure(argc,argv);
+
+    string type=rf.check("type",Value("right")).asString();
+    NewEulMode mode=(rf.check("mode",Value("dynamic")).asString()=="static")?STATIC:DYNAMIC;
+    int nCycles=std::max(1,rf.check("cycles",Value(10000)).asInt32());
+    double period=rf.check("period",Value(0.001)).asFloat64();
+    size_t awLinN=rf.check("aw_lin_N",Value(16)).asInt32();
+    size_t awQuadN=rf.check("aw_quad_N",Value(25)).asInt32();
+    double awD=rf.check("aw_D",Value(1.0)).asFloat64();
+
+    ArmDynCycle cycle(type,mode);
+    size_t N=cycle.getN();
+
+    SampleRing ring(N,4*std::max(awLinN,awQuadN));
+    AWEstimator estimator(N,awLinN,awQuadN,awD);
+
+    Vector enc(N),qDeg(N,0.0),dqDeg(N,0.0),ddqDeg(N,0.0);
+    Vector ft(6,0.0),tau(N,0.0),wrench(6,0.0);
+    ft[2]=-5.0;
+    cycle.setWrench(ft);
+
+    // the windows are filled up before measuring, so that the
+    // estimator runs on its largest windows as in the steady state
+    int nWarmUp=(int)(2*std::max(awLinN,awQuadN));
+
+    unsigned long allocState=0,allocNE=0,allocTau=0;
+    double t_min=1e9,t_max=0.0,t_sum=0.0;
+    for (int k=-nWarmUp; k<nCycles; k++)
+    {
+        // a slow sinusoidal motion of all the joints [deg]
+        double t=k*period;
+        for (size_t i=0; i<N; i++)
+            enc[i]=20.0*sin(2.0*M_PI*0.5*t+i);
+        ring.push(t,enc.data());
+
+        unsigned long a0=allocations.load(memory_order_relaxed);
+        double t0=SystemClock::nowSystem();
+
+        if (estimator.estimate(ring,qDeg,dqDeg,ddqDeg))
+        {
+            if (mode==DYNAMIC)
+                cycle.setState(qDeg,dqDeg,ddqDeg);
+            else
+                cycle.setState(qDeg);
+        }
+        unsigned long a1=allocations.load(memory_order_relaxed);
+
+        cycle.compute();
+        cycle.getWrench(wrench);
+        unsigned long a2=allocations.load(memory_order_relaxed);
+
+        cycle.getTorques(tau);
+
+        double dt=SystemClock::nowSystem()-t0;
+        unsigned long a3=allocations.load(memory_order_relaxed);
+
+        if (k>=0)
+        {
+            allocState+=a1-a0;
+            allocNE+=a2-a1;
+            allocTau+=a3-a2;
+            t_min=std::min(t_min,dt);
+            t_max=std::max(t_max,dt);
+            t_sum+=dt;
+        }
+    }
+
+    yInfo()<<nCycles<<"cycles of the"<<type<<"arm in"
+           <<((mode==DYNAMIC)?"dynamic":"static")<<"mode";
+    yInfo()<<"cycle computation time [us]:"
+           <<"min"<<1e6*t_min<<"avg"<<1e6*t_sum/nCycles<<"max"<<1e6*t_max;
+    yInfo()<<"heap allocations per cycle:"
+           <<"estimator and state"<<(double)allocState/nCycles
+           <<"| torques"<<(double)allocTau/nCycles
+           <<"| iDyn Newton-Euler and wrench"<<(double)allocNE/nCycles;
+
+    if (allocState+allocTau>0)
+    {
+        yError()<<"the cycle of the module allocates memory";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
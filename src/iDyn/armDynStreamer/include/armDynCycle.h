@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2019 Fondazione Istituto Italiano di Tecnologia (IIT)
+ * All Rights Reserved.
+ * Authors: Ugo Pattacini <ugo.pattacini@iit.it>
+ */
+
+#ifndef __ARMDYNCYCLE_H__
+#define __ARMDYNCYCLE_H__
+
+#include <string>
+
+#include <yarp/sig/Vector.h>
+
+#include <iCub/iDyn/iDyn.h>
+#include <iCub/iDyn/iDynInv.h>
+
+/**
+ * One cycle of the Newton-Euler of iDynSensorArmNoTorso, fed with
+ * the joints state in degrees and the FT sensor measurement.
+ *
+ * The state is passed to the chain link by link and the torques
+ * are read back joint by joint, rather than through the
+ * yarp::sig::Vector returned by value by iKin/iDyn, so that the
+ * cycle does not allocate memory beyond what iDyn does internally
+ * (see armDynStreamerBench).
+ */
+class ArmDynCycle
+{
+protected:
+    iCub::iDyn::iCubArmNoTorsoDyn arm;
+    iCub::iDyn::iDynSensorArmNoTorso sensor;
+    yarp::sig::Vector F,Mu;
+
+public:
+    /**
+     * Constructor.
+     * @param type the arm ("left" or "right").
+     * @param mode the Newton-Euler mode.
+     */
+    ArmDynCycle(const std::string &type, const iCub::iDyn::NewEulMode mode);
+
+    /**
+     * Return the number of joints.
+     */
+    size_t getN() const { return arm.getN(); }
+
+    /**
+     * Set the FT sensor measurement.
+     * @param ft the wrench [fx fy fz mx my mz].
+     */
+    void setWrench(const yarp::sig::Vector &ft);
+
+    /**
+     * Set the joints angles.
+     * @param qDeg the angles [deg].
+     */
+    void setState(const yarp::sig::Vector &qDeg);
+
+    /**
+     * Set the joints angles, velocities and accelerations.
+     * @param qDeg the angles [deg].
+     * @param dqDeg the velocities [deg/s].
+     * @param ddqDeg the accelerations [deg/s^2].
+     */
+    void setState(const yarp::sig::Vector &qDeg, const yarp::sig::Vector &dqDeg,
+                  const yarp::sig::Vector &ddqDeg);
+
+    /**
+     * Run the Newton-Euler from the FT sensor.
+     */
+    void compute();
+
+    /**
+     * Retrieve the joints torques.
+     * @param tau filled with the torques [Nm]; it must be already
+     *            sized.
+     */
+    void getTorques(yarp::sig::Vector &tau) const;
+
+    /**
+     * Retrieve the external wrench at the end-effector.
+     * @param wrench filled with the wrench [N,Nm]; it must be
+     *               already sized.
+     * @note iDyn returns the wrench by value, hence this call
+     *       allocates.
+     */
+    void getWrench(yarp::sig::Vector &wrench) const;
+};
+
+#endif
@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2019 Fondazione Istituto Italiano di Tecnologia (IIT)
+ * All Rights Reserved.
+ * Authors: Ugo Pattacini <ugo.pattacini@iit.it>
+ */
+
+#ifndef __AWESTIMATOR_H__
+#define __AWESTIMATOR_H__
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <yarp/sig/Vector.h>
+
+/**
+ * A lock-free ring buffer of timestamped samples, to be written
+ * by one single producer (e.g. the callback of the encoders
+ * port) and read by one single consumer (e.g. the control loop).
+ * The producer never waits: the oldest samples get overwritten.
+ *
+ * The consumer may copy a slot while the producer is rewriting
+ * it; in that case the copy is detected as stale and taken again.
+ * The slots are made of atomics accessed with relaxed ordering,
+ * so that such a copy is a race-free (discarded) read rather
+ * than undefined behavior.
+ */
+class SampleRing
+{
+protected:
+    size_t nJoints;
+    size_t capacity;
+    std::unique_ptr<std::atomic<double>[]> buffer;  // capacity x (1+nJoints): [t y_0 ... y_n-1]
+    std::atomic<uint64_t> head;     // number of samples pushed so far
+
+public:
+    /**
+     * Constructor.
+     * @param nJoints the size of each sample.
+     * @param capacity the number of samples retained.
+     */
+    SampleRing(const size_t nJoints, const size_t capacity);
+
+    /**
+     * Return the size of each sample.
+     */
+    size_t getJoints() const { return nJoints; }
+
+    /**
+     * Store a new sample (producer side).
+     * @param t the timestamp [s].
+     * @param y the nJoints values.
+     */
+    void push(const double t, const double *y);
+
+    /**
+     * Retrieve the newest samples (consumer side); at most
+     * capacity-1 samples can be retrieved, as the slot of the
+     * oldest one may be under rewriting.
+     * @param n the maximum number of samples to retrieve.
+     * @param t filled with the timestamps, newest first.
+     * @param y filled with the values, sample after sample,
+     *          newest first.
+     * @return the number of retrieved samples.
+     */
+    size_t latest(const size_t n, double *t, double *y) const;
+};
+
+/**
+ * Estimate the joints velocities and accelerations from the
+ * samples of a SampleRing through the adaptive window polynomial
+ * fitting (see iCub::ctrl::AWLinEstimator and AWQuadEstimator):
+ * for each joint, the window is enlarged as long as all its
+ * samples lie within the threshold D from the fitted polynomial,
+ * up to the maximum size. A first order polynomial provides the
+ * velocity and a second order polynomial the acceleration.
+ *
+ * Since all the joints share the same timestamps, the normal
+ * equations are solved once per window size and then applied to
+ * all the joints at once. The timestamps are expressed in units
+ * of the mean sample period of the window, so that the normal
+ * equations, and the thresholds on their determinants, do not
+ * depend on the rate of the samples. All the buffers are allocated at
+ * construction time and the cost is bounded by the maximum size
+ * of the windows.
+ */
+class AWEstimator
+{
+protected:
+    size_t nJoints;
+    size_t linN,quadN;
+    double D;
+
+    std::vector<double> t,y;
+    std::vector<double> sy,sty,st2y;
+    std::vector<double> c0,c1,c2,err;
+    std::vector<char>   active;
+    double tLatest,tau;
+
+    void fit(const size_t N, const int order, yarp::sig::Vector &out);
+
+public:
+    /**
+     * Constructor.
+     * @param nJoints the number of joints.
+     * @param linN the maximum window of the velocity estimator.
+     * @param quadN the maximum window of the acceleration
+     *              estimator.
+     * @param D the threshold on the fitting error [same units of
+     *          the samples].
+     */
+    AWEstimator(const size_t nJoints, const size_t linN=16,
+                const size_t quadN=25, const double D=1.0);
+
+    /**
+     * Estimate velocities and accelerations from the newest
+     * samples of the ring.
+     * @param ring the samples.
+     * @param q filled with the newest sample.
+     * @param dq filled with the velocities.
+     * @param ddq filled with the accelerations.
+     * @return false if no sample is available.
+     */
+    bool estimate(const SampleRing &ring, yarp::sig::Vector &q,
+                  yarp::sig::Vector &dq, yarp::sig::Vector &ddq);
+
+    /**
+     * Return the timestamp of the newest sample used.
+     */
+    double getTime() const { return tLatest; }
+};
+
+#endif
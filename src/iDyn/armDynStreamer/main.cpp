@@ -0,0 +1,353 @@
+/**
+ * @ingroup icub_tutorials
+ *
+ * \defgroup icub_armDynStreamer Real-time Newton-Euler on the
+ *           iCub arm
+ *
+ * A tutorial on how to run the recursive Newton-Euler of
+ * iDynSensorArmNoTorso in a periodic loop (1 kHz by default),
+ * fed with the arm encoders and the FT sensor measurements, to
+ * stream out the joints torques and the external wrench acting
+ * on the end-effector.
+ *
+ * All the buffers handled by the loop are allocated at startup,
+ * and the state and the torques are exchanged with the chain
+ * joint by joint (see ArmDynCycle), so that the cycle does not
+ * request memory of its own; the computation time of the cycle
+ * is reported periodically. The heap allocations per cycle, those
+ * inside iDyn included, are counted offline by the companion
+ * binary armDynStreamerBench, which runs the same cycle on a
+ * synthetic encoders stream.
+ *
+ * Options:
+ * -) --robot name: the robot name (default: icubSim)
+ * -) --part name: the arm (default: right_arm)
+ * -) --mode static|dynamic: the Newton-Euler mode (default: static)
+ * -) --period T: the loop period [s] (default: 0.001)
+ * -) --estimator aw|encoders: in dynamic mode, the joints velocities
+ *    and accelerations are either estimated from the timestamped
+ *    encoders stream through the adaptive window polynomial fitting
+ *    (default) or retrieved from the encoders interface
+ * -) --aw_lin_N n, --aw_quad_N n, --aw_D d: the maximum windows of
+ *    the velocity and acceleration estimators and their threshold
+ *    [deg] (default: 16, 25, 1.0)
+ *
+ * With the aw estimator, the encoders are received on the port
+ * /armDynStreamer/state:i (connected to /<robot>/<part>/state:o)
+ * and stored along with their timestamps in a lock-free ring
+ * buffer, which the loop reads from at each cycle.
+ *
+ * Open ports:
+ * -) /armDynStreamer/ft:i      receive the FT sensor measurements [fx fy fz mx my mz]
+ * -) /armDynStreamer/state:i   receive the encoders stream (aw estimator only)
+ * -) /armDynStreamer/torques:o output the joints torques [Nm]
+ * -) /armDynStreamer/wrench:o  output the external wrench at the end-effector [N,Nm]
+ *
+ * \author Ugo Pattacini
+ *
+ * CopyPolicy: Released under the terms of GPL 2.0 or later
+ */
+
+#include <cstdlib>
+#include <string>
+#include <algorithm>
+
+#include <yarp/os/all.h>
+#include <yarp/dev/all.h>
+#include <yarp/sig/Vector.h>
+
+#include <iCub/iDyn/iDyn.h>
+
+#include <awEstimator.h>
+#include <armDynCycle.h>
+
+using namespace std;
+using namespace yarp::os;
+using namespace yarp::dev;
+using namespace yarp::sig;
+using namespace iCub::iDyn;
+
+
+// the producer side of the ring: the encoders are stored
+// as they arrive, stamped with the time of acquisition
+/****************************************************************/
+class StatePort : public BufferedPort<Vector>
+{
+    SampleRing &ring;
+
+    /****************************************************************/
+    void onRead(Vector &enc) override
+    {
+        if (enc.length()<ring.getJoints())
+            return;
+
+        Stamp stamp;
+        getEnvelope(stamp);
+        ring.push(stamp.isValid()?stamp.getTime():SystemClock::nowSystem(),enc.data());
+    }
+
+public:
+    /****************************************************************/
+    StatePort(SampleRing &ring) : ring(ring)
+    {
+        useCallback();
+    }
+};
+
+
+/****************************************************************/
+class Streamer : public PeriodicThread
+{
+    string robot,part;
+    NewEulMode mode;
+    bool useAW;
+    size_t awLinN,awQuadN;
+    double awD;
+
+    SampleRing *ring;
+    AWEstimator *estimator;
+    StatePort *statePort;
+
+    PolyDriver driver;
+    IEncoders *ienc;
+
+    ArmDynCycle *cycle;
+
+    BufferedPort<Vector> ftPort;
+    BufferedPort<Vector> torquesPort;
+    BufferedPort<Vector> wrenchPort;
+
+    // preallocated buffers
+    Vector enc,encSpeed,encAcc;
+    Vector qDeg,dqDeg,ddqDeg;
+
+    // cycle statistics
+    double t_min,t_max,t_sum;
+    unsigned long cycles;
+    double t_report;
+
+public:
+    /****************************************************************/
+    Streamer(const string &robot, const string &part, const NewEulMode mode,
+             const double period) : PeriodicThread(period), robot(robot),
+                                    part(part), mode(mode), useAW(false),
+                                    awLinN(16), awQuadN(25), awD(1.0),
+                                    ring(NULL), estimator(NULL), statePort(NULL),
+                                    ienc(NULL), cycle(NULL) { }
+
+    /****************************************************************/
+    void setEstimator(const bool useAW, const size_t linN, const size_t quadN,
+                      const double D)
+    {
+        this->useAW=useAW;
+        awLinN=linN;
+        awQuadN=quadN;
+        awD=D;
+    }
+
+    /****************************************************************/
+    bool threadInit() override
+    {
+        Property options;
+        options.put("device","remote_controlboard");
+        options.put("remote","/"+robot+"/"+part);
+        options.put("local","/armDynStreamer/"+part);
+        if (!driver.open(options))
+            return false;
+        if (!driver.view(ienc))
+        {
+            driver.close();
+            return false;
+        }
+
+        string type=(part.find("left")==0)?"left":"right";
+        cycle=new ArmDynCycle(type,mode);
+
+        int nEnc; ienc->getAxes(&nEnc);
+        size_t N=cycle->getN();
+        enc.resize(std::max((size_t)nEnc,N),0.0);
+        encSpeed=encAcc=enc;
+        qDeg.resize(N,0.0); dqDeg=ddqDeg=qDeg;
+
+        // the ring retains a few times the largest window, so that
+        // the producer can run ahead of the loop without stalling it
+        useAW&=(mode==DYNAMIC);
+        if (useAW)
+        {
+            ring=new SampleRing(N,4*std::max(awLinN,awQuadN));
+            estimator=new AWEstimator(N,awLinN,awQuadN,awD);
+            statePort=new StatePort(*ring);
+            statePort->open("/armDynStreamer/state:i");
+            Network::connect("/"+robot+"/"+part+"/state:o",statePort->getName(),"udp");
+        }
+
+        ftPort.open("/armDynStreamer/ft:i");
+        torquesPort.open("/armDynStreamer/torques:o");
+        wrenchPort.open("/armDynStreamer/wrench:o");
+
+        t_min=1e9; t_max=t_sum=0.0;
+        cycles=0;
+        t_report=SystemClock::nowSystem();
+
+        return true;
+    }
+
+    /****************************************************************/
+    void run() override
+    {
+        double t0=SystemClock::nowSystem();
+
+        // the latest FT measurement, if any
+        if (Vector *ft=ftPort.read(false))
+            cycle->setWrench(*ft);
+
+        if (useAW)
+        {
+            // position, velocity and acceleration from the newest samples;
+            // nothing to do until the stream has started
+            if (estimator->estimate(*ring,qDeg,dqDeg,ddqDeg))
+                cycle->setState(qDeg,dqDeg,ddqDeg);
+        }
+        else
+        {
+            ienc->getEncoders(enc.data());
+            if (mode==DYNAMIC)
+            {
+                ienc->getEncoderSpeeds(encSpeed.data());
+                ienc->getEncoderAccelerations(encAcc.data());
+                cycle->setState(enc,encSpeed,encAcc);
+            }
+            else
+                cycle->setState(enc);
+        }
+
+        cycle->compute();
+
+        // the ports hand out a pool of buffers, growing while the
+        // previous writes are still in flight: each buffer is sized
+        // when it is handed out the first time and reused afterwards
+        Vector &tau=torquesPort.prepare();
+        if (tau.length()!=cycle->getN())
+            tau.resize(cycle->getN(),0.0);
+        cycle->getTorques(tau);
+        torquesPort.write();
+
+        Vector &wrench=wrenchPort.prepare();
+        if (wrench.length()!=6)
+            wrench.resize(6,0.0);
+        cycle->getWrench(wrench);
+        wrenchPort.write();
+
+        double t1=SystemClock::nowSystem();
+        double dt=t1-t0;
+        t_min=std::min(t_min,dt);
+        t_max=std::max(t_max,dt);
+        t_sum+=dt;
+        cycles++;
+
+        if (t1-t_report>=5.0)
+        {
+            yInfo()<<"cycle computation time [us]:"
+                   <<"min"<<1e6*t_min<<"avg"<<1e6*t_sum/cycles<<"max"<<1e6*t_max
+                   <<"| period [ms]:"<<1e3*getEstimatedPeriod();
+            t_min=1e9; t_max=t_sum=0.0;
+            cycles=0;
+            t_report=t1;
+        }
+    }
+
+    /****************************************************************/
+    void threadRelease() override
+    {
+        ftPort.close();
+        torquesPort.close();
+        wrenchPort.close();
+        driver.close();
+
+        if (statePort!=NULL)
+        {
+            statePort->close();
+            delete statePort;
+        }
+        delete estimator;
+        delete ring;
+
+        delete cycle;
+    }
+};
+
+
+/****************************************************************/
+class StreamerModule : public RFModule
+{
+    Streamer *streamer;
+
+public:
+    /****************************************************************/
+    StreamerModule() : streamer(NULL) { }
+
+    /****************************************************************/
+    bool configure(ResourceFinder &rf) override
+    {
+        string robot=rf.check("robot",Value("icubSim")).asString();
+        string part=rf.check("part",Value("right_arm")).asString();
+        NewEulMode mode=(rf.check("mode",Value("static")).asString()=="dynamic")?DYNAMIC:STATIC;
+        double period=rf.check("period",Value(0.001)).asFloat64();
+
+        streamer=new Streamer(robot,part,mode,period);
+        streamer->setEstimator(rf.check("estimator",Value("aw")).asString()=="aw",
+                               rf.check("aw_lin_N",Value(16)).asInt32(),
+                               rf.check("aw_quad_N",Value(25)).asInt32(),
+                               rf.check("aw_D",Value(1.0)).asFloat64());
+        if (!streamer->start())
+        {
+            delete streamer;
+            streamer=NULL;
+            return false;
+        }
+
+        return true;
+    }
+
+    /****************************************************************/
+    bool close() override
+    {
+        if (streamer!=NULL)
+        {
+            streamer->stop();
+            delete streamer;
+        }
+
+        return true;
+    }
+
+    /****************************************************************/
+    double getPeriod() override
+    {
+        return 1.0;
+    }
+
+    /****************************************************************/
+    bool updateModule() override
+    {
+        return true;
+    }
+};
+
+
+/****************************************************************/
+int main(int argc, char *argv[])
+{
+    Network yarp;
+    if (!yarp.checkNetwork())
+    {
+        yError()<<"YARP network does not seem to be available";
+        return EXIT_FAILURE;
+    }
+
+    ResourceFinder rf;
+    rf.configure(argc,argv);
+
+    StreamerModule module;
+    return module.runModule(rf);
+}
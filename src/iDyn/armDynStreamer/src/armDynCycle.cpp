@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2019 Fondazione Istituto Italiano di Tecnologia (IIT)
+ * All Rights Reserved.
+ * Authors: Ugo Pattacini <ugo.pattacini@iit.it>
+ */
+
+#include <armDynCycle.h>
+
+#include <algorithm>
+
+#include <iCub/ctrl/math.h>
+
+using namespace std;
+using namespace yarp::sig;
+using namespace iCub::ctrl;
+using namespace iCub::iDyn;
+
+/**********************************************************/
+ArmDynCycle::ArmDynCycle(const string &type, const NewEulMode mode) :
+                         arm(type), sensor(&arm,mode,NO_VERBOSE),
+                         F(3,0.0), Mu(3,0.0)
+{
+    arm.prepareNewtonEuler(mode);
+
+    // the arm is supposed to stand still at the base,
+    // which only feels the gravity
+    Vector w0(3,0.0),dw0(3,0.0),ddp0(3,0.0);
+    ddp0[2]=9.81;
+    arm.initKinematicNewtonEuler(w0,dw0,ddp0);
+}
+
+/**********************************************************/
+void ArmDynCycle::setWrench(const Vector &ft)
+{
+    if (ft.length()>=6)
+    {
+        F[0]=ft[0]; F[1]=ft[1]; F[2]=ft[2];
+        Mu[0]=ft[3]; Mu[1]=ft[4]; Mu[2]=ft[5];
+    }
+}
+
+/**********************************************************/
+void ArmDynCycle::setState(const Vector &qDeg)
+{
+    for (unsigned int i=0; i<arm.getN(); i++)
+        arm.setAng(i,CTRL_DEG2RAD*qDeg[i]);
+}
+
+/**********************************************************/
+void ArmDynCycle::setState(const Vector &qDeg, const Vector &dqDeg,
+                           const Vector &ddqDeg)
+{
+    for (unsigned int i=0; i<arm.getN(); i++)
+    {
+        arm.setAng(i,CTRL_DEG2RAD*qDeg[i]);
+        arm.setDAng(i,CTRL_DEG2RAD*dqDeg[i]);
+        arm.setD2Ang(i,CTRL_DEG2RAD*ddqDeg[i]);
+    }
+}
+
+/**********************************************************/
+void ArmDynCycle::compute()
+{
+    sensor.computeFromSensorNewtonEuler(F,Mu);
+}
+
+/**********************************************************/
+void ArmDynCycle::getTorques(Vector &tau) const
+{
+    for (unsigned int i=0; i<std::min((unsigned int)tau.length(),arm.getN()); i++)
+        tau[i]=arm.getTorque(i);
+}
+
+/**********************************************************/
+void ArmDynCycle::getWrench(Vector &wrench) const
+{
+    Vector fm=arm.getForceMomentEndEff();
+    for (size_t i=0; i<std::min(wrench.length(),fm.length()); i++)
+        wrench[i]=fm[i];
+}
@@ -0,0 +1,212 @@
+/*
+ * Copyright (C) 2019 Fondazione Istituto Italiano di Tecnologia (IIT)
+ * All Rights Reserved.
+ * Authors: Ugo Pattacini <ugo.pattacini@iit.it>
+ */
+
+#include <awEstimator.h>
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+using namespace yarp::sig;
+
+/**********************************************************/
+SampleRing::SampleRing(const size_t nJoints, const size_t capacity) :
+                       nJoints(nJoints), capacity(std::max((size_t)2,capacity)),
+                       buffer(new atomic<double>[this->capacity*(1+nJoints)]),
+                       head(0)
+{
+    for (size_t i=0; i<this->capacity*(1+nJoints); i++)
+        buffer[i].store(0.0,memory_order_relaxed);
+}
+
+/**********************************************************/
+void SampleRing::push(const double t, const double *y)
+{
+    uint64_t h=head.load(memory_order_relaxed);
+    atomic<double> *slot=&buffer[(h%capacity)*(1+nJoints)];
+    slot[0].store(t,memory_order_relaxed);
+    for (size_t j=0; j<nJoints; j++)
+        slot[1+j].store(y[j],memory_order_relaxed);
+
+    // publish the sample only once it is complete
+    head.store(h+1,memory_order_release);
+}
+
+/**********************************************************/
+size_t SampleRing::latest(const size_t n, double *t, double *y) const
+{
+    while (true)
+    {
+        uint64_t h=head.load(memory_order_acquire);
+        size_t m=(size_t)std::min((uint64_t)std::min(n,capacity-1),h);
+
+        for (size_t i=0; i<m; i++)
+        {
+            const atomic<double> *slot=&buffer[((h-1-i)%capacity)*(1+nJoints)];
+            t[i]=slot[0].load(memory_order_relaxed);
+            for (size_t j=0; j<nJoints; j++)
+                y[i*nJoints+j]=slot[1+j].load(memory_order_relaxed);
+        }
+
+        // retry if the producer has meanwhile started to overwrite
+        // the oldest sample we have copied: the sample being written
+        // is head, which overwrites the sample head-capacity
+        atomic_thread_fence(memory_order_acquire);
+        if (head.load(memory_order_relaxed)-h+m<capacity)
+            return m;
+    }
+}
+
+/**********************************************************/
+AWEstimator::AWEstimator(const size_t nJoints, const size_t linN,
+                         const size_t quadN, const double D) :
+                         nJoints(nJoints), linN(std::max((size_t)2,linN)),
+                         quadN(std::max((size_t)3,quadN)), D(D), tLatest(0.0),
+                         tau(1.0)
+{
+    size_t N=std::max(this->linN,this->quadN);
+    t.resize(N,0.0);
+    y.resize(N*nJoints,0.0);
+    sy.resize(nJoints,0.0); sty=st2y=sy;
+    c0=c1=c2=err=sy;
+    active.resize(nJoints,0);
+}
+
+/**********************************************************/
+void AWEstimator::fit(const size_t N, const int order, Vector &out)
+{
+    out=0.0;
+    fill(active.begin(),active.end(),1);
+    fill(sy.begin(),sy.end(),0.0);
+    fill(sty.begin(),sty.end(),0.0);
+    fill(st2y.begin(),st2y.end(),0.0);
+    fill(c2.begin(),c2.end(),0.0);
+
+    double St=0.0,St2=0.0,St3=0.0,St4=0.0;
+    size_t nMin=(size_t)order+1;
+
+    for (size_t n=1; n<=N; n++)
+    {
+        // the window gets enlarged by one older sample
+        double ti=t[n-1];
+        double ti2=ti*ti;
+        St+=ti; St2+=ti2; St3+=ti2*ti; St4+=ti2*ti2;
+
+        const double *yi=&y[(n-1)*nJoints];
+        for (size_t j=0; j<nJoints; j++)
+        {
+            sy[j]+=yi[j];
+            sty[j]+=ti*yi[j];
+            st2y[j]+=ti2*yi[j];
+        }
+
+        if (n<nMin)
+            continue;
+
+        // the normal equations depend only on the
+        // timestamps, hence they are shared by all the joints;
+        // with evenly spaced samples, det amounts to n^2(n^2-1)/12
+        // (linear) and n^3(n^2-1)^2(n^2-4)/2160 (quadratic) in
+        // units of the sample period, i.e. at least 1 and 4 for
+        // the smallest windows
+        if (order==1)
+        {
+            double det=n*St2-St*St;
+            if (fabs(det)<1e-6)
+                continue;
+
+            for (size_t j=0; j<nJoints; j++)
+            {
+                c1[j]=(n*sty[j]-St*sy[j])/det;
+                c0[j]=(sy[j]-c1[j]*St)/n;
+            }
+        }
+        else
+        {
+            double a=n,b=St,c=St2,d=St3,e=St4;
+            double i00=c*e-d*d, i01=c*d-b*e, i02=b*d-c*c;
+            double i11=a*e-c*c, i12=b*c-a*d, i22=a*c-b*b;
+            double det=a*i00+b*i01+c*i02;
+            if (fabs(det)<1e-6)
+                continue;
+
+            for (size_t j=0; j<nJoints; j++)
+            {
+                c0[j]=(i00*sy[j]+i01*sty[j]+i02*st2y[j])/det;
+                c1[j]=(i01*sy[j]+i11*sty[j]+i12*st2y[j])/det;
+                c2[j]=(i02*sy[j]+i12*sty[j]+i22*st2y[j])/det;
+            }
+        }
+
+        // the largest fitting error over the window
+        fill(err.begin(),err.end(),0.0);
+        for (size_t i=0; i<n; i++)
+        {
+            const double *yk=&y[i*nJoints];
+            double tk=t[i];
+            for (size_t j=0; j<nJoints; j++)
+                err[j]=std::max(err[j],fabs(yk[j]-(c0[j]+(c1[j]+c2[j]*tk)*tk)));
+        }
+
+        bool any=false;
+        for (size_t j=0; j<nJoints; j++)
+        {
+            if (active[j])
+            {
+                if (err[j]<=D)
+                {
+                    out[j]=(order==1)?c1[j]/tau:2.0*c2[j]/(tau*tau);
+                    any=true;
+                }
+                else
+                    active[j]=0;
+            }
+        }
+
+        if (!any)
+            break;
+    }
+}
+
+/**********************************************************/
+bool AWEstimator::estimate(const SampleRing &ring, Vector &q, Vector &dq,
+                           Vector &ddq)
+{
+    size_t n=ring.latest(t.size(),t.data(),y.data());
+    if (n==0)
+        return false;
+
+    if (q.length()!=nJoints)
+        q.resize(nJoints);
+    if (dq.length()!=nJoints)
+        dq.resize(nJoints);
+    if (ddq.length()!=nJoints)
+        ddq.resize(nJoints);
+
+    for (size_t j=0; j<nJoints; j++)
+        q[j]=y[j];
+
+    // the time is taken relative to the newest sample and
+    // in units of the mean sample period of the largest window
+    // to keep the normal equations well conditioned
+    tLatest=t[0];
+    size_t N=std::min(n,std::max(linN,quadN));
+    tau=(N>1)?(tLatest-t[N-1])/(N-1):0.0;
+    if (tau<=0.0)
+    {
+        dq=0.0;
+        ddq=0.0;
+        return true;
+    }
+
+    for (size_t i=0; i<n; i++)
+        t[i]=(t[i]-tLatest)/tau;
+
+    fit(std::min(n,linN),1,dq);
+    fit(std::min(n,quadN),2,ddq);
+
+    return true;
+}
@@ -0,0 +1,230 @@
+/*
+ * Copyright (C) 2019 Fondazione Istituto Italiano di Tecnologia (IIT)
+ * All Rights Reserved.
+ * Authors: Ugo Pattacini <ugo.pattacini@iit.it>
+ */
+
+#ifndef __BATCHNEWTONEULER_H__
+#define __BATCHNEWTONEULER_H__
+
+#include <cstddef>
+#include <array>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+
+#include <yarp/sig/Matrix.h>
+#include <iCub/iDyn/iDyn.h>
+
+#include <fixedNewtonEuler.h>
+
+/**
+ * This class computes the inverse dynamics of a chain of N links
+ * along a whole trajectory of B samples, spreading the samples
+ * over several threads. Data are arranged by samples, i.e. the N
+ * values of each sample are contiguous, as in the rows of a
+ * yarp::sig::Matrix, so that a trajectory of B samples is a BxN
+ * matrix and each thread works on a contiguous block of rows.
+ *
+ * The base kinematics and the end-effector wrench are the same
+ * for all the samples; the end-effector wrench is expressed in the
+ * frame of the last link, as in iCub::iDyn::iDynChain.
+ *
+ * The threads are started once by setThreads() and then woken up
+ * at each call to compute(), which is serialized.
+ */
+template<size_t N>
+class BatchNewtonEuler
+{
+protected:
+    FixedNewtonEuler<N> ne;
+    unsigned int nThreads;
+
+    // the trajectory currently handed out to the workers
+    struct Job
+    {
+        size_t B,chunk;
+        const double *q,*dq,*ddq;
+        double *tau;
+    };
+
+    std::vector<std::thread> workers;
+    mutable std::mutex mtxCompute;
+    mutable std::mutex mtx;
+    mutable std::condition_variable cvJob;
+    mutable std::condition_variable cvDone;
+    mutable Job job;
+    mutable unsigned long generation;
+    mutable unsigned int pending;
+    bool closing;
+
+    void computeBlock(const size_t b0, const size_t b1, const Job &j) const
+    {
+        for (size_t b=b0; b<b1; b++)
+            ne.computeTorques(&j.q[b*N],&j.dq[b*N],&j.ddq[b*N],&j.tau[b*N]);
+    }
+
+    // served is the last job the worker is not meant to execute
+    void loop(const unsigned int id, unsigned long served)
+    {
+        while (true)
+        {
+            Job j;
+            {
+                std::unique_lock<std::mutex> lck(mtx);
+                cvJob.wait(lck,[&](){ return closing || (generation!=served); });
+                if (closing)
+                    return;
+                served=generation;
+                j=job;
+            }
+
+            size_t b0=std::min(j.B,id*j.chunk);
+            computeBlock(b0,std::min(j.B,b0+j.chunk),j);
+
+            std::lock_guard<std::mutex> lg(mtx);
+            if (--pending==0)
+                cvDone.notify_one();
+        }
+    }
+
+    void stopWorkers()
+    {
+        {
+            std::lock_guard<std::mutex> lg(mtx);
+            closing=true;
+        }
+        cvJob.notify_all();
+        for (auto &w:workers)
+            w.join();
+        workers.clear();
+        closing=false;
+    }
+
+public:
+    /**
+     * Constructor.
+     * @param chain the iDynChain whose dynamics is replicated; it
+     *              must have N links.
+     * @param nThreads the number of threads (0 for all the cores).
+     */
+    BatchNewtonEuler(iCub::iDyn::iDynChain &chain, const unsigned int nThreads=0) :
+                     ne(extractLinks<N>(chain)), nThreads(0), generation(0),
+                     pending(0), closing(false)
+    {
+        setThreads(nThreads);
+    }
+
+    /**
+     * Destructor.
+     */
+    ~BatchNewtonEuler()
+    {
+        stopWorkers();
+    }
+
+    /**
+     * Return the number of links.
+     */
+    size_t getN() const { return N; }
+
+    /**
+     * Set the number of threads.
+     * @param nThreads the number of threads (0 for all the cores).
+     */
+    void setThreads(const unsigned int nThreads)
+    {
+        std::lock_guard<std::mutex> lg(mtxCompute);
+        unsigned int n=(nThreads>0)?nThreads:std::max(1U,std::thread::hardware_concurrency());
+        if ((n==this->nThreads) && (workers.size()==((n>1)?n:0)))
+            return;
+
+        stopWorkers();
+        this->nThreads=n;
+        if (n>1)
+            for (unsigned int id=0; id<n; id++)
+                workers.push_back(std::thread(&BatchNewtonEuler::loop,this,id,generation));
+    }
+
+    /**
+     * Return the number of threads.
+     */
+    unsigned int getThreads() const { return nThreads; }
+
+    /**
+     * Set the kinematics of the base, shared by all the samples.
+     */
+    void setBaseKinematics(const Vec3 &w0, const Vec3 &dw0, const Vec3 &ddp0)
+    {
+        ne.setBaseKinematics(w0,dw0,ddp0);
+    }
+
+    /**
+     * Set the wrench applied to the environment by the
+     * end-effector, shared by all the samples.
+     */
+    void setEndEffWrench(const Vec3 &F, const Vec3 &Mu)
+    {
+        ne.setEndEffWrench(F,Mu);
+    }
+
+    /**
+     * Compute the joints torques along a trajectory.
+     * @param B the number of samples.
+     * @param q the B*N joints angles [rad], where q[b*N+i] is the
+     *          i-th joint of the b-th sample.
+     * @param dq the B*N joints velocities [rad/s].
+     * @param ddq the B*N joints accelerations [rad/s^2].
+     * @param tau the B*N joints torques [Nm].
+     */
+    void compute(const size_t B, const double *q, const double *dq,
+                 const double *ddq, double *tau) const
+    {
+        std::lock_guard<std::mutex> lg(mtxCompute);
+
+        // not worth waking up the workers for short trajectories
+        Job j={B,B,q,dq,ddq,tau};
+        size_t nBlocks=std::min(workers.size(),(B+255)/256);
+        if (nBlocks<=1)
+        {
+            computeBlock(0,B,j);
+            return;
+        }
+
+        // the workers beyond nBlocks get an empty block
+        j.chunk=(B+nBlocks-1)/nBlocks;
+
+        std::unique_lock<std::mutex> lck(mtx);
+        job=j;
+        pending=(unsigned int)workers.size();
+        generation++;
+        cvJob.notify_all();
+        cvDone.wait(lck,[&](){ return pending==0; });
+    }
+
+    /**
+     * Compute the joints torques along a trajectory.
+     * @param q the BxN matrix of joints angles [rad], one sample
+     *          per row.
+     * @param dq the BxN matrix of joints velocities [rad/s].
+     * @param ddq the BxN matrix of joints accelerations [rad/s^2].
+     * @return the BxN matrix of joints torques [Nm], or an empty
+     *         matrix if the sizes do not match.
+     */
+    yarp::sig::Matrix compute(const yarp::sig::Matrix &q, const yarp::sig::Matrix &dq,
+                              const yarp::sig::Matrix &ddq) const
+    {
+        yarp::sig::Matrix tau;
+        if (((size_t)q.cols()!=N) || (dq.rows()!=q.rows()) || (dq.cols()!=q.cols()) ||
+            (ddq.rows()!=q.rows()) || (ddq.cols()!=q.cols()))
+            return tau;
+
+        tau.resize(q.rows(),N);
+        compute((size_t)q.rows(),q.data(),dq.data(),ddq.data(),tau.data());
+        return tau;
+    }
+};
+
+#endif
@@ -0,0 +1,134 @@
+/**
+ * @ingroup icub_tutorials
+ *
+ * \defgroup icub_batchDynamics Batched Inverse Dynamics of the
+ *           iCub arm
+ *
+ * A tutorial on how to predict the joints torques of the iCub arm
+ * (iCubArmNoTorsoDyn) along a whole planned trajectory at once,
+ * e.g. to feed a feedforward controller. The trajectory is passed
+ * as BxN matrices of joints angles, velocities and accelerations
+ * and the samples are spread over the available cores; the torques
+ * are returned as a contiguous BxN matrix.
+ *
+ * The torques are checked against iDynChain::getTorques() sample
+ * by sample and the timings are reported for one and many threads.
+ *
+ * Options:
+ * -) --type left|right: the arm (default: right)
+ * -) --samples B: the length of the trajectory (default: 10000)
+ * -) --threads n: the number of threads (default: all the cores)
+ * -) --tol t: the tolerance on the torques difference [Nm] (default: 1e-9)
+ *
+ * \author Ugo Pattacini
+ *
+ * CopyPolicy: Released under the terms of GPL 2.0 or later
+ */
+
+#include <cstdlib>
+#include <cmath>
+#include <string>
+#include <algorithm>
+
+#include <yarp/os/all.h>
+#include <yarp/sig/all.h>
+
+#include <iCub/iDyn/iDyn.h>
+
+#include <batchNewtonEuler.h>
+
+using namespace std;
+using namespace yarp::os;
+using namespace yarp::sig;
+using namespace iCub::iDyn;
+
+#define NLINKS  7
+
+
+/****************************************************************/
+int main(int argc, char *argv[])
+{
+    ResourceFinder rf;
+    rf.configure(argc,argv);
+
+    string type=rf.check("type",Value("right")).asString();
+    int B=std::max(1,rf.check("samples",Value(10000)).asInt32());
+    int nThreads=std::max(0,rf.check("threads",Value(0)).asInt32());
+    double tol=rf.check("tol",Value(1e-9)).asFloat64();
+
+    iCubArmNoTorsoDyn arm(type);
+    if (arm.getN()!=NLINKS)
+    {
+        yError()<<"the arm is expected to have"<<NLINKS<<"links, found"<<arm.getN();
+        return EXIT_FAILURE;
+    }
+
+    BatchNewtonEuler<NLINKS> batch(arm,(unsigned int)nThreads);
+
+    // a smooth trajectory of 10 s: each joint oscillates
+    // around the middle of its range with its own frequency
+    Matrix q(B,NLINKS),dq(B,NLINKS),ddq(B,NLINKS);
+    for (int b=0; b<B; b++)
+    {
+        double t=10.0*b/B;
+        for (int i=0; i<NLINKS; i++)
+        {
+            iDynLink *link=arm.refLink(i);
+            double c=0.5*(link->getMax()+link->getMin());
+            double a=0.4*(link->getMax()-link->getMin());
+            double w=2.0*M_PI*(0.1+0.05*i);
+
+            q(b,i)=c+a*sin(w*t);
+            dq(b,i)=a*w*cos(w*t);
+            ddq(b,i)=-a*w*w*sin(w*t);
+        }
+    }
+
+    // one thread
+    batch.setThreads(1);
+    double t0=SystemClock::nowSystem();
+    Matrix tau1=batch.compute(q,dq,ddq);
+    double dt_single=SystemClock::nowSystem()-t0;
+
+    // many threads
+    batch.setThreads((unsigned int)nThreads);
+    t0=SystemClock::nowSystem();
+    Matrix tau=batch.compute(q,dq,ddq);
+    double dt_multi=SystemClock::nowSystem()-t0;
+
+    // iDyn, sample by sample
+    Vector w0(3,0.0),dw0(3,0.0),ddp0(3,0.0);
+    ddp0[2]=9.81;
+    Vector Fend(3,0.0),Muend(3,0.0);
+    arm.prepareNewtonEuler(DYNAMIC);
+    arm.initKinematicNewtonEuler(w0,dw0,ddp0);
+
+    double maxErr=0.0;
+    t0=SystemClock::nowSystem();
+    for (int b=0; b<B; b++)
+    {
+        arm.setAng(q.getRow(b));
+        arm.setDAng(dq.getRow(b));
+        arm.setD2Ang(ddq.getRow(b));
+        arm.computeNewtonEuler(w0,dw0,ddp0,Fend,Muend);
+
+        Vector tauIDyn=arm.getTorques();
+        for (int i=0; i<NLINKS; i++)
+            maxErr=std::max(maxErr,std::max(fabs(tau(b,i)-tauIDyn[i]),fabs(tau1(b,i)-tauIDyn[i])));
+    }
+    double dt_iDyn=SystemClock::nowSystem()-t0;
+
+    yInfo()<<B<<"samples of the"<<type<<"arm trajectory";
+    yInfo()<<"max torques difference ="<<maxErr<<"[Nm]";
+    yInfo()<<"iDyn sample by sample ="<<dt_iDyn<<"[s]";
+    yInfo()<<"batch, 1 thread ="<<dt_single<<"[s]";
+    yInfo()<<"batch,"<<batch.getThreads()<<"threads ="<<dt_multi<<"[s]";
+
+    if (maxErr>tol)
+    {
+        yError()<<"the torques differ more than the tolerance"<<tol;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
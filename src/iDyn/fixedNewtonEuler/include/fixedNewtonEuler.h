@@ -0,0 +1,249 @@
+/*
+ * Copyright (C) 2019 Fondazione Istituto Italiano di Tecnologia (IIT)
+ * All Rights Reserved.
+ * Authors: Ugo Pattacini <ugo.pattacini@iit.it>
+ */
+
+#ifndef __FIXEDNEWTONEULER_H__
+#define __FIXEDNEWTONEULER_H__
+
+#include <cmath>
+#include <cstddef>
+#include <array>
+
+#include <yarp/sig/Matrix.h>
+#include <iCub/iDyn/iDyn.h>
+
+/**
+ * A 3D vector stored on the stack.
+ */
+struct Vec3
+{
+    double v[3];
+
+    /**********************************************************/
+    double operator[](const int i) const { return v[i]; }
+    double &operator[](const int i) { return v[i]; }
+
+    /**********************************************************/
+    Vec3 operator+(const Vec3 &b) const { return Vec3{{v[0]+b.v[0],v[1]+b.v[1],v[2]+b.v[2]}}; }
+    Vec3 operator-(const Vec3 &b) const { return Vec3{{v[0]-b.v[0],v[1]-b.v[1],v[2]-b.v[2]}}; }
+    Vec3 operator*(const double k) const { return Vec3{{k*v[0],k*v[1],k*v[2]}}; }
+
+    /**********************************************************/
+    Vec3 cross(const Vec3 &b) const
+    {
+        return Vec3{{v[1]*b.v[2]-v[2]*b.v[1],
+                     v[2]*b.v[0]-v[0]*b.v[2],
+                     v[0]*b.v[1]-v[1]*b.v[0]}};
+    }
+
+    /**********************************************************/
+    double dot(const Vec3 &b) const { return v[0]*b.v[0]+v[1]*b.v[1]+v[2]*b.v[2]; }
+};
+
+/**
+ * A 3x3 matrix stored by rows on the stack.
+ */
+struct Mat3
+{
+    double m[3][3];
+
+    /**********************************************************/
+    static Mat3 eye()
+    {
+        return Mat3{{{1.0,0.0,0.0},{0.0,1.0,0.0},{0.0,0.0,1.0}}};
+    }
+
+    /**********************************************************/
+    Vec3 operator*(const Vec3 &b) const
+    {
+        return Vec3{{m[0][0]*b.v[0]+m[0][1]*b.v[1]+m[0][2]*b.v[2],
+                     m[1][0]*b.v[0]+m[1][1]*b.v[1]+m[1][2]*b.v[2],
+                     m[2][0]*b.v[0]+m[2][1]*b.v[1]+m[2][2]*b.v[2]}};
+    }
+
+    /**********************************************************/
+    Vec3 transposedTimes(const Vec3 &b) const
+    {
+        return Vec3{{m[0][0]*b.v[0]+m[1][0]*b.v[1]+m[2][0]*b.v[2],
+                     m[0][1]*b.v[0]+m[1][1]*b.v[1]+m[2][1]*b.v[2],
+                     m[0][2]*b.v[0]+m[1][2]*b.v[1]+m[2][2]*b.v[2]}};
+    }
+};
+
+/**
+ * The kinematic and dynamic parameters of a link: the standard
+ * Denavit-Hartenberg parameters, the mass [kg], the center of mass
+ * and the inertia tensor about the center of mass, both expressed
+ * in the link frame.
+ */
+struct NELink
+{
+    double A;
+    double D;
+    double alpha;
+    double offset;
+    double mass;
+    Vec3   rC;
+    Mat3   I;
+};
+
+/**
+ * Extract the parameters of the first N links of an iDyn chain.
+ * @param chain the chain, which must have at least N links.
+ * @return the links parameters.
+ */
+template<size_t N>
+std::array<NELink,N> extractLinks(iCub::iDyn::iDynChain &chain)
+{
+    std::array<NELink,N> links;
+    for (size_t i=0; i<N; i++)
+    {
+        iCub::iDyn::iDynLink *link=chain.refLink((unsigned int)i);
+        NELink &l=links[i];
+
+        l.A=link->getA();
+        l.D=link->getD();
+        l.alpha=link->getAlpha();
+        l.offset=link->getOffset();
+        l.mass=link->getMass();
+
+        // the center of mass is the translation of the roto-translation
+        // matrix of the COM expressed in the link frame
+        yarp::sig::Matrix HC=link->getCOM();
+        yarp::sig::Matrix I=link->getInertia();
+        for (int r=0; r<3; r++)
+        {
+            l.rC[r]=HC(r,3);
+            for (int c=0; c<3; c++)
+                l.I.m[r][c]=I(r,c);
+        }
+    }
+
+    return links;
+}
+
+/**
+ * The recursive Newton-Euler algorithm (as in Siciliano et al.,
+ * "Robotics: Modelling, Planning and Control") for a chain of N
+ * revolute links known at compile time, working on stack-allocated
+ * 3x3 matrices and 3D vectors only, with the link parameters stored
+ * contiguously.
+ *
+ * The base kinematics (angular velocity and acceleration, linear
+ * acceleration with the gravity folded in) is expressed in the base
+ * frame of the Denavit-Hartenberg chain, as in
+ * iCub::iDyn::iDynChain::initKinematicNewtonEuler(); the wrench
+ * acting on the end-effector is expressed in the end-effector frame,
+ * which is placed after the last link by (RN,pN).
+ */
+template<size_t N>
+class FixedNewtonEuler
+{
+protected:
+    std::array<NELink,N> links;
+    std::array<double,N> ca,sa;
+    Mat3 RN;
+    Vec3 pN;
+
+    Vec3 w0,dw0,ddp0;
+    Vec3 Fend,Muend;
+
+public:
+    /**********************************************************/
+    FixedNewtonEuler(const std::array<NELink,N> &links,
+                     const Mat3 &RN=Mat3::eye(),
+                     const Vec3 &pN=Vec3{{0.0,0.0,0.0}}) : links(links), RN(RN), pN(pN)
+    {
+        for (size_t i=0; i<N; i++)
+        {
+            ca[i]=std::cos(links[i].alpha);
+            sa[i]=std::sin(links[i].alpha);
+        }
+
+        w0=dw0=Fend=Muend=Vec3{{0.0,0.0,0.0}};
+        ddp0=Vec3{{0.0,0.0,9.81}};
+    }
+
+    /**********************************************************/
+    size_t getN() const { return N; }
+
+    /**
+     * Set the kinematics of the base.
+     */
+    void setBaseKinematics(const Vec3 &w0, const Vec3 &dw0, const Vec3 &ddp0)
+    {
+        this->w0=w0;
+        this->dw0=dw0;
+        this->ddp0=ddp0;
+    }
+
+    /**
+     * Set the wrench applied to the environment by the end-effector.
+     */
+    void setEndEffWrench(const Vec3 &F, const Vec3 &Mu)
+    {
+        Fend=F;
+        Muend=Mu;
+    }
+
+    /**
+     * Compute the joints torques.
+     * @param q the joints angles [rad].
+     * @param dq the joints velocities [rad/s].
+     * @param ddq the joints accelerations [rad/s^2].
+     * @param tau the joints torques [Nm].
+     */
+    void computeTorques(const double *q, const double *dq, const double *ddq,
+                        double *tau) const
+    {
+        const Vec3 z0{{0.0,0.0,1.0}};
+        Mat3 R[N];
+        Vec3 r[N],w[N],dw[N],ddpC[N];
+
+        // forward recursion: kinematics
+        Vec3 w_prev=w0,dw_prev=dw0,ddp_prev=ddp0;
+        for (size_t i=0; i<N; i++)
+        {
+            const NELink &l=links[i];
+            double theta=q[i]+l.offset;
+            double c=std::cos(theta),s=std::sin(theta);
+
+            R[i]=Mat3{{{c,-s*ca[i], s*sa[i]},
+                       {s, c*ca[i],-c*sa[i]},
+                       {0.0,  sa[i],   ca[i]}}};
+            r[i]=Vec3{{l.A,l.D*sa[i],l.D*ca[i]}};
+
+            w[i]=R[i].transposedTimes(w_prev+z0*dq[i]);
+            dw[i]=R[i].transposedTimes(dw_prev+z0*ddq[i]+w_prev.cross(z0)*dq[i]);
+            Vec3 ddp=R[i].transposedTimes(ddp_prev)+dw[i].cross(r[i])+w[i].cross(w[i].cross(r[i]));
+            ddpC[i]=ddp+dw[i].cross(l.rC)+w[i].cross(w[i].cross(l.rC));
+
+            w_prev=w[i];
+            dw_prev=dw[i];
+            ddp_prev=ddp;
+        }
+
+        // backward recursion: wrenches, starting from the end-effector
+        // wrench moved to the frame of the last link
+        Vec3 Rf=RN*Fend;
+        Vec3 Rmu=RN*Muend+pN.cross(Rf);
+        for (size_t k=N; k>0; k--)
+        {
+            size_t i=k-1;
+            const NELink &l=links[i];
+
+            Vec3 f=Rf+ddpC[i]*l.mass;
+            Vec3 mu=Rmu-f.cross(r[i]+l.rC)+Rf.cross(l.rC)+l.I*dw[i]+w[i].cross(l.I*w[i]);
+
+            // z0 expressed in the frame of the link
+            tau[i]=mu[1]*sa[i]+mu[2]*ca[i];
+
+            Rf=R[i]*f;
+            Rmu=R[i]*mu;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,171 @@
+/**
+ * @ingroup icub_tutorials
+ *
+ * \defgroup icub_fixedNewtonEuler Fixed-size Newton-Euler on the
+ *           iCub arm
+ *
+ * A tutorial on how to specialize the recursive Newton-Euler of
+ * the iCub arm (iCubArmNoTorsoDyn) when the number of links is
+ * known at compile time: the kinematic and dynamic parameters are
+ * extracted once from the iDyn limb and stored contiguously, then
+ * the recursion works on stack-allocated 3x3 matrices and 3D
+ * vectors only, with no yarp::sig::Matrix/Vector allocated per
+ * call.
+ *
+ * The torques are compared with those returned by
+ * iDynChain::getTorques() over random configurations within the
+ * joints limits, and the per-call time of both implementations is
+ * reported. The two are to be taken as equivalent only as long as
+ * this check passes: the largest difference is reported per joint
+ * along with the state where it occurs, and the process exits with
+ * failure beyond the tolerance.
+ *
+ * Options:
+ * -) --type left|right: the arm (default: right)
+ * -) --samples n: the number of random states (default: 10000)
+ * -) --tol t: the tolerance on the torques difference [Nm] (default: 1e-9)
+ *
+ * \author Ugo Pattacini
+ *
+ * CopyPolicy: Released under the terms of GPL 2.0 or later
+ */
+
+#include <cstdlib>
+#include <cmath>
+#include <array>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <yarp/os/all.h>
+#include <yarp/sig/all.h>
+#include <yarp/math/Rand.h>
+
+#include <iCub/iDyn/iDyn.h>
+
+#include <fixedNewtonEuler.h>
+
+using namespace std;
+using namespace yarp::os;
+using namespace yarp::sig;
+using namespace yarp::math;
+using namespace iCub::iDyn;
+
+#define NLINKS  7
+
+
+/****************************************************************/
+int main(int argc, char *argv[])
+{
+    ResourceFinder rf;
+    rf.configure(argc,argv);
+
+    string type=rf.check("type",Value("right")).asString();
+    int samples=std::max(1,rf.check("samples",Value(10000)).asInt32());
+    double tol=rf.check("tol",Value(1e-9)).asFloat64();
+
+    iCubArmNoTorsoDyn arm(type);
+    if (arm.getN()!=NLINKS)
+    {
+        yError()<<"the arm is expected to have"<<NLINKS<<"links, found"<<arm.getN();
+        return EXIT_FAILURE;
+    }
+
+    // iDyn handles the end-effector wrench in the frame of the last
+    // link, thus the default (identity) end-effector transformation
+    // is kept to compare the torques
+    FixedNewtonEuler<NLINKS> fixedNE(extractLinks<NLINKS>(arm));
+    arm.prepareNewtonEuler(DYNAMIC);
+
+    Vector w0(3,0.0),dw0(3,0.0),ddp0(3,0.0);
+    ddp0[2]=9.81;
+    Vector Fend(3,0.0),Muend(3,0.0);
+    arm.initKinematicNewtonEuler(w0,dw0,ddp0);
+    fixedNE.setBaseKinematics(Vec3{{w0[0],w0[1],w0[2]}},Vec3{{dw0[0],dw0[1],dw0[2]}},
+                              Vec3{{ddp0[0],ddp0[1],ddp0[2]}});
+
+    // random states within the joints limits, drawn beforehand
+    // so that the timings account for the computation only
+    vector<double> Q(samples*NLINKS),dQ(Q.size()),ddQ(Q.size());
+    Rand::init();
+    for (int k=0; k<samples; k++)
+    {
+        for (size_t i=0; i<NLINKS; i++)
+        {
+            iDynLink *link=arm.refLink((unsigned int)i);
+            Q[k*NLINKS+i]=Rand::scalar(link->getMin(),link->getMax());
+            dQ[k*NLINKS+i]=Rand::scalar(-1.0,1.0);
+            ddQ[k*NLINKS+i]=Rand::scalar(-1.0,1.0);
+        }
+    }
+
+    // iDyn
+    Vector q(NLINKS),dq(NLINKS),ddq(NLINKS);
+    vector<double> tauIDyn(Q.size());
+    double t0=SystemClock::nowSystem();
+    for (int k=0; k<samples; k++)
+    {
+        for (size_t i=0; i<NLINKS; i++)
+        {
+            q[i]=Q[k*NLINKS+i];
+            dq[i]=dQ[k*NLINKS+i];
+            ddq[i]=ddQ[k*NLINKS+i];
+        }
+
+        arm.setAng(q);
+        arm.setDAng(dq);
+        arm.setD2Ang(ddq);
+        arm.computeNewtonEuler(w0,dw0,ddp0,Fend,Muend);
+
+        Vector tau=arm.getTorques();
+        copy(tau.begin(),tau.end(),tauIDyn.begin()+k*NLINKS);
+    }
+    double dt_iDyn=SystemClock::nowSystem()-t0;
+
+    // fixed-size
+    vector<double> tauFixed(Q.size());
+    t0=SystemClock::nowSystem();
+    for (int k=0; k<samples; k++)
+        fixedNE.computeTorques(&Q[k*NLINKS],&dQ[k*NLINKS],&ddQ[k*NLINKS],&tauFixed[k*NLINKS]);
+    double dt_fixed=SystemClock::nowSystem()-t0;
+
+    double maxErr=0.0,maxTau=0.0;
+    array<double,NLINKS> jointErr;
+    jointErr.fill(0.0);
+    size_t worst=0;
+    for (size_t j=0; j<Q.size(); j++)
+    {
+        double err=fabs(tauFixed[j]-tauIDyn[j]);
+        jointErr[j%NLINKS]=std::max(jointErr[j%NLINKS],err);
+        maxTau=std::max(maxTau,fabs(tauIDyn[j]));
+        if (err>maxErr)
+        {
+            maxErr=err;
+            worst=j/NLINKS;
+        }
+    }
+
+    yInfo()<<samples<<"random states of the"<<type<<"arm";
+    yInfo()<<"max torques difference ="<<maxErr<<"[Nm] over torques up to"<<maxTau<<"[Nm]";
+    Vector errs(NLINKS,jointErr.data());
+    yInfo()<<"max difference per joint [Nm] = ("<<errs.toString(3,3)<<")";
+    yInfo()<<"iDyn per call ="<<1e6*dt_iDyn/samples<<"[us]";
+    yInfo()<<"fixed-size per call ="<<1e6*dt_fixed/samples<<"[us]";
+    if (dt_fixed>0.0)
+        yInfo()<<"speed-up ="<<dt_iDyn/dt_fixed;
+
+    if (maxErr>tol)
+    {
+        Vector qw(NLINKS,&Q[worst*NLINKS]),dqw(NLINKS,&dQ[worst*NLINKS]),ddqw(NLINKS,&ddQ[worst*NLINKS]);
+        Vector tw(NLINKS,&tauIDyn[worst*NLINKS]),tf(NLINKS,&tauFixed[worst*NLINKS]);
+        yError()<<"the torques differ more than the tolerance"<<tol<<"at the state #"<<worst;
+        yError()<<"q [rad] = ("<<qw.toString(6,6)<<")";
+        yError()<<"dq [rad/s] = ("<<dqw.toString(6,6)<<")";
+        yError()<<"ddq [rad/s^2] = ("<<ddqw.toString(6,6)<<")";
+        yError()<<"iDyn tau [Nm] = ("<<tw.toString(9,9)<<")";
+        yError()<<"fixed-size tau [Nm] = ("<<tf.toString(9,9)<<")";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
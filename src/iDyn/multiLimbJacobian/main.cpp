@@ -10,13 +10,39 @@
 // and the end-effector pose are computed, for different couples of limbs.
 //
 // Author: Serena Ivaldi - <serena.ivaldi@iit.it>
+//
+// The node can also serve all the couples from a kinematic cache, which is filled
+// once per joints update; run with "--benchmark [ticks]" to compare the two ways.
+//
+// Finally, run with "--batch" to evaluate the couples over a stream of joints states
+// instead of the interactive menu (see batchMode() below for the options and formats).
 
 #include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <csignal>
+#include <fstream>
 #include <iostream>
 #include <iomanip>
 
+#include <yarp/os/Network.h>
+#include <yarp/os/BufferedPort.h>
+#include <yarp/os/Bottle.h>
+#include <yarp/os/ResourceFinder.h>
+#include <yarp/os/SystemClock.h>
 #include <yarp/sig/Vector.h>
 #include <yarp/sig/Matrix.h>
+#include <yarp/math/Math.h>
+#include <yarp/math/Rand.h>
 #include <iCub/ctrl/math.h>
 #include <iCub/iKin/iKinFwd.h>
 #include <iCub/iDyn/iDyn.h>
@@ -25,7 +51,9 @@
 
 using namespace std;
 using namespace yarp;
+using namespace yarp::os;
 using namespace yarp::sig;
+using namespace yarp::math;
 using namespace iCub::ctrl;
 using namespace iCub::iKin;
 using namespace iCub::iDyn;
@@ -41,6 +69,190 @@ using namespace iCub::skinDynLib;
 // it's important to remember the indeces because they identify the limb during computations.
 // as usual, one can create its own limbs (iDynLimb), but here we use icub arms, torso and head.
 
+
+// computeJacobian/computePose traverse both the limbs of the couple from scratch at each call,
+// hence the limbs shared by many couples (torso, head) are traversed over and over again.
+// the cache below stores the frames of every limb once per joints update, then each couple is
+// obtained just by composing the stored frames.
+// the frames of a limb are accumulated link after link from the DH parameters, and they are
+// recomputed only when the joints angles of the limb differ from those they were computed
+// for, so that there is no need to notify the cache after setAng().
+// every limb is attached to the node either by its base (arms, head) or by its end-effector
+// (the torso): the couple starts from the free end of the first limb, goes through the node
+// and ends at the free end of the second limb, which fixes the directions JAC_KIN/JAC_IKIN.
+// the columns of the Jacobian follow the joints order of the first limb and then of the second
+// limb; the joints traversed against their kinematic direction get the opposite sign.
+// as in iKin, the blocked links enter the frames with their blocked angle but have no column.
+
+class NodeKinCache
+{
+protected:
+
+    struct Entry
+    {
+        iDynLimb       *limb;
+        Matrix          RBT;        // the pose of the attachment frame wrt the node
+        bool            byBase;     // true if attached by the base, false if by the end-effector
+        vector<Matrix>  frames;     // frames[j] is the frame whose z-axis is the j-th joint axis
+        Matrix          H;          // the end-effector wrt the limb base (H0 and HN included)
+        Vector          q;          // the joints angles the frames refer to
+        vector<bool>    blocked;    // the blocked links the frames refer to
+        unsigned int    dof;        // the number of links which are not blocked
+        bool            valid;
+    };
+
+    vector<Entry> entries;
+
+    // the transformation of the j-th link in standard DH convention
+    static Matrix linkH(const iKinLink &l)
+    {
+        double theta=l.getAng()+l.getOffset();
+        double c=cos(theta),     s=sin(theta);
+        double ca=cos(l.getAlpha()), sa=sin(l.getAlpha());
+
+        Matrix H(4,4);
+        H(0,0)=c;   H(0,1)=-s*ca; H(0,2)=s*sa;  H(0,3)=l.getA()*c;
+        H(1,0)=s;   H(1,1)=c*ca;  H(1,2)=-c*sa; H(1,3)=l.getA()*s;
+        H(2,0)=0.0; H(2,1)=sa;    H(2,2)=ca;    H(2,3)=l.getD();
+        H(3,0)=0.0; H(3,1)=0.0;   H(3,2)=0.0;   H(3,3)=1.0;
+        return H;
+    }
+
+    // recompute the frames of the limb if its joints have changed since the last time
+    const Entry &get(unsigned int i)
+    {
+        Entry &e=entries[i];
+        iKinChain &chain=*e.limb->asChain();
+        unsigned int N=chain.getN();
+
+        bool changed=!e.valid;
+        for (unsigned int j=0; (j<N) && !changed; j++)
+            changed=(chain[j].getAng()!=e.q[j]) || (chain[j].isBlocked()!=e.blocked[j]);
+
+        if (changed)
+        {
+            e.frames.resize(N);
+            e.q.resize(N);
+            e.blocked.resize(N);
+            e.dof=chain.getDOF();
+
+            Matrix F=chain.getH0();
+            for (unsigned int j=0; j<N; j++)
+            {
+                e.frames[j]=F;
+                e.q[j]=chain[j].getAng();
+                e.blocked[j]=chain[j].isBlocked();
+                F=F*linkH(chain[j]);
+            }
+
+            e.H=F*chain.getHN();
+            e.valid=true;
+        }
+
+        return e;
+    }
+
+    // the pose of the free end of limb A wrt the node, and of the free end of limb B wrt the node
+    Matrix rootToNode(const Entry &a) const
+    {
+        return (a.byBase ? yarp::math::SE3inv(a.H) : a.H) * yarp::math::SE3inv(a.RBT);
+    }
+
+    Matrix nodeToTip(const Entry &b) const
+    {
+        return b.RBT * (b.byBase ? b.H : yarp::math::SE3inv(b.H));
+    }
+
+    void fillColumns(Matrix &J, unsigned int col, const Entry &e, const Matrix &M,
+                     const double sign, const Vector &pe) const
+    {
+        for (size_t j=0; j<e.frames.size(); j++)
+        {
+            if (e.blocked[j])
+                continue;
+
+            Matrix F=M*e.frames[j];
+            Vector z=F.getCol(2).subVector(0,2);
+            Vector p=F.getCol(3).subVector(0,2);
+            Vector w=sign*yarp::math::cross(z,pe-p);
+
+            for (int k=0; k<3; k++)
+            {
+                J(k,col)=w[k];
+                J(k+3,col)=sign*z[k];
+            }
+            col++;
+        }
+    }
+
+public:
+
+    // register a limb: the order of registration gives the index of the limb
+    void addLimb(iDynLimb *limb, const Matrix &RBT, const bool byBase)
+    {
+        Entry e;
+        e.limb=limb;
+        e.RBT=RBT;
+        e.byBase=byBase;
+        e.dof=0;
+        e.valid=false;
+        entries.push_back(e);
+    }
+
+    // the roto-translational matrix of the couple
+    Matrix computeH(unsigned int iA, unsigned int iB)
+    {
+        return rootToNode(get(iA))*nodeToTip(get(iB));
+    }
+
+    // the Jacobian of the couple
+    Matrix computeJacobian(unsigned int iA, unsigned int iB)
+    {
+        const Entry &a=get(iA);
+        const Entry &b=get(iB);
+        const Matrix RN=rootToNode(a);
+        const Matrix H=RN*nodeToTip(b);
+        const Vector pe=H.getCol(3).subVector(0,2);
+
+        Matrix J(6,a.dof+b.dof);
+
+        Matrix MA(4,4); MA.eye();
+        if (a.byBase)
+            MA=yarp::math::SE3inv(a.H);
+        fillColumns(J,0,a,MA,a.byBase ? -1.0 : 1.0,pe);
+
+        Matrix MB=RN*b.RBT;
+        if (!b.byBase)
+            MB=MB*yarp::math::SE3inv(b.H);
+        fillColumns(J,a.dof,b,MB,b.byBase ? 1.0 : -1.0,pe);
+
+        return J;
+    }
+
+    // the pose of the couple, with the same representation as iKin
+    Vector computePose(unsigned int iA, unsigned int iB, bool axisRep = false)
+    {
+        Matrix H=computeH(iA,iB);
+        Vector v(axisRep ? 7 : 6);
+        v[0]=H(0,3); v[1]=H(1,3); v[2]=H(2,3);
+
+        if (axisRep)
+        {
+            Vector r=yarp::math::dcm2axis(H);
+            v[3]=r[0]; v[4]=r[1]; v[5]=r[2]; v[6]=r[3];
+        }
+        else
+        {
+            // Euler angles as XYZ
+            v[3]=atan2(-H(2,1),H(2,2));
+            v[4]=asin(H(2,0));
+            v[5]=atan2(-H(1,0),H(0,0));
+        }
+
+        return v;
+    }
+};
+
 class UpTorso : public iDynNode
 {
 public: 
@@ -50,6 +262,8 @@ public:
     iDynLimb *torso;
     iDynLimb *arm_left;
 
+    NodeKinCache cache;
+
     // construct the node
     UpTorso()
     :iDynNode("node with arms, torso and head")
@@ -93,6 +307,13 @@ public:
         addLimb(head,Hhead);
         addLimb(arm_left,Harm_left);
 
+        // the same limbs go into the cache, with the same indeces
+        // note that the torso is the only one attached to the node by its end-effector
+        cache.addLimb(arm_right,Harm_right,true);
+        cache.addLimb(torso,Htorso,false);
+        cache.addLimb(head,Hhead,true);
+        cache.addLimb(arm_left,Harm_left,true);
+
         // print verbose error messages: useful during debug/tests
         verbose = VERBOSE;
         arm_right->setVerbosity(VERBOSE);
@@ -144,6 +365,27 @@ public:
     Vector Pose_ArmLeftArmRight(bool axisRep = false)   { return computePose(3,JAC_IKIN,0,JAC_KIN, axisRep); }
     Vector Pose_ArmRightArmLeft(bool axisRep = false)   { return computePose(0,JAC_IKIN,3,JAC_KIN, axisRep); }
 
+    // the same couples served from the cache, which follows
+    // the joints angles of the limbs by itself
+
+    Matrix CachedJacobian_TorsoArmRight()     {   return cache.computeJacobian(1,0);   }
+    Matrix CachedJacobian_TorsoArmLeft()      {   return cache.computeJacobian(1,3);   }
+    Matrix CachedJacobian_TorsoHead()         {   return cache.computeJacobian(1,2);   }
+    Matrix CachedJacobian_HeadArmRight()      {   return cache.computeJacobian(2,0);   }
+    Matrix CachedJacobian_HeadArmLeft()       {   return cache.computeJacobian(2,3);   }
+    Matrix CachedJacobian_HeadTorso()         {   return cache.computeJacobian(2,1);   }
+    Matrix CachedJacobian_ArmLeftArmRight()   {   return cache.computeJacobian(3,0);   }
+    Matrix CachedJacobian_ArmRightArmLeft()   {   return cache.computeJacobian(0,3);   }
+
+    Vector CachedPose_TorsoArmRight(bool axisRep = false)     { return cache.computePose(1,0,axisRep); }
+    Vector CachedPose_TorsoArmLeft(bool axisRep = false)      { return cache.computePose(1,3,axisRep); }
+    Vector CachedPose_HeadArmRight(bool axisRep = false)      { return cache.computePose(2,0,axisRep); }
+    Vector CachedPose_HeadArmLeft(bool axisRep = false)       { return cache.computePose(2,3,axisRep); }
+    Vector CachedPose_TorsoHead(bool axisRep = false)         { return cache.computePose(1,2,axisRep); }
+    Vector CachedPose_HeadTorso(bool axisRep = false)         { return cache.computePose(2,1,axisRep); }
+    Vector CachedPose_ArmLeftArmRight(bool axisRep = false)   { return cache.computePose(3,0,axisRep); }
+    Vector CachedPose_ArmRightArmLeft(bool axisRep = false)   { return cache.computePose(0,3,axisRep); }
+
     // generic print method
     string toString() { return info; }
 };
@@ -168,14 +410,525 @@ void printVector(const string &s, const Vector &v)
 }
 
 
+// the largest absolute difference between two matrices
+double maxAbsDiff(const Matrix &a, const Matrix &b)
+{
+    if ((a.rows()!=b.rows()) || (a.cols()!=b.cols()))
+        return HUGE_VAL;
+
+    double d=0.0;
+    for(int i=0;i<a.rows();i++)
+        for(int j=0;j<a.cols();j++)
+            d=std::max(d,fabs(a(i,j)-b(i,j)));
+    return d;
+}
+
+// query all the couples at each control tick, first through iDynNode and then through the cache;
+// then check that the two ways agree on every sample, as for the whole pose and every column of
+// the Jacobians
+int benchmark(UpTorso &node, const int ticks)
+{
+    iDynLimb *limbs[4]={node.arm_right,node.torso,node.head,node.arm_left};
+
+    // the joints angles are changed at each tick, as if read from the encoders,
+    // drawn over the whole range of the joints
+    vector<vector<Vector>> q(ticks,vector<Vector>(4));
+    for (int t=0; t<ticks; t++)
+    {
+        for (int i=0; i<4; i++)
+        {
+            iKinChain &chain=*limbs[i]->asChain();
+            q[t][i].resize(chain.getN());
+            for (unsigned int j=0; j<chain.getN(); j++)
+                q[t][i][j]=Rand::scalar(chain[j].getMin(),chain[j].getMax());
+        }
+    }
+
+    Matrix J; Vector pose;
+
+    double t0=SystemClock::nowSystem();
+    for (int t=0; t<ticks; t++)
+    {
+        for (int i=0; i<4; i++)
+            limbs[i]->setAng(q[t][i]);
+
+        J=node.Jacobian_TorsoArmRight();      pose=node.Pose_TorsoArmRight();
+        J=node.Jacobian_TorsoArmLeft();       pose=node.Pose_TorsoArmLeft();
+        J=node.Jacobian_TorsoHead();          pose=node.Pose_TorsoHead();
+        J=node.Jacobian_HeadArmRight();       pose=node.Pose_HeadArmRight();
+        J=node.Jacobian_HeadArmLeft();        pose=node.Pose_HeadArmLeft();
+        J=node.Jacobian_HeadTorso();          pose=node.Pose_HeadTorso();
+        J=node.Jacobian_ArmLeftArmRight();    pose=node.Pose_ArmLeftArmRight();
+        J=node.Jacobian_ArmRightArmLeft();    pose=node.Pose_ArmRightArmLeft();
+    }
+    double dt_node=SystemClock::nowSystem()-t0;
+
+    t0=SystemClock::nowSystem();
+    for (int t=0; t<ticks; t++)
+    {
+        for (int i=0; i<4; i++)
+            limbs[i]->setAng(q[t][i]);
+
+        J=node.CachedJacobian_TorsoArmRight();      pose=node.CachedPose_TorsoArmRight();
+        J=node.CachedJacobian_TorsoArmLeft();       pose=node.CachedPose_TorsoArmLeft();
+        J=node.CachedJacobian_TorsoHead();          pose=node.CachedPose_TorsoHead();
+        J=node.CachedJacobian_HeadArmRight();       pose=node.CachedPose_HeadArmRight();
+        J=node.CachedJacobian_HeadArmLeft();        pose=node.CachedPose_HeadArmLeft();
+        J=node.CachedJacobian_HeadTorso();          pose=node.CachedPose_HeadTorso();
+        J=node.CachedJacobian_ArmLeftArmRight();    pose=node.CachedPose_ArmLeftArmRight();
+        J=node.CachedJacobian_ArmRightArmLeft();    pose=node.CachedPose_ArmRightArmLeft();
+    }
+    double dt_cache=SystemClock::nowSystem()-t0;
+
+    // the orientations are compared as rotation matrices,
+    // which are not affected by the wrapping of the angles
+    Matrix (UpTorso::*jacobians[8][2])()=
+    {
+        {&UpTorso::Jacobian_TorsoArmRight,   &UpTorso::CachedJacobian_TorsoArmRight},
+        {&UpTorso::Jacobian_TorsoArmLeft,    &UpTorso::CachedJacobian_TorsoArmLeft},
+        {&UpTorso::Jacobian_TorsoHead,       &UpTorso::CachedJacobian_TorsoHead},
+        {&UpTorso::Jacobian_HeadArmRight,    &UpTorso::CachedJacobian_HeadArmRight},
+        {&UpTorso::Jacobian_HeadArmLeft,     &UpTorso::CachedJacobian_HeadArmLeft},
+        {&UpTorso::Jacobian_HeadTorso,       &UpTorso::CachedJacobian_HeadTorso},
+        {&UpTorso::Jacobian_ArmLeftArmRight, &UpTorso::CachedJacobian_ArmLeftArmRight},
+        {&UpTorso::Jacobian_ArmRightArmLeft, &UpTorso::CachedJacobian_ArmRightArmLeft}
+    };
+    Vector (UpTorso::*poses[8][2])(bool)=
+    {
+        {&UpTorso::Pose_TorsoArmRight,   &UpTorso::CachedPose_TorsoArmRight},
+        {&UpTorso::Pose_TorsoArmLeft,    &UpTorso::CachedPose_TorsoArmLeft},
+        {&UpTorso::Pose_TorsoHead,       &UpTorso::CachedPose_TorsoHead},
+        {&UpTorso::Pose_HeadArmRight,    &UpTorso::CachedPose_HeadArmRight},
+        {&UpTorso::Pose_HeadArmLeft,     &UpTorso::CachedPose_HeadArmLeft},
+        {&UpTorso::Pose_HeadTorso,       &UpTorso::CachedPose_HeadTorso},
+        {&UpTorso::Pose_ArmLeftArmRight, &UpTorso::CachedPose_ArmLeftArmRight},
+        {&UpTorso::Pose_ArmRightArmLeft, &UpTorso::CachedPose_ArmRightArmLeft}
+    };
+
+    // the comparison goes over the ticks twice: first with all the links released,
+    // then blocking about one link out of three at its angle, so that the blocked
+    // links are checked to have no column in the Jacobians of both the ways
+    // (the last link of each limb is never blocked, to keep at least one DOF)
+    double dev_J=0.0, dev_pos=0.0, dev_rot=0.0;
+    int nBlocked=0;
+    for (int pass=0; pass<2; pass++)
+    {
+        for (int t=0; t<ticks; t++)
+        {
+            for (int i=0; i<4; i++)
+            {
+                iKinChain &chain=*limbs[i]->asChain();
+                for (unsigned int j=0; j<chain.getN(); j++)
+                    if (chain[j].isBlocked())
+                        chain.releaseLink(j);
+
+                limbs[i]->setAng(q[t][i]);
+
+                if (pass>0)
+                {
+                    for (unsigned int j=0; j+1<chain.getN(); j++)
+                    {
+                        if (Rand::scalar()<1.0/3.0)
+                        {
+                            chain.blockLink(j,q[t][i][j]);
+                            nBlocked++;
+                        }
+                    }
+                }
+            }
+
+            for (int i=0; i<8; i++)
+            {
+                dev_J=std::max(dev_J,maxAbsDiff((node.*jacobians[i][0])(),(node.*jacobians[i][1])()));
+
+                Vector p1=(node.*poses[i][0])(true);
+                Vector p2=(node.*poses[i][1])(true);
+                dev_pos=std::max(dev_pos,norm(p1.subVector(0,2)-p2.subVector(0,2)));
+                dev_rot=std::max(dev_rot,maxAbsDiff(yarp::math::axis2dcm(p1.subVector(3,6)),
+                                                       yarp::math::axis2dcm(p2.subVector(3,6))));
+            }
+        }
+    }
+
+    // the node is left with all the links released
+    for (int i=0; i<4; i++)
+    {
+        iKinChain &chain=*limbs[i]->asChain();
+        for (unsigned int j=0; j<chain.getN(); j++)
+            if (chain[j].isBlocked())
+                chain.releaseLink(j);
+    }
+
+    const double tol=1e-9;
+    bool ok=(dev_J<tol) && (dev_pos<tol) && (dev_rot<tol);
+
+    cout<<endl<<"all the 8 couples queried over "<<ticks<<" ticks"<<endl;
+    cout<<"  iDynNode: "<<1e6*dt_node/ticks<<" [us/tick]"<<endl;
+    cout<<"  cache:    "<<1e6*dt_cache/ticks<<" [us/tick]"<<endl;
+    cout<<"  compared with all the links released and then with "<<nBlocked<<" links blocked at random"<<endl;
+    cout<<"  max deviation over all the ticks: Jacobian "<<dev_J<<", position "<<dev_pos
+        <<" [m], rotation "<<dev_rot<<(ok ? " [ok]" : " [FAILED]")<<endl<<endl;
+
+    return (ok ? 0 : 1);
+}
+
+
+// the couples available in batch mode, numbered as in the interactive menu
+struct Couple
+{
+    Matrix (UpTorso::*jacobian)();
+    Vector (UpTorso::*pose)(bool);
+    Matrix (UpTorso::*cachedJacobian)();
+    Vector (UpTorso::*cachedPose)(bool);
+    int limbA, limbB;
+};
+
+const Couple couples[8]=
+{
+    {&UpTorso::Jacobian_TorsoArmRight,   &UpTorso::Pose_TorsoArmRight,   &UpTorso::CachedJacobian_TorsoArmRight,   &UpTorso::CachedPose_TorsoArmRight,   1,0},
+    {&UpTorso::Jacobian_TorsoArmLeft,    &UpTorso::Pose_TorsoArmLeft,    &UpTorso::CachedJacobian_TorsoArmLeft,    &UpTorso::CachedPose_TorsoArmLeft,    1,3},
+    {&UpTorso::Jacobian_TorsoHead,       &UpTorso::Pose_TorsoHead,       &UpTorso::CachedJacobian_TorsoHead,       &UpTorso::CachedPose_TorsoHead,       1,2},
+    {&UpTorso::Jacobian_HeadArmRight,    &UpTorso::Pose_HeadArmRight,    &UpTorso::CachedJacobian_HeadArmRight,    &UpTorso::CachedPose_HeadArmRight,    2,0},
+    {&UpTorso::Jacobian_HeadArmLeft,     &UpTorso::Pose_HeadArmLeft,     &UpTorso::CachedJacobian_HeadArmLeft,     &UpTorso::CachedPose_HeadArmLeft,     2,3},
+    {&UpTorso::Jacobian_HeadTorso,       &UpTorso::Pose_HeadTorso,       &UpTorso::CachedJacobian_HeadTorso,       &UpTorso::CachedPose_HeadTorso,       2,1},
+    {&UpTorso::Jacobian_ArmLeftArmRight, &UpTorso::Pose_ArmLeftArmRight, &UpTorso::CachedJacobian_ArmLeftArmRight, &UpTorso::CachedPose_ArmLeftArmRight, 3,0},
+    {&UpTorso::Jacobian_ArmRightArmLeft, &UpTorso::Pose_ArmRightArmLeft, &UpTorso::CachedJacobian_ArmRightArmLeft, &UpTorso::CachedPose_ArmRightArmLeft, 0,3}
+};
+
+// the limbs of the node, in the order they have been added
+iDynLimb *getLimb(UpTorso &node, const int i)
+{
+    iDynLimb *limbs[4]={node.arm_right,node.torso,node.head,node.arm_left};
+    return limbs[i];
+}
+
+// parse one sample made up of the four lists of joints angles [deg]:
+// (right_arm ...) (torso ...) (head ...) (left_arm ...)
+// missing angles are set to zero
+bool parseSample(UpTorso &node, const Bottle &b, vector<Vector> &q)
+{
+    if (b.size()<4)
+        return false;
+
+    q.resize(4);
+    for (int i=0; i<4; i++)
+    {
+        Bottle *l=b.get(i).asList();
+        if (l==NULL)
+            return false;
+
+        q[i].resize(getLimb(node,i)->getN(),0.0);
+        for (size_t j=0; j<std::min(q[i].length(),l->size()); j++)
+            q[i][j]=CTRL_DEG2RAD*l->get(j).asFloat64();
+    }
+
+    return true;
+}
+
+// set by ctrl+c to end the batch mode
+atomic<bool> interrupted(false);
+void onSignal(int) { interrupted=true; }
+
+// evaluate the requested couples over a stream of joints states
+//
+// options:
+// --in file:     the joints states are read from a text file, one sample per line
+// --port name:   the joints states are read from the port name (e.g. /multiLimbJacobian/q:i)
+// --out file:    the binary output file (default: multiLimbJacobian.bin)
+// --couples "(1 2 ...)": the couples to evaluate, numbered as in the menu (default: all)
+// --threads n:   the number of threads the samples are spread over (default: all the cores)
+// --block n:     the number of samples processed at once (default: 1000)
+// --cache:       evaluate the couples through the kinematic cache
+// --samples n:   stop after n samples (default: 0, i.e. at the end of the stream)
+// --duration s:  stop after s seconds (default: 0, i.e. at the end of the stream)
+//
+// the port stream has no end, hence the run is ended by the limits above or by ctrl+c,
+// and the report is printed in any case
+//
+// output format (native endianness):
+// header:  char[8] "MLJACB" | int32 version (1) | int32 number of couples C |
+//          C x (int32 couple id, int32 number of Jacobian columns)
+// samples: for each sample and each couple, the pose (6 doubles, see Pose_*)
+//          followed by the Jacobian (6 x columns doubles, row-major)
+int batchMode(int argc, char *argv[])
+{
+    ResourceFinder rf;
+    rf.configure(argc,argv);
+
+    vector<int> ids;
+    if (Bottle *b=rf.find("couples").asList())
+    {
+        for (size_t i=0; i<b->size(); i++)
+        {
+            int id=b->get(i).asInt32();
+            if ((id<1) || (id>8))
+            {
+                cout<<"invalid couple "<<id<<endl;
+                return 1;
+            }
+            ids.push_back(id);
+        }
+    }
+    else
+        for (int id=1; id<=8; id++)
+            ids.push_back(id);
+
+    unsigned int nThreads=std::max(1U,thread::hardware_concurrency());
+    nThreads=(unsigned int)std::max(1,rf.check("threads",Value((int)nThreads)).asInt32());
+    size_t block=(size_t)std::max(1,rf.check("block",Value(1000)).asInt32());
+    size_t maxSamples=(size_t)std::max(0,rf.check("samples",Value(0)).asInt32());
+    double duration=rf.check("duration",Value(0.0)).asFloat64();
+    bool useCache=rf.check("cache");
+
+    // one node per thread, since the limbs hold the joints state
+    vector<unique_ptr<UpTorso>> nodes;
+    for (unsigned int i=0; i<nThreads; i++)
+        nodes.push_back(unique_ptr<UpTorso>(new UpTorso));
+
+    // the size of the results of one sample
+    vector<int> cols;
+    size_t sampleSize=0;
+    for (auto id : ids)
+    {
+        const Couple &c=couples[id-1];
+        cols.push_back(getLimb(*nodes[0],c.limbA)->getDOF()+getLimb(*nodes[0],c.limbB)->getDOF());
+        sampleSize+=6+6*cols.back();
+    }
+
+    string outName=rf.check("out",Value("multiLimbJacobian.bin")).asString();
+    ofstream out(outName.c_str(),ios::binary);
+    if (!out.is_open())
+    {
+        cout<<"unable to open "<<outName<<endl;
+        return 1;
+    }
+
+    char magic[8]={'M','L','J','A','C','B',0,0};
+    int32_t header[2]={1,(int32_t)ids.size()};
+    out.write(magic,sizeof(magic));
+    out.write((const char*)header,sizeof(header));
+    for (size_t i=0; i<ids.size(); i++)
+    {
+        int32_t entry[2]={ids[i],cols[i]};
+        out.write((const char*)entry,sizeof(entry));
+    }
+
+    // the input source
+    unique_ptr<Network> network;
+    BufferedPort<Bottle> port;
+    ifstream in;
+    bool fromPort=rf.check("port");
+    if (fromPort)
+    {
+        network=unique_ptr<Network>(new Network);
+        if (!port.open(rf.find("port").asString()))
+            return 1;
+        port.setStrict();
+    }
+    else if (rf.check("in"))
+    {
+        in.open(rf.find("in").asString().c_str());
+        if (!in.is_open())
+        {
+            cout<<"unable to open "<<rf.find("in").asString()<<endl;
+            return 1;
+        }
+    }
+    else
+    {
+        cout<<"either --in or --port is required"<<endl;
+        return 1;
+    }
+
+    signal(SIGINT,onSignal);
+    signal(SIGTERM,onSignal);
+
+    size_t total=0;
+    double t0=SystemClock::nowSystem();
+    auto expired=[&]()
+    {
+        return interrupted || ((duration>0.0) && (SystemClock::nowSystem()-t0>=duration));
+    };
+
+    // fill a block of samples from the input source, returning false at the end of the stream
+    auto fill=[&](vector<vector<Vector>> &samples)
+    {
+        samples.clear();
+        while (samples.size()<block)
+        {
+            if (((maxSamples>0) && (total+samples.size()>=maxSamples)) || expired())
+                return !samples.empty();
+
+            Bottle b;
+            if (!fromPort)
+            {
+                string line;
+                if (!getline(in,line))
+                    return !samples.empty();
+                if (line.empty())
+                    continue;
+                b.fromString(line);
+            }
+            else
+            {
+                // the port is polled so as to check the limits
+                // while waiting; a partial block is processed
+                // as soon as the stream pauses
+                Bottle *p=port.read(false);
+                if (p==NULL)
+                {
+                    if (!samples.empty())
+                        return true;
+                    SystemClock::delaySystem(0.001);
+                    continue;
+                }
+                b=*p;
+            }
+
+            vector<Vector> q;
+            if (parseSample(*nodes[0],b,q))
+                samples.push_back(q);
+            else
+                cout<<"skipping malformed sample: "<<b.toString()<<endl;
+        }
+        return true;
+    };
+
+    vector<vector<Vector>> samples;
+    vector<double> results;
+    double t_compute=0.0;
+    atomic<bool> mismatch(false);
+
+    // the workers are launched once and then woken up at each block,
+    // whose samples are split evenly among them
+    mutex mtx;
+    condition_variable cvStart,cvDone;
+    size_t generation=0;
+    unsigned int pending=0;
+    bool quit=false;
+
+    auto work=[&](const unsigned int w)
+    {
+        UpTorso &node=*nodes[w];
+        for (size_t k=w; k<samples.size(); k+=nThreads)
+        {
+            for (int i=0; i<4; i++)
+                getLimb(node,i)->setAng(samples[k][i]);
+
+            double *ptr=&results[k*sampleSize];
+            for (size_t i=0; i<ids.size(); i++)
+            {
+                const Couple &c=couples[ids[i]-1];
+                Vector pose=useCache ? (node.*c.cachedPose)(false) : (node.*c.pose)(false);
+                Matrix J=useCache ? (node.*c.cachedJacobian)() : (node.*c.jacobian)();
+
+                // the layout is the one declared in the header
+                if ((pose.length()!=6) || (J.rows()!=6) || (J.cols()!=cols[i]))
+                {
+                    mismatch=true;
+                    return;
+                }
+
+                for (size_t j=0; j<6; j++)
+                    *ptr++=pose[j];
+                for (int r=0; r<J.rows(); r++)
+                    for (int col=0; col<J.cols(); col++)
+                        *ptr++=J(r,col);
+            }
+        }
+    };
+
+    vector<thread> workers;
+    for (unsigned int w=0; w<nThreads; w++)
+    {
+        workers.push_back(thread([&,w]()
+        {
+            size_t done=0;
+            while (true)
+            {
+                {
+                    unique_lock<mutex> lck(mtx);
+                    cvStart.wait(lck,[&](){ return quit || (generation!=done); });
+                    if (quit)
+                        return;
+                    done=generation;
+                }
+
+                work(w);
+
+                lock_guard<mutex> lg(mtx);
+                if (--pending==0)
+                    cvDone.notify_all();
+            }
+        }));
+    }
+
+    while (!mismatch && fill(samples))
+    {
+        results.resize(samples.size()*sampleSize);
+
+        double t1=SystemClock::nowSystem();
+        {
+            unique_lock<mutex> lck(mtx);
+            pending=nThreads;
+            generation++;
+            cvStart.notify_all();
+            cvDone.wait(lck,[&](){ return (pending==0); });
+        }
+        t_compute+=SystemClock::nowSystem()-t1;
+
+        if (mismatch)
+            break;
+
+        out.write((const char*)results.data(),results.size()*sizeof(double));
+        total+=samples.size();
+    }
+
+    {
+        lock_guard<mutex> lg(mtx);
+        quit=true;
+    }
+    cvStart.notify_all();
+    for (auto &w : workers)
+        w.join();
+
+    if (fromPort)
+        port.close();
+
+    double dt=SystemClock::nowSystem()-t0;
+    cout<<total<<" samples x "<<ids.size()<<" couples evaluated with "<<nThreads<<" threads"
+        <<(interrupted ? " (interrupted)" : "")<<endl;
+    if (total>0)
+    {
+        cout<<"  throughput: "<<total/dt<<" [samples/s] overall, "
+            <<total/t_compute<<" [samples/s] computation only"<<endl;
+        cout<<"  results written to "<<outName<<endl;
+    }
+
+    if (mismatch)
+    {
+        cout<<"the size of a result does not match the header, output truncated"<<endl;
+        return 1;
+    }
+
+    return 0;
+}
+
+
 /////////////////
 //    MAIN     //
 /////////////////
-int main()
+int main(int argc, char *argv[])
 {    
+    if ((argc>1) && (strcmp(argv[1],"--batch")==0))
+        return batchMode(argc,argv);
+
     // we create the node with arm and torso
     UpTorso node;
 
+    if ((argc>1) && (strcmp(argv[1],"--benchmark")==0))
+        return benchmark(node,(argc>2) ? std::max(1,atoi(argv[2])) : 10000);
+
     cout<<endl<<"Node <"<<node.toString()<<"> created"<<endl;
     
     // now we set the joint angles for the two limbs
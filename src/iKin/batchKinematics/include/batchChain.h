@@ -0,0 +1,315 @@
+/*
+ * Copyright (C) 2019 Fondazione Istituto Italiano di Tecnologia (IIT)
+ * All Rights Reserved.
+ * Authors: Ugo Pattacini <ugo.pattacini@iit.it>
+ */
+
+#ifndef __BATCHCHAIN_H__
+#define __BATCHCHAIN_H__
+
+#include <cmath>
+#include <cstddef>
+#include <algorithm>
+#include <vector>
+
+#include <yarp/sig/Matrix.h>
+#include <iCub/iKin/iKinFwd.h>
+
+#include <fixedChain.h>
+
+/**
+ * This class computes the forward kinematics and the geometric
+ * Jacobian of a serial chain for a batch of B configurations at
+ * once. Data are arranged as structure of arrays, i.e. the B
+ * values of each quantity are contiguous, so that the inner loops
+ * run over the batch and can be vectorized by the compiler.
+ * All the links of the chain are considered as released.
+ *
+ * The sines and cosines of the joints are not computed through
+ * the libm calls, which the compiler cannot vectorize, but through
+ * the branch-free polynomial sinCos(); the build enables the loop
+ * vectorizer with the dynamic cost model for this purpose (GCC).
+ */
+class BatchChain
+{
+protected:
+    std::vector<DHLink> links;
+    std::vector<bool> active;
+    Mat4 H0;
+    Mat4 HN;
+
+    // the 3x4 upper part of the current transformation,
+    // plus z-axes and origins of the links frames
+    std::vector<double> T,Tn,c,s;
+    std::vector<double> z,p;
+    std::vector<double> Jp,A;
+    size_t batchSize;
+
+    /**********************************************************/
+    static inline void sinCos(const double x, double &s, double &c)
+    {
+        // reduction to r in [-pi/4,pi/4] around the nearest
+        // multiple y of pi/2, with pi/2 split into three parts
+        // (Cody-Waite); the rounding relies on the 2^52+2^51
+        // trick, which does not survive -ffast-math
+        const double y=(x*0.63661977236758134308+6755399441055744.0)-6755399441055744.0;
+        const double r=((x-y*1.57079625129699707031)-y*7.54978941586159635335e-8)-
+                       y*5.39030285815811905290e-15;
+        const int q=(int)y;
+
+        // minimax polynomials (Cephes) accurate
+        // to about 1 ulp over [-pi/4,pi/4]
+        const double r2=r*r;
+        const double ps=r+r*r2*(((((1.58962301576546568060e-10*r2-2.50507477628578072866e-8)*r2+
+                        2.75573136213857245213e-6)*r2-1.98412698295895385996e-4)*r2+
+                        8.33333333332211858878e-3)*r2-1.66666666666666307295e-1);
+        const double pc=1.0-0.5*r2+r2*r2*(((((-1.13585365213876817300e-11*r2+2.08757008419747316778e-9)*r2-
+                        2.75573141792967388112e-7)*r2+2.48015872888517045348e-5)*r2-
+                        1.38888888888730564116e-3)*r2+4.16666666666665929218e-2);
+
+        // the quadrant selects and signs the results
+        const double ss=(q&1)?pc:ps;
+        const double cc=(q&1)?ps:pc;
+        s=(q&2)?-ss:ss;
+        c=((q+1)&2)?-cc:cc;
+    }
+
+    /**********************************************************/
+    void resize(const size_t B)
+    {
+        // shrinking keeps the capacity, hence the buffers
+        // are allocated only as the batch size grows
+        size_t N=links.size();
+        batchSize=B;
+        T.resize(12*B); Tn.resize(12*B);
+        c.resize(B); s.resize(B);
+        z.resize(3*N*B); p.resize(3*N*B);
+        Jp.resize(6*N*B); A.resize(6*B);
+    }
+
+public:
+    /**
+     * Constructor. 
+     * @param chain the iKinChain whose kinematics is replicated.
+     * @param B the batch size the buffers are allocated for; 
+     *          compute() with larger batches reallocates them.
+     */
+    BatchChain(iCub::iKin::iKinChain &chain, const size_t B=0) : batchSize(0)
+    {
+        for (unsigned int i=0; i<chain.getN(); i++)
+        {
+            iCub::iKin::iKinLink &l=chain[i];
+            links.push_back(DHLink{l.getA(),l.getD(),l.getAlpha(),l.getOffset(),
+                                   l.getMin(),l.getMax()});
+            active.push_back(true);
+        }
+
+        const yarp::sig::Matrix &h0=chain.getH0();
+        const yarp::sig::Matrix &hn=chain.getHN();
+        for (int r=0; r<4; r++)
+        {
+            for (int k=0; k<4; k++)
+            {
+                H0.m[r][k]=h0(r,k);
+                HN.m[r][k]=hn(r,k);
+            }
+        }
+
+        resize(B);
+    }
+
+    /**
+     * Return the number of links.
+     */
+    size_t getN() const { return links.size(); }
+
+    /**
+     * Return the i-th link.
+     */
+    const DHLink &operator()(const size_t i) const { return links[i]; }
+
+    /**
+     * Tell whether the i-th link contributes to the manipulability 
+     * (all the links do by default). 
+     * @param i the link.
+     * @param act true iff its column of the Jacobian is accounted.
+     */
+    void setActive(const size_t i, const bool act) { active[i]=act; }
+
+    /**
+     * Return the k-th component of the end-effector positions 
+     * computed by the last call to compute(). 
+     * @param k the component (0=x, 1=y, 2=z).
+     * @return the pointer to the B values.
+     */
+    const double *getPosition(const int k) const { return &T[(4*k+3)*batchSize]; }
+
+    /**
+     * Compute forward kinematics, geometric Jacobian and 
+     * manipulability for a batch of configurations. 
+     * @param B the batch size.
+     * @param q the N*B joints values [rad], where q[i*B+b] is the 
+     *          i-th joint of the b-th configuration.
+     * @param x the 7*B end-effector poses [x y z ax ay az theta], 
+     *          where x[k*B+b] is the k-th component of the b-th
+     *          pose; it can be NULL.
+     * @param J the 6*N*B Jacobians, where J[(r*N+i)*B+b] is the 
+     *          element (r,i) of the b-th Jacobian; it can be NULL.
+     * @param m the B translational manipulability indexes 
+     *          sqrt(det(Jp*Jp')), where Jp is made up of the
+     *          columns of the active links only; it can be NULL.
+     */
+    void compute(const size_t B, const double *q, double *x, double *J=NULL,
+                 double *m=NULL)
+    {
+        const size_t N=links.size();
+        resize(B);
+
+        for (int r=0; r<3; r++)
+            for (int k=0; k<4; k++)
+                for (size_t b=0; b<B; b++)
+                    T[(4*r+k)*B+b]=H0.m[r][k];
+
+        for (size_t i=0; i<N; i++)
+        {
+            const DHLink &l=links[i];
+            const double ca=cos(l.alpha);
+            const double sa=sin(l.alpha);
+            const double *qi=&q[i*B];
+
+            // store the z-axis and the origin of the i-th frame
+            for (int r=0; r<3; r++)
+            {
+                double *zi=&z[(3*i+r)*B];
+                double *pi=&p[(3*i+r)*B];
+                const double *Tz=&T[(4*r+2)*B];
+                const double *Tp=&T[(4*r+3)*B];
+                for (size_t b=0; b<B; b++)
+                {
+                    zi[b]=Tz[b];
+                    pi[b]=Tp[b];
+                }
+            }
+
+            for (size_t b=0; b<B; b++)
+                sinCos(qi[b]+l.offset,s[b],c[b]);
+
+            // T=T*H_i, row by row
+            for (int r=0; r<3; r++)
+            {
+                const double *T0=&T[(4*r+0)*B];
+                const double *T1=&T[(4*r+1)*B];
+                const double *T2=&T[(4*r+2)*B];
+                const double *T3=&T[(4*r+3)*B];
+                double *Tn0=&Tn[(4*r+0)*B];
+                double *Tn1=&Tn[(4*r+1)*B];
+                double *Tn2=&Tn[(4*r+2)*B];
+                double *Tn3=&Tn[(4*r+3)*B];
+                for (size_t b=0; b<B; b++)
+                {
+                    Tn0[b]=T0[b]*c[b]+T1[b]*s[b];
+                    Tn1[b]=(-T0[b]*s[b]+T1[b]*c[b])*ca+T2[b]*sa;
+                    Tn2[b]=(T0[b]*s[b]-T1[b]*c[b])*sa+T2[b]*ca;
+                    Tn3[b]=(T0[b]*c[b]+T1[b]*s[b])*l.A+T2[b]*l.D+T3[b];
+                }
+            }
+
+            T.swap(Tn);
+        }
+
+        // append HN
+        for (int r=0; r<3; r++)
+        {
+            for (int k=0; k<4; k++)
+            {
+                double *Tnk=&Tn[(4*r+k)*B];
+                for (size_t b=0; b<B; b++)
+                {
+                    Tnk[b]=T[(4*r+0)*B+b]*HN.m[0][k]+T[(4*r+1)*B+b]*HN.m[1][k]+
+                           T[(4*r+2)*B+b]*HN.m[2][k];
+                    if (k==3)
+                        Tnk[b]+=T[(4*r+3)*B+b];
+                }
+            }
+        }
+        T.swap(Tn);
+
+        if (x!=NULL)
+        {
+            // the conversion to axis-angle is branchy,
+            // hence it is carried out sample by sample
+            for (size_t b=0; b<B; b++)
+            {
+                Mat4 H=Mat4::eye();
+                for (int r=0; r<3; r++)
+                    for (int k=0; k<4; k++)
+                        H.m[r][k]=T[(4*r+k)*B+b];
+
+                double xb[7];
+                toPose(H,xb);
+                for (int k=0; k<7; k++)
+                    x[k*B+b]=xb[k];
+            }
+        }
+
+        if ((J!=NULL) || (m!=NULL))
+        {
+            double *Jb=(J!=NULL)?J:Jp.data();
+
+            const double *pE[3]={&T[3*B],&T[7*B],&T[11*B]};
+            for (size_t i=0; i<N; i++)
+            {
+                const double *zx=&z[(3*i+0)*B], *zy=&z[(3*i+1)*B], *zz=&z[(3*i+2)*B];
+                const double *px=&p[(3*i+0)*B], *py=&p[(3*i+1)*B], *pz=&p[(3*i+2)*B];
+                double *J0=&Jb[(0*N+i)*B], *J1=&Jb[(1*N+i)*B], *J2=&Jb[(2*N+i)*B];
+                double *J3=&Jb[(3*N+i)*B], *J4=&Jb[(4*N+i)*B], *J5=&Jb[(5*N+i)*B];
+                for (size_t b=0; b<B; b++)
+                {
+                    const double dx=pE[0][b]-px[b];
+                    const double dy=pE[1][b]-py[b];
+                    const double dz=pE[2][b]-pz[b];
+                    J0[b]=zy[b]*dz-zz[b]*dy;
+                    J1[b]=zz[b]*dx-zx[b]*dz;
+                    J2[b]=zx[b]*dy-zy[b]*dx;
+                    J3[b]=zx[b];
+                    J4[b]=zy[b];
+                    J5[b]=zz[b];
+                }
+            }
+
+            if (m!=NULL)
+            {
+                // accumulate the symmetric matrix A=Jp*Jp'
+                std::fill(A.begin(),A.end(),0.0);
+                double *a00=&A[0], *a01=&A[B], *a02=&A[2*B];
+                double *a11=&A[3*B], *a12=&A[4*B], *a22=&A[5*B];
+                for (size_t i=0; i<N; i++)
+                {
+                    if (!active[i])
+                        continue;
+
+                    const double *J0=&Jb[(0*N+i)*B];
+                    const double *J1=&Jb[(1*N+i)*B];
+                    const double *J2=&Jb[(2*N+i)*B];
+                    for (size_t b=0; b<B; b++)
+                    {
+                        a00[b]+=J0[b]*J0[b]; a01[b]+=J0[b]*J1[b]; a02[b]+=J0[b]*J2[b];
+                        a11[b]+=J1[b]*J1[b]; a12[b]+=J1[b]*J2[b]; a22[b]+=J2[b]*J2[b];
+                    }
+                }
+
+                for (size_t b=0; b<B; b++)
+                {
+                    const double det=a00[b]*(a11[b]*a22[b]-a12[b]*a12[b])-
+                                     a01[b]*(a01[b]*a22[b]-a12[b]*a02[b])+
+                                     a02[b]*(a01[b]*a12[b]-a11[b]*a02[b]);
+                    m[b]=sqrt(std::max(0.0,det));
+                }
+            }
+        }
+    }
+};
+
+#endif
+
+
@@ -0,0 +1,183 @@
+/**
+ * @ingroup icub_tutorials
+ *
+ * \defgroup icub_batchKinematics Batched Forward Kinematics of 
+ *           iCub limbs
+ *
+ * A tutorial on how to evaluate forward kinematics, geometric 
+ * Jacobian and manipulability of iCub limbs for a large batch 
+ * of joints configurations at once. The results are checked 
+ * against iKinChain. 
+ *
+ * \author Ugo Pattacini
+ * 
+ * CopyPolicy: Released under the terms of GPL 2.0 or later
+ */
+
+#include <cstdlib>
+#include <memory>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+
+#include <yarp/os/all.h>
+#include <yarp/sig/all.h>
+#include <yarp/math/Math.h>
+#include <yarp/math/Rand.h>
+#include <iCub/iKin/iKinFwd.h>
+
+#include <batchChain.h>
+
+using namespace std;
+using namespace yarp::os;
+using namespace yarp::sig;
+using namespace yarp::math;
+using namespace iCub::iKin;
+
+/****************************************************************/
+bool check(const string &kinematics, const string &type, const size_t B,
+           const double tol)
+{
+    unique_ptr<iKinLimb> limb;
+    if (kinematics == "eye")
+    {
+        limb = unique_ptr<iKinLimb>(new iCubEye(type));
+    }
+    else if (kinematics == "arm")
+    {
+        limb = unique_ptr<iKinLimb>(new iCubArm(type));
+    }
+    else
+    {
+        limb = unique_ptr<iKinLimb>(new iCubLeg(type));
+    }
+
+    // as in iCubLimbsFwKin, all the links are released
+    iKinChain* chain = limb->asChain();
+    chain->setAllConstraints(false);
+    for (size_t i = 0; i < chain->getN(); i++)
+    {
+        chain->releaseLink(i);
+    }
+
+    BatchChain batch(*chain, B);
+    size_t N = batch.getN();
+
+    // draw the configurations within the joints bounds
+    vector<double> q(N * B);
+    for (size_t i = 0; i < N; i++)
+    {
+        for (size_t b = 0; b < B; b++)
+        {
+            q[i * B + b] = Rand::scalar(batch(i).min, batch(i).max);
+        }
+    }
+
+    vector<double> x(7 * B), J(6 * N * B), m(B);
+    double t = SystemClock::nowSystem();
+    batch.compute(B, q.data(), x.data(), J.data(), m.data());
+    double dt_batch = SystemClock::nowSystem() - t;
+
+    // compare against iKinChain sample by sample
+    double errPose = 0.0, errJac = 0.0, errManip = 0.0;
+    double dt_iKin = 0.0;
+    Vector qb(N);
+    for (size_t b = 0; b < B; b++)
+    {
+        for (size_t i = 0; i < N; i++)
+        {
+            qb[i] = q[i * B + b];
+        }
+
+        t = SystemClock::nowSystem();
+        chain->setAng(qb);
+        Vector xb = chain->EndEffPose();
+        Matrix Jb = chain->GeoJacobian();
+        dt_iKin += SystemClock::nowSystem() - t;
+
+        for (size_t k = 0; k < xb.length(); k++)
+        {
+            errPose = std::max(errPose, fabs(xb[k] - x[k * B + b]));
+        }
+        for (int r = 0; r < Jb.rows(); r++)
+        {
+            for (int c = 0; c < Jb.cols(); c++)
+            {
+                errJac = std::max(errJac, fabs(Jb(r, c) - J[(r * N + c) * B + b]));
+            }
+        }
+
+        Matrix Jp = Jb.submatrix(0, 2, 0, Jb.cols() - 1);
+        double manip = sqrt(std::max(0.0, det(Jp * Jp.transposed())));
+        errManip = std::max(errManip, fabs(manip - m[b]));
+    }
+
+    bool ok = (errPose < tol) && (errJac < tol) && (errManip < tol);
+
+    cout << "kinematics=\"" << kinematics << "/" << limb->getType() << "\" N=" << N << endl;
+    cout << "  max errors: pose=" << errPose << " jacobian=" << errJac
+         << " manipulability=" << errManip << (ok ? " [ok]" : " [FAILED]") << endl;
+    cout << "  iKinChain: " << 1e6 * dt_iKin / B << " [us]/sample; batch: "
+         << 1e6 * dt_batch / B << " [us]/sample (x" << dt_iKin / dt_batch << ")" << endl;
+
+    return ok;
+}
+
+/****************************************************************/
+int main(int argc, char *argv[])
+{
+    ResourceFinder rf;
+    rf.configure(argc, argv);
+    if (rf.check("help"))
+    {
+        cout << "Options:" << endl;
+        cout << "--kinematics eye|arm|leg (default: all)" << endl;
+        cout << "--type left|right|left_v2|... (default: left and right)" << endl;
+        cout << "--batch B (default: 10000)" << endl;
+        cout << "--tol tol (default: 1e-9)" << endl;
+        return EXIT_SUCCESS;
+    }
+
+    vector<string> kinematics = {"eye", "arm", "leg"};
+    vector<string> types = {"left", "right"};
+    if (rf.check("kinematics"))
+    {
+        kinematics = {rf.find("kinematics").asString()};
+    }
+    if (rf.check("type"))
+    {
+        types = {rf.find("type").asString()};
+    }
+
+    size_t B = (size_t)rf.check("batch", Value(10000)).asInt32();
+    double tol = rf.check("tol", Value(1e-9)).asFloat64();
+
+    for (auto &k : kinematics)
+    {
+        transform(k.begin(), k.end(), k.begin(), ::tolower);
+        if ((k != "eye") && (k != "arm") && (k != "leg"))
+        {
+            cerr << "unrecognized kinematics \"" << k << "\"" << endl;
+            return EXIT_FAILURE;
+        }
+    }
+    for (auto &t : types)
+    {
+        transform(t.begin(), t.end(), t.begin(), ::tolower);
+    }
+
+    Rand::init();
+
+    bool ok = true;
+    for (auto &k : kinematics)
+    {
+        for (auto &t : types)
+        {
+            ok &= check(k, t, B, tol);
+        }
+    }
+
+    return (ok ? EXIT_SUCCESS : EXIT_FAILURE);
+}
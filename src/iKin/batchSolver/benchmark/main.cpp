@@ -0,0 +1,116 @@
+/**
+ * @ingroup icub_tutorials
+ *
+ * \defgroup icub_batchSolverBenchmark Serialization Benchmark
+ *           for the Batch Solver
+ *
+ * Compare the cost of encoding and decoding batches of inverse
+ * kinematics requests and replies in Bottle format against the
+ * binary BatchPacket format. No robot nor network is needed.
+ *
+ * Options: --n (the number of entries per batch, 1000 by
+ * default) and --trials (the number of repetitions, 100 by
+ * default).
+ *
+ * \author Ugo Pattacini
+ *
+ * CopyPolicy: Released under the terms of GPL 2.0 or later
+ */
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <iomanip>
+
+#include <yarp/os/all.h>
+#include <yarp/sig/all.h>
+#include <yarp/math/Rand.h>
+
+#include <batchSolver.h>
+
+using namespace std;
+using namespace yarp::os;
+using namespace yarp::sig;
+using namespace yarp::math;
+
+/****************************************************************/
+template<class Encode, class Decode>
+double measure(const int trials, Encode encode, Decode decode)
+{
+    double t0=SystemClock::nowSystem();
+    for (int i=0; i<trials; i++)
+    {
+        encode();
+        decode();
+    }
+    return 1e3*(SystemClock::nowSystem()-t0)/trials;
+}
+
+/****************************************************************/
+int main(int argc, char *argv[])
+{
+    Network yarp;
+
+    ResourceFinder rf;
+    rf.configure(argc,argv);
+    int n=rf.check("n",Value(1000)).asInt32();
+    int trials=rf.check("trials",Value(100)).asInt32();
+
+    vector<BatchRequest> requests(n);
+    vector<BatchResult> results(n);
+    for (int i=0; i<n; i++)
+    {
+        requests[i].xd=Rand::vector(Vector(7,-1.0),Vector(7,1.0));
+        requests[i].dof=Vector(10,1.0);
+        requests[i].q=Rand::vector(Vector(10,-90.0),Vector(10,90.0));
+
+        results[i].xd=requests[i].xd;
+        results[i].x=Rand::vector(Vector(7,-1.0),Vector(7,1.0));
+        results[i].q=requests[i].q;
+    }
+
+    // Bottle: from the structures to the wire and back
+    Bottle bottleOut,bottleIn;
+    vector<BatchRequest> requestsIn;
+    vector<BatchResult> resultsIn;
+
+    double bottleReq=measure(trials,[&](){
+        BatchSolver::toBottle(requests,bottleOut);
+        Portable::copyPortable(bottleOut,bottleIn);
+    },[&](){ BatchSolver::fromBottle(bottleIn,requestsIn); });
+    size_t bottleReqSize;
+    bottleIn.toBinary(&bottleReqSize);
+
+    double bottleRep=measure(trials,[&](){
+        BatchSolver::toBottle(results,bottleOut);
+        Portable::copyPortable(bottleOut,bottleIn);
+    },[&](){ BatchSolver::fromBottle(bottleIn,resultsIn); });
+    size_t bottleRepSize;
+    bottleIn.toBinary(&bottleRepSize);
+
+    // BatchPacket: same round-trip
+    BatchPacket packetOut,packetIn;
+
+    double packetReq=measure(trials,[&](){
+        packetOut.fromRequests(requests);
+        Portable::copyPortable(packetOut,packetIn);
+    },[&](){ packetIn.toRequests(requestsIn); });
+    size_t packetReqSize=sizeof(int32_t)*5+sizeof(double)*packetIn.data.size();
+
+    double packetRep=measure(trials,[&](){
+        packetOut.fromResults(results);
+        Portable::copyPortable(packetOut,packetIn);
+    },[&](){ packetIn.toResults(resultsIn); });
+    size_t packetRepSize=sizeof(int32_t)*5+sizeof(double)*packetIn.data.size();
+
+    cout<<"batch of "<<n<<" entries, "<<trials<<" trials"<<endl;
+    cout<<setw(10)<<"format"<<setw(16)<<"request [ms]"<<setw(16)<<"request [B]"
+        <<setw(16)<<"reply [ms]"<<setw(16)<<"reply [B]"<<endl;
+    cout<<setw(10)<<"bottle"<<setw(16)<<bottleReq<<setw(16)<<bottleReqSize
+        <<setw(16)<<bottleRep<<setw(16)<<bottleRepSize<<endl;
+    cout<<setw(10)<<"binary"<<setw(16)<<packetReq<<setw(16)<<packetReqSize
+        <<setw(16)<<packetRep<<setw(16)<<packetRepSize<<endl;
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,330 @@
+/*
+ * Copyright (C) 2019 Fondazione Istituto Italiano di Tecnologia (IIT)
+ * All Rights Reserved.
+ * Authors: Ugo Pattacini <ugo.pattacini@iit.it>
+ */
+
+#ifndef __BATCHSOLVER_H__
+#define __BATCHSOLVER_H__
+
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <cstdint>
+#include <string>
+#include <deque>
+#include <vector>
+
+#include <yarp/os/all.h>
+#include <yarp/sig/all.h>
+
+#include <iCub/iKin/iKinFwd.h>
+#include <iCub/iKin/iKinIpOpt.h>
+
+#include <solverTelemetry.h>
+
+#define BATCHSLV_VOCAB_CMD_BATCH    yarp::os::createVocab32('b','a','t','c')
+#define BATCHSLV_VOCAB_CMD_FORMAT   yarp::os::createVocab32('f','m','t')
+#define BATCHSLV_VOCAB_VAL_BINARY   yarp::os::createVocab32('b','i','n')
+#define BATCHSLV_VOCAB_VAL_BOTTLE   yarp::os::createVocab32('b','o','t')
+
+#define BATCHSLV_PACKET_VERSION     1
+#define BATCHSLV_PACKET_MAX_N       100000
+#define BATCHSLV_PACKET_MAX_LEN     1024
+
+/**
+ * A fixed-size pool of threads executing jobs. Each job receives
+ * the id of the worker that runs it, so that per-worker resources
+ * can be accessed without locking.
+ */
+class WorkerPool
+{
+protected:
+    struct Job
+    {
+        std::function<void(const unsigned int)> exec;
+        size_t *pending;
+    };
+
+    std::vector<std::thread> workers;
+    std::deque<Job> jobs;
+    std::mutex mtx;
+    std::condition_variable cvJobs;
+    std::condition_variable cvDone;
+    bool closing;
+
+    void loop(const unsigned int id);
+
+public:
+    /**
+     * Constructor. 
+     * @param nThreads the number of workers.
+     */
+    WorkerPool(const unsigned int nThreads);
+
+    /**
+     * Destructor.
+     */
+    ~WorkerPool();
+
+    /**
+     * Return the number of workers.
+     */
+    unsigned int size() const { return (unsigned int)workers.size(); }
+
+    /**
+     * Execute the jobs and wait for their completion. Batches 
+     * coming from different threads are served concurrently. 
+     * @param batch the jobs to execute.
+     */
+    void run(const std::vector<std::function<void(const unsigned int)>> &batch);
+};
+
+/**
+ * A single inverse kinematics request: the target, the optional 
+ * dof mask and the optional initial joints configuration [deg]. 
+ */
+struct BatchRequest
+{
+    yarp::sig::Vector xd;
+    yarp::sig::Vector dof;
+    yarp::sig::Vector q;
+};
+
+/**
+ * A single inverse kinematics solution: the requested target,
+ * the achieved pose and the joints configuration [deg].
+ */
+struct BatchResult
+{
+    yarp::sig::Vector xd;
+    yarp::sig::Vector x;
+    yarp::sig::Vector q;
+};
+
+/**
+ * The fixed-layout binary counterpart of the Bottle messages 
+ * exchanged with the BatchSolver: a version header followed by
+ * n entries of three vectors of doubles, whose lengths are the
+ * same for all the entries. Requests carry (xd,dof,q), replies 
+ * carry (xd,x,q); unused vectors have zero length. Packets with
+ * more than BATCHSLV_PACKET_MAX_N entries or vectors longer than
+ * BATCHSLV_PACKET_MAX_LEN are rejected. 
+ */
+class BatchPacket : public yarp::os::Portable
+{
+public:
+    int32_t version;
+    int32_t n;
+    int32_t len[3];
+    std::vector<double> data;
+
+    BatchPacket();
+
+    /**
+     * Fill the packet with requests.
+     * @return false if the requests do not share the same lengths,
+     *         in which case the packet is left empty.
+     */
+    bool fromRequests(const std::vector<BatchRequest> &requests);
+
+    /**
+     * Retrieve the requests from the packet.
+     */
+    bool toRequests(std::vector<BatchRequest> &requests) const;
+
+    /**
+     * Fill the packet with results.
+     * @return false if the results do not share the same lengths,
+     *         in which case the packet is left empty.
+     */
+    bool fromResults(const std::vector<BatchResult> &results);
+
+    /**
+     * Retrieve the results from the packet.
+     */
+    bool toResults(std::vector<BatchResult> &results) const;
+
+    /**
+     * Read the packet whose version has been already consumed
+     * from the connection.
+     */
+    bool read(yarp::os::ConnectionReader &connection, const int32_t version);
+
+    bool read(yarp::os::ConnectionReader &connection) override;
+    bool write(yarp::os::ConnectionWriter &connection) const override;
+};
+
+/**
+ * The format negotiation for a connection that exchanges
+ * BatchPackets: the vocab "fmt" followed by the format vocab,
+ * sent in place of the packet version. The reply is a Bottle
+ * containing either "ack" or "nack".
+ */
+class BatchFormat : public yarp::os::Portable
+{
+public:
+    int32_t format;
+
+    BatchFormat(const int32_t format=BATCHSLV_VOCAB_VAL_BOTTLE) : format(format) { }
+
+    bool read(yarp::os::ConnectionReader &connection) override;
+    bool write(yarp::os::ConnectionWriter &connection) const override;
+};
+
+/**
+ * This class solves the inverse kinematics of a limb for a batch
+ * of targets received in one single message, processing them in
+ * parallel over a pool of workers, each of which owns a copy of
+ * the limb along with its own IpOpt solver.
+ *
+ * The request is made up of the vocab "batc" followed by N lists,
+ * each containing the same options of a request to the online
+ * Cartesian solver (see iCub::iKin::CartesianHelper): the target
+ * (xd ...) and the optional dof mask (dof ...) and initial joints
+ * configuration (q ...) [deg]. The reply is made up of the vocab
+ * "ack" followed by N lists with the options (xd ...), (x ...) and 
+ * (q ...) [deg], as the online solver does. 
+ *
+ * Each connection starts exchanging Bottles; sending [fmt] [bin]
+ * switches that connection to BatchPacket for both requests and
+ * replies, whereas other connections are not affected. A binary
+ * connection gets back to Bottles through BatchFormat. Malformed
+ * requests are replied with the Bottle [nack], whatever the format
+ * of the connection.
+ *
+ * The figures of the served requests are published through
+ * SolverTelemetry on the port /<name>/telemetry:o.
+ *
+ * @note Concurrent IpOpt solves require IpOpt to be linked against
+ *       a thread-safe linear solver, such as the HSL ones (e.g.
+ *       ma27, ma57). MUMPS, which IpOpt is usually shipped with,
+ *       is not reentrant and concurrent solves would corrupt each
+ *       other: with MUMPS, one single worker is to be used.
+ */
+class BatchSolver : public yarp::os::PortReaderCreator
+{
+protected:
+    struct IterationCounter : public iCub::iKin::iKinIterateCallback
+    {
+        int iterations;
+        IterationCounter() : iterations(0) { }
+        void exec(const yarp::sig::Vector &xd, const yarp::sig::Vector &q) override { iterations++; }
+    };
+
+    struct Worker
+    {
+        std::unique_ptr<iCub::iKin::iKinLimb>     limb;
+        std::unique_ptr<iCub::iKin::iKinIpOptMin> slv;
+        IterationCounter counter;
+    };
+
+    /**
+     * The reader handling one single connection.
+     */
+    class Connection : public yarp::os::PortReader
+    {
+        BatchSolver &owner;
+        bool binary;
+    public:
+        Connection(BatchSolver &owner) : owner(owner), binary(false) { }
+        bool read(yarp::os::ConnectionReader &connection) override;
+    };
+
+    std::unique_ptr<iCub::iKin::iKinLimb> prototype;
+    std::shared_ptr<WorkerPool> pool;
+    std::vector<Worker> workers;
+    std::vector<bool> blocked;
+    yarp::sig::Vector qrest;
+    unsigned int ctrlPose;
+
+    yarp::os::Port rpcPort;
+    SolverTelemetry telemetry;
+
+    void solve(Worker &w, const BatchRequest &request, BatchResult &result,
+               SolverStats &stats);
+    void solve(const std::vector<BatchRequest> &requests,
+               std::vector<BatchResult> &results,
+               std::vector<SolverStats> &stats);
+    yarp::os::PortReader *create() const override;
+
+public:
+    /**
+     * Constructor. 
+     * @param limb the limb whose copies are handled by the workers;
+     *             its blocked links define the default dof and its
+     *             current configuration the default starting point.
+     */
+    BatchSolver(iCub::iKin::iKinLimb &limb);
+
+    /**
+     * Configure the solver. 
+     * @param options contains the following fields: 
+     *                name (the ports prefix), pose (full|xyz),
+     *                threads (the number of workers, 0 by default
+     *                for all the cores; see the note on the linear
+     *                solver above), tol,
+     *                constr_tol, maxIter, telemetry_window (the
+     *                number of requests the telemetry percentiles
+     *                are computed over).
+     * @param pool the pool of threads to be used; if not given, a 
+     *             new pool is created. In any case, the solver
+     *             allocates one limb and one IpOpt instance for
+     *             each worker of the pool.
+     * @return true/false on success/failure.
+     */
+    bool open(const yarp::os::Searchable &options,
+              std::shared_ptr<WorkerPool> pool=nullptr);
+
+    /**
+     * Close the solver.
+     */
+    void close();
+
+    /**
+     * Solve a batch of requests.
+     * @param requests the requests.
+     * @param results the solutions.
+     */
+    void solve(const std::vector<BatchRequest> &requests,
+               std::vector<BatchResult> &results);
+
+    /**
+     * Solve a batch of requests in Bottle format.
+     * @param request the batch request.
+     * @param reply the batch reply.
+     * @return true/false on success/failure.
+     */
+    bool solve(const yarp::os::Bottle &request, yarp::os::Bottle &reply);
+
+    /**
+     * Convert a batch request from Bottle format.
+     */
+    static bool fromBottle(const yarp::os::Bottle &request, std::vector<BatchRequest> &requests);
+
+    /**
+     * Convert a batch request to Bottle format.
+     */
+    static void toBottle(const std::vector<BatchRequest> &requests, yarp::os::Bottle &request);
+
+    /**
+     * Convert a batch reply from Bottle format.
+     */
+    static bool fromBottle(const yarp::os::Bottle &reply, std::vector<BatchResult> &results);
+
+    /**
+     * Convert a batch reply to Bottle format.
+     */
+    static void toBottle(const std::vector<BatchResult> &results, yarp::os::Bottle &reply);
+
+    /**
+     * Destructor.
+     */
+    virtual ~BatchSolver();
+};
+
+#endif
+
+
@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2019 Fondazione Istituto Italiano di Tecnologia (IIT)
+ * All Rights Reserved.
+ * Authors: Ugo Pattacini <ugo.pattacini@iit.it>
+ */
+
+#ifndef __SOLVERTELEMETRY_H__
+#define __SOLVERTELEMETRY_H__
+
+#include <mutex>
+#include <string>
+#include <deque>
+#include <vector>
+
+#include <yarp/os/BufferedPort.h>
+#include <yarp/os/Bottle.h>
+
+/**
+ * The figures collected while serving one single request.
+ */
+struct SolverStats
+{
+    double wait;        // time spent in the queue [s]
+    double solve;       // time spent by the solver [s]
+    double reply;       // time spent encoding the reply [s]
+    int    iterations;  // number of iterations of the solver
+    double error;       // norm of the residual between target and achieved pose
+
+    SolverStats() : wait(0.0), solve(0.0), reply(0.0), iterations(0), error(0.0) { }
+};
+
+/**
+ * This class publishes the figures of the requests served by a
+ * solver on the port /<name>/telemetry:o, along with rolling
+ * percentiles computed over the last requests.
+ *
+ * Each message is made up of:
+ * (count <n>) (requests ((wait ..) (solve ..) (reply ..) (iter ..) (err ..)) ...)
+ * (percentiles (p50 p90 p99) (wait ...) (solve ...) (reply ...) (iter ...) (err ...))
+ * where count is the total number of served requests, requests
+ * lists the figures of the latest batch and each percentiles
+ * entry reports the three percentiles of the corresponding
+ * figure over the rolling window.
+ */
+class SolverTelemetry
+{
+protected:
+    std::mutex mtx;
+    std::deque<SolverStats> window;
+    size_t windowSize;
+    size_t count;
+
+    yarp::os::BufferedPort<yarp::os::Bottle> port;
+
+public:
+    /**
+     * Constructor.
+     */
+    SolverTelemetry();
+
+    /**
+     * Open the telemetry port.
+     * @param name the ports prefix.
+     * @param windowSize the number of latest requests the
+     *                   percentiles are computed over.
+     * @return true/false on success/failure.
+     */
+    bool open(const std::string &name, const size_t windowSize=1000);
+
+    /**
+     * Close the telemetry port.
+     */
+    void close();
+
+    /**
+     * Record the figures of a batch of requests and publish them.
+     * Safe to be called concurrently.
+     * @param stats the figures of the requests.
+     */
+    void add(const std::vector<SolverStats> &stats);
+
+    /**
+     * Return the p-th percentile of the values.
+     * @param values the values, which get partially sorted.
+     * @param p the percentile in [0,100].
+     */
+    static double percentile(std::vector<double> &values, const double p);
+};
+
+#endif
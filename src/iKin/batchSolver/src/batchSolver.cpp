@@ -0,0 +1,647 @@
+/*
+ * Copyright (C) 2019 Fondazione Istituto Italiano di Tecnologia (IIT)
+ * All Rights Reserved.
+ * Authors: Ugo Pattacini <ugo.pattacini@iit.it>
+ */
+
+#include <batchSolver.h>
+
+#include <algorithm>
+#include <stdio.h>
+
+#include <yarp/math/Math.h>
+#include <iCub/iKin/iKinVocabs.h>
+#include <iCub/iKin/iKinHlp.h>
+
+using namespace std;
+using namespace yarp::os;
+using namespace yarp::sig;
+using namespace yarp::math;
+using namespace iCub::ctrl;
+using namespace iCub::iKin;
+
+namespace
+{
+    /**********************************************************/
+    Vector getVectorOption(const Bottle &b, const int vocab)
+    {
+        Vector v;
+        if (Bottle *l=b.find(Vocab32::decode(vocab)).asList())
+            for (size_t i=0; i<l->size(); i++)
+                v.push_back(l->get(i).asFloat64());
+        return v;
+    }
+
+    /**********************************************************/
+    void setReplyTime(vector<SolverStats> &stats, const double dt)
+    {
+        // the reply is encoded once for the whole batch
+        for (auto &s:stats)
+            s.reply=dt;
+    }
+
+    /**********************************************************/
+    bool checkLengths(const vector<const Vector*> &v)
+    {
+        // all the entries carry vectors of the same length
+        for (size_t i=3; i<v.size(); i++)
+            if (v[i]->length()!=v[i%3]->length())
+                return false;
+        return true;
+    }
+
+    /**********************************************************/
+    void fillPacket(const vector<const Vector*> &v, int32_t &n, int32_t *len,
+                    vector<double> &data)
+    {
+        n=(int32_t)(v.size()/3);
+        for (int k=0; k<3; k++)
+            len[k]=(n>0)?(int32_t)v[k]->length():0;
+
+        data.clear();
+        data.reserve(n*(len[0]+len[1]+len[2]));
+        for (auto &vk:v)
+            data.insert(data.end(),vk->data(),vk->data()+vk->length());
+    }
+
+    /**********************************************************/
+    void addVectorOption(Bottle &b, const int vocab, const Vector &v)
+    {
+        Bottle &part=b.addList();
+        part.addVocab32(vocab);
+        Bottle &val=part.addList();
+        for (size_t i=0; i<v.length(); i++)
+            val.addFloat64(v[i]);
+    }
+}
+
+/**********************************************************/
+WorkerPool::WorkerPool(const unsigned int nThreads) : closing(false)
+{
+    for (unsigned int id=0; id<std::max(1U,nThreads); id++)
+        workers.push_back(thread(&WorkerPool::loop,this,id));
+}
+
+/**********************************************************/
+WorkerPool::~WorkerPool()
+{
+    {
+        lock_guard<mutex> lg(mtx);
+        closing=true;
+    }
+    cvJobs.notify_all();
+
+    for (auto &w:workers)
+        w.join();
+}
+
+/**********************************************************/
+void WorkerPool::loop(const unsigned int id)
+{
+    while (true)
+    {
+        Job job;
+        {
+            unique_lock<mutex> lck(mtx);
+            cvJobs.wait(lck,[this](){ return closing || !jobs.empty(); });
+            if (jobs.empty())
+                return;
+
+            job=jobs.front();
+            jobs.pop_front();
+        }
+
+        job.exec(id);
+
+        lock_guard<mutex> lg(mtx);
+        if (--(*job.pending)==0)
+            cvDone.notify_all();
+    }
+}
+
+/**********************************************************/
+void WorkerPool::run(const vector<function<void(const unsigned int)>> &batch)
+{
+    if (batch.empty())
+        return;
+
+    // each batch keeps track of its own jobs
+    size_t pending=batch.size();
+
+    unique_lock<mutex> lck(mtx);
+    for (auto &exec:batch)
+        jobs.push_back(Job{exec,&pending});
+    cvJobs.notify_all();
+
+    cvDone.wait(lck,[&pending](){ return (pending==0); });
+}
+
+/**********************************************************/
+BatchPacket::BatchPacket() : version(BATCHSLV_PACKET_VERSION), n(0)
+{
+    len[0]=len[1]=len[2]=0;
+}
+
+/**********************************************************/
+bool BatchPacket::fromRequests(const vector<BatchRequest> &requests)
+{
+    vector<const Vector*> v;
+    for (auto &r:requests)
+    {
+        v.push_back(&r.xd);
+        v.push_back(&r.dof);
+        v.push_back(&r.q);
+    }
+
+    bool ok=checkLengths(v);
+    if (!ok)
+        v.clear();
+
+    fillPacket(v,n,len,data);
+    return ok;
+}
+
+/**********************************************************/
+bool BatchPacket::toRequests(vector<BatchRequest> &requests) const
+{
+    if (data.size()!=(size_t)n*(len[0]+len[1]+len[2]))
+        return false;
+
+    requests.resize(n);
+    const double *ptr=data.data();
+    for (auto &r:requests)
+    {
+        Vector *v[3]={&r.xd,&r.dof,&r.q};
+        for (int k=0; k<3; k++)
+        {
+            v[k]->resize(len[k]);
+            for (int32_t i=0; i<len[k]; i++)
+                (*v[k])[i]=*ptr++;
+        }
+    }
+
+    return true;
+}
+
+/**********************************************************/
+bool BatchPacket::fromResults(const vector<BatchResult> &results)
+{
+    vector<const Vector*> v;
+    for (auto &r:results)
+    {
+        v.push_back(&r.xd);
+        v.push_back(&r.x);
+        v.push_back(&r.q);
+    }
+
+    bool ok=checkLengths(v);
+    if (!ok)
+        v.clear();
+
+    fillPacket(v,n,len,data);
+    return ok;
+}
+
+/**********************************************************/
+bool BatchPacket::toResults(vector<BatchResult> &results) const
+{
+    if (data.size()!=(size_t)n*(len[0]+len[1]+len[2]))
+        return false;
+
+    results.resize(n);
+    const double *ptr=data.data();
+    for (auto &r:results)
+    {
+        Vector *v[3]={&r.xd,&r.x,&r.q};
+        for (int k=0; k<3; k++)
+        {
+            v[k]->resize(len[k]);
+            for (int32_t i=0; i<len[k]; i++)
+                (*v[k])[i]=*ptr++;
+        }
+    }
+
+    return true;
+}
+
+/**********************************************************/
+bool BatchPacket::read(ConnectionReader &connection)
+{
+    return read(connection,connection.expectInt32());
+}
+
+/**********************************************************/
+bool BatchPacket::read(ConnectionReader &connection, const int32_t version)
+{
+    this->version=version;
+    if (version!=BATCHSLV_PACKET_VERSION)
+        return false;
+
+    // the sizes are bounded before allocating anything
+    n=connection.expectInt32();
+    for (int k=0; k<3; k++)
+        len[k]=connection.expectInt32();
+    if (connection.isError() || (n<0) || (n>BATCHSLV_PACKET_MAX_N))
+        return false;
+    for (int k=0; k<3; k++)
+        if ((len[k]<0) || (len[k]>BATCHSLV_PACKET_MAX_LEN))
+            return false;
+
+    data.resize((size_t)n*(len[0]+len[1]+len[2]));
+    if (data.empty())
+        return !connection.isError();
+
+    return connection.expectBlock((char*)data.data(),data.size()*sizeof(double));
+}
+
+/**********************************************************/
+bool BatchPacket::write(ConnectionWriter &connection) const
+{
+    connection.appendInt32(version);
+    connection.appendInt32(n);
+    for (int k=0; k<3; k++)
+        connection.appendInt32(len[k]);
+    if (!data.empty())
+        connection.appendExternalBlock((const char*)data.data(),data.size()*sizeof(double));
+
+    return !connection.isError();
+}
+
+/**********************************************************/
+bool BatchFormat::read(ConnectionReader &connection)
+{
+    if (connection.expectInt32()!=BATCHSLV_VOCAB_CMD_FORMAT)
+        return false;
+
+    format=connection.expectInt32();
+    return !connection.isError();
+}
+
+/**********************************************************/
+bool BatchFormat::write(ConnectionWriter &connection) const
+{
+    connection.appendInt32(BATCHSLV_VOCAB_CMD_FORMAT);
+    connection.appendInt32(format);
+    return !connection.isError();
+}
+
+/**********************************************************/
+BatchSolver::BatchSolver(iKinLimb &limb) : prototype(new iKinLimb(limb)),
+                                           ctrlPose(IKINCTRL_POSE_FULL)
+{
+    iKinChain *chain=limb.asChain();
+    for (unsigned int i=0; i<chain->getN(); i++)
+    {
+        blocked.push_back(chain->isLinkBlocked(i));
+        qrest.push_back((*chain)[i].getAng());
+    }
+}
+
+/**********************************************************/
+bool BatchSolver::open(const Searchable &options, shared_ptr<WorkerPool> pool)
+{
+    string name=options.check("name",Value("solver")).asString();
+    ctrlPose=(options.check("pose",Value("full")).asString()=="xyz")?
+             IKINCTRL_POSE_XYZ:IKINCTRL_POSE_FULL;
+    double tol=options.check("tol",Value(1e-3)).asFloat64();
+    double constr_tol=options.check("constr_tol",Value(1e-6)).asFloat64();
+    int maxIter=options.check("maxIter",Value(200)).asInt32();
+
+    // see the note on the linear solver in batchSolver.h
+    if (pool==nullptr)
+    {
+        int nThreads=options.check("threads",Value(0)).asInt32();
+        if (nThreads<=0)
+            nThreads=(int)std::max(1U,thread::hardware_concurrency());
+        pool=make_shared<WorkerPool>((unsigned int)nThreads);
+    }
+    this->pool=pool;
+
+    // one copy of the limb and one solver for each worker
+    workers.clear();
+    workers.resize(pool->size());
+    for (auto &w:workers)
+    {
+        w.limb=unique_ptr<iKinLimb>(new iKinLimb(*prototype));
+        w.slv=unique_ptr<iKinIpOptMin>(new iKinIpOptMin(*w.limb->asChain(),ctrlPose,
+                                                        tol,constr_tol,maxIter));
+        w.slv->setUserScaling(true,100.0,100.0,100.0);
+    }
+
+    // each connection is given its own reader
+    // to keep track of the negotiated format
+    rpcPort.setReaderCreator(*this);
+    if (!rpcPort.open("/"+name+"/batch:rpc"))
+        return false;
+
+    int window=options.check("telemetry_window",Value(1000)).asInt32();
+    if (!telemetry.open(name,(size_t)std::max(1,window)))
+    {
+        rpcPort.close();
+        return false;
+    }
+
+    return true;
+}
+
+/**********************************************************/
+void BatchSolver::close()
+{
+    rpcPort.interrupt();
+    rpcPort.close();
+    telemetry.close();
+}
+
+/**********************************************************/
+BatchSolver::~BatchSolver()
+{
+    close();
+}
+
+/**********************************************************/
+PortReader *BatchSolver::create() const
+{
+    return new Connection(const_cast<BatchSolver&>(*this));
+}
+
+/**********************************************************/
+void BatchSolver::solve(Worker &w, const BatchRequest &request, BatchResult &result,
+                        SolverStats &stats)
+{
+    iKinChain *chain=w.limb->asChain();
+    unsigned int N=chain->getN();
+
+    // the initial configuration is the one of the
+    // original limb unless otherwise specified
+    Vector q0=qrest;
+    for (size_t i=0; i<std::min((size_t)N,request.q.length()); i++)
+        q0[i]=CTRL_DEG2RAD*request.q[i];
+
+    // the dof mask applies to the first links,
+    // as in the online solver
+    vector<bool> active(N);
+    for (unsigned int i=0; i<N; i++)
+        active[i]=!blocked[i];
+    for (size_t i=0; i<std::min((size_t)N,request.dof.length()); i++)
+        active[i]=(request.dof[i]!=0.0);
+
+    for (unsigned int i=0; i<N; i++)
+        if (chain->isLinkBlocked(i))
+            chain->releaseLink(i);
+    chain->setAng(q0);
+    for (unsigned int i=0; i<N; i++)
+        if (!active[i])
+            chain->blockLink(i,q0[i]);
+
+    // missing components of the target are
+    // taken from the current pose
+    Vector xd=request.xd;
+    Vector x0=chain->EndEffPose();
+    for (size_t i=xd.length(); i<x0.length(); i++)
+        xd.push_back(x0[i]);
+
+    result.xd=xd;
+    w.counter.iterations=0;
+
+    double t0=SystemClock::nowSystem();
+    w.slv->solve(chain->getAng(),xd,NULL,NULL,&w.counter);
+    stats.solve=SystemClock::nowSystem()-t0;
+    stats.iterations=w.counter.iterations;
+
+    result.x=chain->EndEffPose();
+    result.q.resize(N);
+    for (unsigned int i=0; i<N; i++)
+        result.q[i]=CTRL_RAD2DEG*(*chain)[i].getAng();
+
+    // the residual accounts only for the controlled components
+    size_t len=(ctrlPose==IKINCTRL_POSE_XYZ)?3:result.x.length();
+    stats.error=norm(result.xd.subVector(0,len-1)-result.x.subVector(0,len-1));
+}
+
+/**********************************************************/
+void BatchSolver::solve(const vector<BatchRequest> &requests, vector<BatchResult> &results,
+                        vector<SolverStats> &stats)
+{
+    results.resize(requests.size());
+    stats.assign(requests.size(),SolverStats());
+    vector<function<void(const unsigned int)>> jobs;
+
+    // the queue wait counts from the submission of the batch
+    double t0=SystemClock::nowSystem();
+    for (size_t i=0; i<requests.size(); i++)
+    {
+        jobs.push_back([this,&requests,&results,&stats,t0,i](const unsigned int id)
+        {
+            stats[i].wait=SystemClock::nowSystem()-t0;
+            solve(workers[id],requests[i],results[i],stats[i]);
+        });
+    }
+
+    pool->run(jobs);
+}
+
+/**********************************************************/
+void BatchSolver::solve(const vector<BatchRequest> &requests, vector<BatchResult> &results)
+{
+    vector<SolverStats> stats;
+    solve(requests,results,stats);
+    telemetry.add(stats);
+}
+
+/**********************************************************/
+bool BatchSolver::solve(const Bottle &request, Bottle &reply)
+{
+    vector<BatchRequest> requests;
+    if (!fromBottle(request,requests))
+    {
+        reply.clear();
+        reply.addVocab32(IKINSLV_VOCAB_REP_NACK);
+        return false;
+    }
+
+    vector<BatchResult> results;
+    solve(requests,results);
+    toBottle(results,reply);
+
+    return true;
+}
+
+/**********************************************************/
+bool BatchSolver::fromBottle(const Bottle &request, vector<BatchRequest> &requests)
+{
+    requests.clear();
+    if ((request.size()==0) || (request.get(0).asVocab32()!=BATCHSLV_VOCAB_CMD_BATCH))
+        return false;
+
+    for (size_t i=1; i<request.size(); i++)
+    {
+        Bottle *req=request.get(i).asList();
+        if (req==NULL)
+            return false;
+
+        BatchRequest r;
+        r.xd=getVectorOption(*req,IKINSLV_VOCAB_OPT_XD);
+        r.dof=getVectorOption(*req,IKINSLV_VOCAB_OPT_DOF);
+        r.q=getVectorOption(*req,IKINSLV_VOCAB_OPT_Q);
+        requests.push_back(r);
+    }
+
+    return true;
+}
+
+/**********************************************************/
+void BatchSolver::toBottle(const vector<BatchRequest> &requests, Bottle &request)
+{
+    request.clear();
+    request.addVocab32(BATCHSLV_VOCAB_CMD_BATCH);
+    for (auto &r:requests)
+    {
+        Bottle &req=request.addList();
+        CartesianHelper::addTargetOption(req,r.xd);
+        if (r.dof.length()>0)
+            CartesianHelper::addDOFOption(req,r.dof);
+        if (r.q.length()>0)
+            addVectorOption(req,IKINSLV_VOCAB_OPT_Q,r.q);
+    }
+}
+
+/**********************************************************/
+bool BatchSolver::fromBottle(const Bottle &reply, vector<BatchResult> &results)
+{
+    results.clear();
+    if ((reply.size()==0) || (reply.get(0).asVocab32()!=IKINSLV_VOCAB_REP_ACK))
+        return false;
+
+    for (size_t i=1; i<reply.size(); i++)
+    {
+        Bottle *rep=reply.get(i).asList();
+        if (rep==NULL)
+            return false;
+
+        BatchResult r;
+        r.xd=getVectorOption(*rep,IKINSLV_VOCAB_OPT_XD);
+        r.x=getVectorOption(*rep,IKINSLV_VOCAB_OPT_X);
+        r.q=getVectorOption(*rep,IKINSLV_VOCAB_OPT_Q);
+        results.push_back(r);
+    }
+
+    return true;
+}
+
+/**********************************************************/
+void BatchSolver::toBottle(const vector<BatchResult> &results, Bottle &reply)
+{
+    reply.clear();
+    reply.addVocab32(IKINSLV_VOCAB_REP_ACK);
+    for (auto &r:results)
+    {
+        Bottle &rep=reply.addList();
+        CartesianHelper::addTargetOption(rep,r.xd);
+        addVectorOption(rep,IKINSLV_VOCAB_OPT_X,r.x);
+        addVectorOption(rep,IKINSLV_VOCAB_OPT_Q,r.q);
+    }
+}
+
+/**********************************************************/
+bool BatchSolver::Connection::read(ConnectionReader &connection)
+{
+    ConnectionWriter *returnToSender=connection.getWriter();
+
+    // failures are replied in Bottle format, which
+    // is told apart also by the BatchPacket readers
+    Bottle nack;
+    nack.addVocab32(IKINSLV_VOCAB_REP_NACK);
+
+    if (binary)
+    {
+        int32_t header=connection.expectInt32();
+
+        // format negotiation
+        if (header==BATCHSLV_VOCAB_CMD_FORMAT)
+        {
+            int32_t fmt=connection.expectInt32();
+            Bottle reply;
+            if ((fmt==BATCHSLV_VOCAB_VAL_BINARY) || (fmt==BATCHSLV_VOCAB_VAL_BOTTLE))
+            {
+                binary=(fmt==BATCHSLV_VOCAB_VAL_BINARY);
+                reply.addVocab32(IKINSLV_VOCAB_REP_ACK);
+            }
+            else
+                reply=nack;
+
+            if (returnToSender!=NULL)
+                reply.write(*returnToSender);
+            return true;
+        }
+
+        BatchPacket request,reply;
+        vector<BatchRequest> requests;
+        vector<BatchResult> results;
+        vector<SolverStats> stats;
+        if (!request.read(connection,header) || !request.toRequests(requests))
+        {
+            if (returnToSender!=NULL)
+                nack.write(*returnToSender);
+            return true;
+        }
+
+        owner.solve(requests,results,stats);
+
+        double t0=SystemClock::nowSystem();
+        reply.fromResults(results);
+        if (returnToSender!=NULL)
+            reply.write(*returnToSender);
+        setReplyTime(stats,SystemClock::nowSystem()-t0);
+
+        owner.telemetry.add(stats);
+        return true;
+    }
+
+    Bottle request,reply;
+    if (!request.read(connection))
+    {
+        if (returnToSender!=NULL)
+            nack.write(*returnToSender);
+        return true;
+    }
+
+    // format negotiation
+    if (request.get(0).asVocab32()==BATCHSLV_VOCAB_CMD_FORMAT)
+    {
+        int fmt=request.get(1).asVocab32();
+        if ((fmt==BATCHSLV_VOCAB_VAL_BINARY) || (fmt==BATCHSLV_VOCAB_VAL_BOTTLE))
+        {
+            binary=(fmt==BATCHSLV_VOCAB_VAL_BINARY);
+            reply.addVocab32(IKINSLV_VOCAB_REP_ACK);
+        }
+        else
+            reply.addVocab32(IKINSLV_VOCAB_REP_NACK);
+    }
+    else
+    {
+        vector<BatchRequest> requests;
+        if (fromBottle(request,requests))
+        {
+            vector<BatchResult> results;
+            vector<SolverStats> stats;
+            owner.solve(requests,results,stats);
+
+            double t0=SystemClock::nowSystem();
+            toBottle(results,reply);
+            if (returnToSender!=NULL)
+                reply.write(*returnToSender);
+            setReplyTime(stats,SystemClock::nowSystem()-t0);
+
+            owner.telemetry.add(stats);
+            return true;
+        }
+
+        reply.addVocab32(IKINSLV_VOCAB_REP_NACK);
+    }
+
+    if (returnToSender!=NULL)
+        reply.write(*returnToSender);
+
+    return true;
+}
+
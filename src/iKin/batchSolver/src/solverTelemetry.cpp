@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2019 Fondazione Istituto Italiano di Tecnologia (IIT)
+ * All Rights Reserved.
+ * Authors: Ugo Pattacini <ugo.pattacini@iit.it>
+ */
+
+#include <solverTelemetry.h>
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+using namespace yarp::os;
+
+/**********************************************************/
+SolverTelemetry::SolverTelemetry() : windowSize(1000), count(0)
+{
+}
+
+/**********************************************************/
+bool SolverTelemetry::open(const string &name, const size_t windowSize)
+{
+    this->windowSize=std::max((size_t)1,windowSize);
+    return port.open("/"+name+"/telemetry:o");
+}
+
+/**********************************************************/
+void SolverTelemetry::close()
+{
+    port.interrupt();
+    port.close();
+}
+
+/**********************************************************/
+double SolverTelemetry::percentile(vector<double> &values, const double p)
+{
+    if (values.empty())
+        return 0.0;
+
+    size_t k=(size_t)std::floor(0.01*std::min(100.0,std::max(0.0,p))*(values.size()-1)+0.5);
+    nth_element(values.begin(),values.begin()+k,values.end());
+    return values[k];
+}
+
+/**********************************************************/
+void SolverTelemetry::add(const vector<SolverStats> &stats)
+{
+    lock_guard<mutex> lg(mtx);
+
+    count+=stats.size();
+    for (auto &s:stats)
+    {
+        window.push_back(s);
+        if (window.size()>windowSize)
+            window.pop_front();
+    }
+
+    if (port.getOutputCount()==0)
+        return;
+
+    Bottle &msg=port.prepare();
+    msg.clear();
+
+    Bottle &c=msg.addList();
+    c.addString("count");
+    c.addInt64((int64_t)count);
+
+    Bottle &r=msg.addList();
+    r.addString("requests");
+    Bottle &list=r.addList();
+    for (auto &s:stats)
+    {
+        Bottle &item=list.addList();
+        Bottle &wait=item.addList();  wait.addString("wait");   wait.addFloat64(s.wait);
+        Bottle &solve=item.addList(); solve.addString("solve"); solve.addFloat64(s.solve);
+        Bottle &reply=item.addList(); reply.addString("reply"); reply.addFloat64(s.reply);
+        Bottle &iter=item.addList();  iter.addString("iter");   iter.addInt32(s.iterations);
+        Bottle &err=item.addList();   err.addString("err");     err.addFloat64(s.error);
+    }
+
+    // percentiles over the rolling window
+    const double p[3]={50.0,90.0,99.0};
+    Bottle &pct=msg.addList();
+    pct.addString("percentiles");
+    Bottle &header=pct.addList();
+    for (int i=0; i<3; i++)
+        header.addString("p"+to_string((int)p[i]));
+
+    vector<double> values(window.size());
+    auto addPercentiles=[&](const string &tag, double (*get)(const SolverStats&))
+    {
+        for (size_t i=0; i<window.size(); i++)
+            values[i]=get(window[i]);
+
+        Bottle &entry=pct.addList();
+        entry.addString(tag);
+        for (int i=0; i<3; i++)
+            entry.addFloat64(percentile(values,p[i]));
+    };
+
+    addPercentiles("wait",[](const SolverStats &s){ return s.wait; });
+    addPercentiles("solve",[](const SolverStats &s){ return s.solve; });
+    addPercentiles("reply",[](const SolverStats &s){ return s.reply; });
+    addPercentiles("iter",[](const SolverStats &s){ return (double)s.iterations; });
+    addPercentiles("err",[](const SolverStats &s){ return s.error; });
+
+    port.write();
+}
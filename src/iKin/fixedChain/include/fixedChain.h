@@ -0,0 +1,235 @@
+/*
+ * Copyright (C) 2019 Fondazione Istituto Italiano di Tecnologia (IIT)
+ * All Rights Reserved.
+ * Authors: Ugo Pattacini <ugo.pattacini@iit.it>
+ */
+
+#ifndef __FIXEDCHAIN_H__
+#define __FIXEDCHAIN_H__
+
+#include <cmath>
+#include <cstddef>
+#include <algorithm>
+#include <array>
+
+/**
+ * The Denavit-Hartenberg parameters of a link in standard
+ * convention: lengths are in meters, angles in radians.
+ */
+struct DHLink
+{
+    double A;
+    double D;
+    double alpha;
+    double offset;
+    double min;
+    double max;
+};
+
+/**
+ * A 4x4 rototranslational matrix stored by rows on the stack.
+ */
+struct Mat4
+{
+    double m[4][4];
+
+    /**********************************************************/
+    static constexpr Mat4 eye()
+    {
+        return Mat4{{{1.0,0.0,0.0,0.0},
+                     {0.0,1.0,0.0,0.0},
+                     {0.0,0.0,1.0,0.0},
+                     {0.0,0.0,0.0,1.0}}};
+    }
+
+    /**********************************************************/
+    Mat4 operator*(const Mat4 &b) const
+    {
+        // the last row of rototranslational matrices is (0 0 0 1)
+        Mat4 c;
+        for (int i=0; i<3; i++)
+        {
+            for (int j=0; j<4; j++)
+                c.m[i][j]=m[i][0]*b.m[0][j]+m[i][1]*b.m[1][j]+m[i][2]*b.m[2][j];
+            c.m[i][3]+=m[i][3];
+        }
+        c.m[3][0]=c.m[3][1]=c.m[3][2]=0.0; c.m[3][3]=1.0;
+        return c;
+    }
+};
+
+/**
+ * Convert a rototranslational matrix into a pose vector 
+ * [x y z ax ay az theta] as iCub::ctrl::dcm2axis() does. 
+ * @param H the rototranslational matrix.
+ * @param x the pose.
+ */
+inline void toPose(const Mat4 &H, double *x)
+{
+    x[0]=H.m[0][3];
+    x[1]=H.m[1][3];
+    x[2]=H.m[2][3];
+
+    double v[3]={H.m[2][1]-H.m[1][2],
+                 H.m[0][2]-H.m[2][0],
+                 H.m[1][0]-H.m[0][1]};
+    const double r=sqrt(v[0]*v[0]+v[1]*v[1]+v[2]*v[2]);
+    const double theta=atan2(0.5*r,0.5*(H.m[0][0]+H.m[1][1]+H.m[2][2]-1.0));
+
+    if (r<1e-9)
+    {
+        // the rotation is either null or of 180 degrees:
+        // in the latter case the axis is retrieved from
+        // the diagonal of R=2*a*a'-I
+        int k=0;
+        for (int i=1; i<3; i++)
+            if (H.m[i][i]>H.m[k][k])
+                k=i;
+
+        v[k]=sqrt(std::max(0.0,0.5*(H.m[k][k]+1.0)));
+        for (int i=0; i<3; i++)
+            if (i!=k)
+                v[i]=(v[k]>0.0)?0.5*(H.m[i][k]+H.m[k][i])/(2.0*v[k]):0.0;
+
+        const double n=sqrt(v[0]*v[0]+v[1]*v[1]+v[2]*v[2]);
+        if (n>0.0)
+        {
+            x[3]=v[0]/n; x[4]=v[1]/n; x[5]=v[2]/n;
+        }
+        else
+        {
+            x[3]=0.0; x[4]=0.0; x[5]=1.0;
+        }
+    }
+    else
+    {
+        x[3]=v[0]/r; x[4]=v[1]/r; x[5]=v[2]/r;
+    }
+
+    x[6]=theta;
+}
+
+/**
+ * This class implements the forward kinematics of a serial chain
+ * whose number of links N and Denavit-Hartenberg table are known
+ * at compile time, so that all the intermediate transformations
+ * live on the stack and the loops can be unrolled by the compiler.
+ * Differently from iKinChain, links cannot be blocked: the joints
+ * vector always contains N elements.
+ */
+template<size_t N>
+class FixedChain
+{
+protected:
+    std::array<DHLink,N> links;
+    Mat4 H0;
+    Mat4 HN;
+
+    /**********************************************************/
+    static Mat4 getLinkH(const DHLink &l, const double q)
+    {
+        const double theta=q+l.offset;
+        const double c_theta=cos(theta);
+        const double s_theta=sin(theta);
+        const double c_alpha=cos(l.alpha);
+        const double s_alpha=sin(l.alpha);
+
+        return Mat4{{{c_theta, -s_theta*c_alpha,  s_theta*s_alpha, c_theta*l.A},
+                     {s_theta,  c_theta*c_alpha, -c_theta*s_alpha, s_theta*l.A},
+                     {    0.0,          s_alpha,          c_alpha,         l.D},
+                     {    0.0,              0.0,              0.0,         1.0}}};
+    }
+
+public:
+    /**
+     * Constructor. 
+     * @param links the Denavit-Hartenberg table. 
+     * @param H0 the rigid roto-translation from the root reference 
+     *           to the first link.
+     * @param HN the rigid roto-translation from the last link to
+     *           the end-effector.
+     */
+    constexpr FixedChain(const std::array<DHLink,N> &links,
+                         const Mat4 &H0=Mat4::eye(), const Mat4 &HN=Mat4::eye()) :
+                         links(links), H0(H0), HN(HN) { }
+
+    /**
+     * Return the number of links.
+     */
+    constexpr size_t getN() const { return N; }
+
+    /**
+     * Return the i-th link.
+     */
+    constexpr const DHLink &operator()(const size_t i) const { return links[i]; }
+
+    /**
+     * Compute the rototranslational matrices of all the links
+     * referred to the root frame. 
+     * @param q the joints configuration [rad].
+     * @param H the N+1 matrices, where H[0]=H0 and H[N] is the 
+     *          matrix of the last link (HN excluded).
+     */
+    void getIntermediateH(const double *q, std::array<Mat4,N+1> &H) const
+    {
+        H[0]=H0;
+        for (size_t i=0; i<N; i++)
+            H[i+1]=H[i]*getLinkH(links[i],q[i]);
+    }
+
+    /**
+     * Compute the rototranslational matrix of the end-effector.
+     * @param q the joints configuration [rad].
+     * @return the end-effector matrix.
+     */
+    Mat4 getH(const double *q) const
+    {
+        Mat4 H=H0;
+        for (size_t i=0; i<N; i++)
+            H=H*getLinkH(links[i],q[i]);
+        return H*HN;
+    }
+
+    /**
+     * Compute the end-effector pose as iKinChain::EndEffPose() 
+     * does with the axis-angle representation. 
+     * @param q the joints configuration [rad].
+     * @param x the pose [x y z ax ay az theta].
+     */
+    void EndEffPose(const double *q, double *x) const
+    {
+        toPose(getH(q),x);
+    }
+
+    /**
+     * Compute the geometric Jacobian as iKinChain::GeoJacobian()
+     * does when all the links are released.
+     * @param q the joints configuration [rad].
+     * @param J the 6xN Jacobian stored by rows.
+     */
+    void GeoJacobian(const double *q, double J[6][N]) const
+    {
+        std::array<Mat4,N+1> H;
+        getIntermediateH(q,H);
+        const Mat4 HE=H[N]*HN;
+
+        for (size_t i=0; i<N; i++)
+        {
+            const double z[3]={H[i].m[0][2],H[i].m[1][2],H[i].m[2][2]};
+            const double p[3]={HE.m[0][3]-H[i].m[0][3],
+                               HE.m[1][3]-H[i].m[1][3],
+                               HE.m[2][3]-H[i].m[2][3]};
+
+            J[0][i]=z[1]*p[2]-z[2]*p[1];
+            J[1][i]=z[2]*p[0]-z[0]*p[2];
+            J[2][i]=z[0]*p[1]-z[1]*p[0];
+            J[3][i]=z[0];
+            J[4][i]=z[1];
+            J[5][i]=z[2];
+        }
+    }
+};
+
+#endif
+
+
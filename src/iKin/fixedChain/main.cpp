@@ -0,0 +1,224 @@
+/**
+ * @ingroup icub_tutorials
+ *
+ * \defgroup icub_fixedChain Fixed-Size Kinematic Chains
+ *
+ * A tutorial on how to specialize the forward kinematics of a 
+ * serial chain whose Denavit-Hartenberg table is known at 
+ * compile time, comparing the results and the performances 
+ * against iKinChain. 
+ *  
+ * The same program serves also as converter: when launched with
+ * the option --config it reads a links file in the iKinLimb 
+ * format and prints out the corresponding FixedChain definition. 
+ *
+ * \author Ugo Pattacini
+ * 
+ * CopyPolicy: Released under the terms of GPL 2.0 or later
+ */ 
+
+#include <cstdio>
+#include <cmath>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <iostream>
+
+#include <yarp/os/ResourceFinder.h>
+#include <yarp/os/Property.h>
+#include <yarp/os/SystemClock.h>
+#include <yarp/sig/Vector.h>
+#include <yarp/sig/Matrix.h>
+#include <yarp/math/Math.h>
+#include <yarp/math/Rand.h>
+
+#include <iCub/iKin/iKinFwd.h>
+
+#include <fixedChain.h>
+
+using namespace std;
+using namespace yarp::os;
+using namespace yarp::sig;
+using namespace yarp::math;
+using namespace iCub::ctrl;
+using namespace iCub::iKin;
+
+
+// the iCub right arm (torso included) as in the fwInvKinematics tutorial:
+// the table is known at compile time, hence the compiler can fold it
+//                                               A,        D,     alpha,           offset(*),          min theta,          max theta
+constexpr array<DHLink,10> rightArmLinks={{{     0.032,      0.0,  M_PI/2.0,                 0.0, -22.0*CTRL_DEG2RAD,  84.0*CTRL_DEG2RAD},
+                                           {       0.0,  -0.0055,  M_PI/2.0,           -M_PI/2.0, -39.0*CTRL_DEG2RAD,  39.0*CTRL_DEG2RAD},
+                                           {-0.0233647,  -0.1433,  M_PI/2.0, -105.0*CTRL_DEG2RAD, -59.0*CTRL_DEG2RAD,  59.0*CTRL_DEG2RAD},
+                                           {       0.0, -0.10774,  M_PI/2.0,           -M_PI/2.0, -95.5*CTRL_DEG2RAD,   5.0*CTRL_DEG2RAD},
+                                           {       0.0,      0.0, -M_PI/2.0,           -M_PI/2.0,                0.0, 160.8*CTRL_DEG2RAD},
+                                           {       0.0, -0.15228, -M_PI/2.0, -105.0*CTRL_DEG2RAD, -37.0*CTRL_DEG2RAD,  90.0*CTRL_DEG2RAD},
+                                           {     0.015,      0.0,  M_PI/2.0,                 0.0,   5.5*CTRL_DEG2RAD, 106.0*CTRL_DEG2RAD},
+                                           {       0.0,  -0.1373,  M_PI/2.0,           -M_PI/2.0, -90.0*CTRL_DEG2RAD,  90.0*CTRL_DEG2RAD},
+                                           {       0.0,      0.0,  M_PI/2.0,            M_PI/2.0, -90.0*CTRL_DEG2RAD,   0.0*CTRL_DEG2RAD},
+                                           {    0.0625,    0.016,       0.0,                M_PI, -20.0*CTRL_DEG2RAD,  40.0*CTRL_DEG2RAD}}};
+// (*) remind that offset is added to theta before computing the rototranslational matrix
+
+constexpr Mat4 rightArmH0={{{0.0, -1.0,  0.0, 0.0},
+                            {0.0,  0.0, -1.0, 0.0},
+                            {1.0,  0.0,  0.0, 0.0},
+                            {0.0,  0.0,  0.0, 1.0}}};
+
+constexpr FixedChain<10> rightArm(rightArmLinks,rightArmH0);
+
+
+/****************************************************************/
+Matrix toMatrix(const Mat4 &H)
+{
+    Matrix M(4,4);
+    for (int r=0; r<4; r++)
+        for (int c=0; c<4; c++)
+            M(r,c)=H.m[r][c];
+    return M;
+}
+
+
+/****************************************************************/
+string toString(const Matrix &M)
+{
+    string s;
+    for (int r=0; r<4; r++)
+    {
+        s+="                 {";
+        for (int c=0; c<4; c++)
+        {
+            char buf[64];
+            sprintf(buf,"%.17g%s",M(r,c),c<3?", ":"");
+            s+=buf;
+        }
+        s+=(r<3)?"},\n":"}";
+    }
+    return s;
+}
+
+
+// this function converts the links file of an iKinLimb
+// into the code defining the corresponding FixedChain
+/****************************************************************/
+int convert(const string &fileName)
+{
+    Property linksOptions;
+    linksOptions.fromConfigFile(fileName);
+
+    // let iKinLimb parse the file for us
+    iKinLimb limb(linksOptions);
+    if (!limb.isValid())
+    {
+        cerr << "Error: invalid links parameters!" << endl;
+        return EXIT_FAILURE;
+    }
+
+    iKinChain *chain=limb.asChain();
+    unsigned int N=chain->getN();
+
+    printf("constexpr array<DHLink,%u> links={{\n",N);
+    for (unsigned int i=0; i<N; i++)
+    {
+        iKinLink &l=(*chain)[i];
+        printf("    {%.17g, %.17g, %.17g, %.17g, %.17g, %.17g}%s\n",
+               l.getA(),l.getD(),l.getAlpha(),l.getOffset(),l.getMin(),l.getMax(),
+               i<N-1?",":"");
+    }
+    printf("}};\n\n");
+
+    printf("constexpr Mat4 H0={{\n%s}};\n\n",toString(chain->getH0()).c_str());
+    printf("constexpr Mat4 HN={{\n%s}};\n\n",toString(chain->getHN()).c_str());
+    printf("constexpr FixedChain<%u> chain(links,H0,HN);\n",N);
+
+    return EXIT_SUCCESS;
+}
+
+
+/****************************************************************/
+int main(int argc, char *argv[])
+{
+    ResourceFinder rf;
+    rf.configure(argc,argv);
+    if (rf.check("help"))
+    {
+        cout << "Options:" << endl;
+        cout << "--config file: convert the links file into a FixedChain definition" << endl;
+        cout << "--samples n: number of configurations used for the benchmark (default: 100000)" << endl;
+        return EXIT_SUCCESS;
+    }
+
+    if (rf.check("config"))
+        return convert(rf.findFile("config"));
+
+    // build up the equivalent iKinChain
+    vector<iKinLink> links;
+    for (size_t i=0; i<rightArmLinks.size(); i++)
+    {
+        const DHLink &l=rightArmLinks[i];
+        links.push_back(iKinLink(l.A,l.D,l.alpha,l.offset,l.min,l.max));
+    }
+
+    iKinChain chain;
+    chain.setH0(toMatrix(rightArmH0));
+    for (auto &l:links)
+        chain<<l;
+    chain.setAllConstraints(false);
+
+    // draw the configurations within the joints bounds
+    int samples=rf.check("samples",Value(100000)).asInt32();
+    Rand::init();
+    vector<Vector> qs(samples,Vector(chain.getN()));
+    for (auto &q:qs)
+        for (size_t i=0; i<q.length(); i++)
+            q[i]=Rand::scalar(rightArmLinks[i].min,rightArmLinks[i].max);
+
+    // check the results
+    double errPose=0.0;
+    double errJac=0.0;
+    for (auto &q:qs)
+    {
+        Vector x=chain.EndEffPose(q);
+        Matrix J=chain.GeoJacobian();
+
+        double xf[7],Jf[6][10];
+        rightArm.EndEffPose(q.data(),xf);
+        rightArm.GeoJacobian(q.data(),Jf);
+
+        for (size_t i=0; i<x.length(); i++)
+            errPose=std::max(errPose,fabs(x[i]-xf[i]));
+        for (int r=0; r<J.rows(); r++)
+            for (int c=0; c<J.cols(); c++)
+                errJac=std::max(errJac,fabs(J(r,c)-Jf[r][c]));
+    }
+
+    cout << "max |EndEffPose difference|  = " << errPose << endl;
+    cout << "max |GeoJacobian difference| = " << errJac << endl;
+
+    // compare the performances
+    double t=SystemClock::nowSystem();
+    for (auto &q:qs)
+    {
+        chain.setAng(q);
+        chain.EndEffPose();
+        chain.GeoJacobian();
+    }
+    double dt_iKin=SystemClock::nowSystem()-t;
+
+    double chk=0.0;
+    t=SystemClock::nowSystem();
+    for (auto &q:qs)
+    {
+        double xf[7],Jf[6][10];
+        rightArm.EndEffPose(q.data(),xf);
+        rightArm.GeoJacobian(q.data(),Jf);
+        chk+=xf[0]+Jf[0][0];
+    }
+    double dt_fixed=SystemClock::nowSystem()-t;
+
+    cout << "iKinChain:     " << 1e6*dt_iKin/samples << " [us] per EndEffPose+GeoJacobian" << endl;
+    cout << "FixedChain<" << rightArm.getN() << ">: " << 1e6*dt_fixed/samples << " [us] per EndEffPose+GeoJacobian"
+         << " (x" << dt_iKin/dt_fixed << ", checksum " << chk << ")" << endl;
+
+    return EXIT_SUCCESS;
+}
@@ -13,16 +13,26 @@
  */ 
 
 #include <cmath>
+#include <limits>
+#include <atomic>
+#include <thread>
+#include <functional>
+#include <string>
+#include <vector>
 #include <iostream>
 #include <iomanip>
 
+#include <yarp/os/ResourceFinder.h>
 #include <yarp/os/SystemClock.h>
 #include <yarp/sig/Vector.h>
 #include <yarp/math/Math.h>
+#include <yarp/math/Rand.h>
 
 #include <iCub/iKin/iKinFwd.h>
 #include <iCub/iKin/iKinIpOpt.h>
 
+#include <iKinCache.h>
+
 using namespace std;
 using namespace yarp::os;
 using namespace yarp::sig;
@@ -80,8 +90,91 @@ protected:
 };
 
 
-int main()
+// the error between the target and the achieved pose, both in
+// axis-angle representation: the position error [m] plus the angle
+// of the rotation bringing the achieved orientation onto the target
+// one [rad], weighted by oriWeight [m/rad] as in iKinCache
+double poseError(const Vector &xd, const Vector &x, const double oriWeight=0.1)
+{
+    Matrix Rd=yarp::math::axis2dcm(xd.subVector(3,6));
+    Matrix R=yarp::math::axis2dcm(x.subVector(3,6));
+    Vector r=yarp::math::dcm2axis(Rd*R.transposed());
+    return norm(xd.subVector(0,2)-x.subVector(0,2))+oriWeight*fabs(r[3]);
+}
+
+
+// this function shows how to run several independent IpOpt
+// minimizations in parallel, each of them seeded with a different
+// starting configuration randomly drawn within the joints bounds.
+// Due to the redundancy, different seeds may lead to different
+// solutions: we retain the one that better achieves the target
+// according to poseError().
+// Each worker operates on its own copy of the limb since the solver
+// manipulates the chain it is attached to.
+// The linear solver of IpOpt must be thread-safe for nThreads>1
+// (see BatchSolver in iKin/batchSolver).
+Vector multiStartSolve(iKinLimb &limb, const Vector &xd, const unsigned int K,
+                       const unsigned int nThreads, double &cost)
 {
+    iKinChain &chain=*limb.asChain();
+
+    // the seeds are drawn beforehand, the first one being
+    // the current configuration as in the single-start case
+    vector<Vector> seeds(K,chain.getAng());
+    for (unsigned int k=1; k<K; k++)
+        for (unsigned int i=0; i<chain.getDOF(); i++)
+            seeds[k][i]=Rand::scalar(chain(i).getMin(),chain(i).getMax());
+
+    // one copy of the limb for each worker of the pool
+    unsigned int nWorkers=std::max(1U,std::min(nThreads,K));
+    vector<iKinLimb> limbs(nWorkers,limb);
+
+    vector<Vector> solutions(K);
+    vector<double> costs(K,numeric_limits<double>::infinity());
+    atomic<unsigned int> idx(0);
+
+    auto worker=[&](iKinLimb &lmb)
+    {
+        iKinChain *chn=lmb.asChain();
+        iKinIpOptMin slv(*chn,IKINCTRL_POSE_FULL,1e-3,1e-6,100);
+        slv.setUserScaling(true,100.0,100.0,100.0);
+
+        for (unsigned int k=idx++; k<K; k=idx++)
+        {
+            Vector x=xd;
+            solutions[k]=slv.solve(seeds[k],x);
+            costs[k]=poseError(xd,chn->EndEffPose(solutions[k]));
+        }
+    };
+
+    vector<thread> pool;
+    for (auto &lmb:limbs)
+        pool.push_back(thread(worker,ref(lmb)));
+    for (auto &t:pool)
+        t.join();
+
+    unsigned int best=0;
+    for (unsigned int k=1; k<K; k++)
+        if (costs[k]<costs[best])
+            best=k;
+
+    cost=costs[best];
+    return solutions[best];
+}
+
+
+// Options:
+// -) --threads n: the number of concurrent multi-start solves
+//    (default: 0, i.e. all the cores; see multiStartSolve() on
+//    the linear solver).
+// -) --cache file: the file where the solutions are stored between
+//    runs (default: fwInvKinematics_cache.ini).
+int main(int argc, char *argv[])
+{
+    ResourceFinder rf;
+    rf.configure(argc,argv);
+
+
     // some useful variables
     Vector q0,qf,qhat,xf,xhat;
 
@@ -98,11 +191,12 @@ int main()
     // [] or () operators. This prevent the user from adding/removing links
     // to iCub limbs as well as changing their properties too easily.
     // Anyway, arm object is affected by modifications on the chain.
-    iKinChain *chain;
+    iKinLimb *limb;
     if (true)   // selector
-        chain=genArm.asChain();
+        limb=&genArm;
     else
-        chain=libArm.asChain();
+        limb=&libArm;
+    iKinChain *chain=limb->asChain();
 
     // get initial joints configuration
     q0=chain->getAng();
@@ -191,6 +285,67 @@ int main()
     cout << "||xf-K(qhat)||=" << norm(xf-xhat) << endl;
     cout << "Solved in " << dt << " [s]" << endl;
 
+    // the same problem can be tackled by starting from multiple
+    // seeds at once in order to escape from local minima
+    const unsigned int K=8;
+    int threads=rf.check("threads",Value(0)).asInt32();
+    const unsigned int nThreads=(threads>0)?(unsigned int)threads:
+                                std::max(1U,thread::hardware_concurrency());
+    double cost;
+
+    Rand::init();
+    chain->setAng(q0);
+    t=SystemClock::nowSystem();
+    Vector qbest=multiStartSolve(*limb,xf,K,nThreads,cost);
+    double dt_multi=SystemClock::nowSystem()-t;
+
+    cout << endl;
+    cout << "Multi-start (" << K << " seeds on " << nThreads << " threads)" << endl;
+    cout << "qbest: " << (CTRL_RAD2DEG*qbest).toString() << endl;
+    cout << "poseError(xf,K(qbest))=" << cost << " (poseError(xf,K(qhat))=" << poseError(xf,xhat) << ")" << endl;
+    cout << "Solved in " << dt_multi << " [s] (single-start: " << dt << " [s])" << endl;
+
+    // the solutions can be stored in a cache indexed by the targets
+    // and saved on disk between runs: a target already visited is
+    // then served straightaway, while a nearby target can be solved
+    // starting from the closest known solution
+    string cacheFile=rf.check("cache",Value("fwInvKinematics_cache.ini")).asString();
+    iKinCache cache(IKINCTRL_POSE_FULL);
+    cache.load(cacheFile,chain->getDOF());
+    cache.insert(xf,qbest);
+
+    // a target 1 cm away from xf is not in the cache
+    // (unless visited in previous runs), but xf is close
+    // enough to provide the initial guess
+    Vector xf_near=xf;
+    xf_near[0]+=0.01;
+
+    Vector qcached;
+    t=SystemClock::nowSystem();
+    bool hit=cache.lookup(xf_near,qcached);
+    double dt_hit=SystemClock::nowSystem()-t;
+
+    chain->setAng(q0);
+    t=SystemClock::nowSystem();
+    slv.solve(chain->getAng(),xf_near);
+    double dt_cold=SystemClock::nowSystem()-t;
+
+    Vector qseed=q0;
+    bool seeded=cache.getSeed(xf_near,0.05,qseed);
+    chain->setAng(q0);
+    t=SystemClock::nowSystem();
+    Vector qnear=slv.solve(qseed,xf_near);
+    double dt_warm=SystemClock::nowSystem()-t;
+    cache.insert(xf_near,qnear);
+
+    cout << endl;
+    cout << "Cache with " << cache.size() << " solutions" << endl;
+    cout << "Lookup of the nearby target: " << (hit?"hit":"miss") << " in " << dt_hit << " [s]" << endl;
+    cout << "Nearby target solved in " << dt_warm << " [s] with "
+         << (seeded?"warm start":"no seed") << " (" << dt_cold << " [s] from q0)" << endl;
+
+    cache.save(cacheFile);
+
     return 0;
 }
 
@@ -15,6 +15,13 @@
  * -) /ctrl/v:o    output the velocity profiles that steer the joints to the final configuration [deg/s] (to be connected to the robot)
  * -) /ctrl/x:o    output the current end-effector position in axis-angle format
  *
+ * If the option --cache is given, the solutions found by the Solver are stored
+ * in a cache that is loaded at startup and saved on exit: targets already visited
+ * starting from the same joints configuration are then served without running
+ * the optimizer, whereas targets close to known ones are solved starting from the
+ * closest stored solution. Only the solutions the optimizer converged to are
+ * stored.
+ *
  *
  * \author Ugo Pattacini
  * 
@@ -37,6 +44,10 @@
 #include <iCub/iKin/iKinInv.h>
 #include <iCub/iKin/iKinIpOpt.h>
 
+#include <IpReturnCodes.hpp>
+
+#include <iKinCache.h>
+
 using namespace std;
 using namespace yarp::os;
 using namespace yarp::sig;
@@ -124,6 +135,8 @@ protected:
     iKinLimb       *limb;
     iKinChain      *chain;
     iKinIpOptMin   *slv;
+    iKinCache      *cache;
+    double          cacheRadius;
     exchangeData   *commData;
 
     inPort         *port_q;
@@ -140,6 +153,8 @@ public:
         limb=NULL;
         chain=NULL;
         slv=NULL;
+        cache=NULL;
+        cacheRadius=0.0;
     }
 
     /*****************************************************************/
@@ -183,6 +198,17 @@ public:
         // of constraints and the hessian of lagrangian in norm between 0.1 and 10.0)
         slv->setUserScaling(true,100.0,100.0,100.0);
 
+        // the cache of the solutions is optional
+        if (rf.check("cache"))
+        {
+            cache=new iKinCache(ctrlPose,1e-6,rf.check("cache_ori_weight",Value(0.1)).asFloat64());
+            cacheRadius=rf.check("cache_radius",Value(0.05)).asFloat64();
+            if (cache->load(rf.find("cache").asString(),chain->getDOF()))
+                fprintf(stdout,"Loaded %d solutions from the cache\n",(int)cache->size());
+            else
+                fprintf(stdout,"No solutions loaded from the cache\n");
+        }
+
         port_xd.open("/"+name+"/xd:i");
         port_xd.useCallback();
         port_xd.set_vect(xd_old);
@@ -217,9 +243,27 @@ public:
             Vector q0=chain->getAng();
             Vector w_3rd(chain->getDOF(),1.0);
 
-            // call the solver and start the convergence from the current point
-            Vector dummyVect(1);
-            Vector qdhat=slv->solve(q0,xd,0.0,dummyVect,dummyVect,0.01,q0,w_3rd);
+            // the solution depends on q0 as well through the
+            // minimization against the current joints position
+            Vector qdhat;
+            if ((cache==NULL) || !cache->lookup(xd,qdhat,q0))
+            {
+                // start the convergence from the solution of the closest
+                // target stored in the cache, if any, or from the current point
+                Vector qseed=q0;
+                if (cache!=NULL)
+                    cache->getSeed(xd,cacheRadius,qseed);
+
+                // call the solver
+                Vector dummyVect(1);
+                int exit_code;
+                qdhat=slv->solve(qseed,xd,0.0,dummyVect,dummyVect,0.01,q0,w_3rd,&exit_code);
+
+                bool converged=(exit_code==Ipopt::Solve_Succeeded) ||
+                               (exit_code==Ipopt::Solved_To_Acceptable_Level);
+                if ((cache!=NULL) && converged)
+                    cache->insert(xd,qdhat,q0);
+            }
 
             // qdhat is an estimation of the real qd, so that xdhat is the actual achieved pose
             Vector xdhat=chain->EndEffPose(qdhat);
@@ -244,6 +288,12 @@ public:
         port_xd.close();
         port_qd.close();
 
+        if (cache!=NULL)
+        {
+            cache->save(rf.find("cache").asString());
+            delete cache;
+        }
+
         delete slv;
         delete limb;
     }
@@ -446,6 +496,9 @@ int main(int argc, char *argv[])
         fprintf(stdout,"\t--config  file: specify the file containing the DH parameters of the links (default: \"config.ini\")\n");
         fprintf(stdout,"\t--T       time: specify the task execution time in seconds (default: 2.0)\n");
         fprintf(stdout,"\t--onlyXYZ     : disable orientation control\n");
+        fprintf(stdout,"\t--cache   file: store the solutions in the given file and reuse them\n");
+        fprintf(stdout,"\t--cache_radius r: max distance [m] of a stored target to be used as initial guess (default: 0.05)\n");
+        fprintf(stdout,"\t--cache_ori_weight w: weight [m/rad] of the orientation within the distance (default: 0.1)\n");
 
         return 0;
     }
@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2019 Fondazione Istituto Italiano di Tecnologia (IIT)
+ * All Rights Reserved.
+ * Authors: Ugo Pattacini <ugo.pattacini@iit.it>
+ */
+
+#ifndef __IKINCACHE_H__
+#define __IKINCACHE_H__
+
+#include <string>
+#include <vector>
+
+#include <yarp/sig/Vector.h>
+
+/**
+ * This class stores the solutions of the inverse kinematics
+ * indexed by the target poses within a k-d tree, so that
+ * already visited targets can be served straightaway while
+ * nearby targets can profit from a warm start.
+ *
+ * The distance between two targets is the euclidean distance
+ * between their positions [m] and their orientations, the latter
+ * expressed as rotation vectors [rad] and weighted by a length
+ * [m/rad] that tells how far in space one radian is deemed to be:
+ * the tolerance and the radius are both in meters then.
+ *
+ * When the solver also minimizes against a rest posture, the
+ * solution depends on that posture as well: it can be stored along
+ * with the solution, so that a target is served straightaway only
+ * if it was solved against the same rest posture. The weights of
+ * the rest task are not stored and are supposed not to change.
+ */
+class iKinCache
+{
+protected:
+    struct Node
+    {
+        yarp::sig::Vector xd;
+        yarp::sig::Vector key;
+        yarp::sig::Vector q;
+        yarp::sig::Vector qRest;
+        int left,right;
+    };
+
+    std::vector<Node> nodes;
+    unsigned int ctrlPose;
+    double tol;
+    double oriWeight;
+    double restTol;
+
+    yarp::sig::Vector getKey(const yarp::sig::Vector &xd) const;
+    void search(const int idx, const unsigned int depth, const yarp::sig::Vector &key,
+                int &best, double &bestDist2) const;
+    int nearest(const yarp::sig::Vector &xd, double &dist) const;
+
+public:
+    /**
+     * Constructor. 
+     * @param ctrlPose IKINCTRL_POSE_FULL => complete pose 
+     *                 IKINCTRL_POSE_XYZ  => only the position is
+     *                 taken into account to index the targets.
+     * @param tol the distance below which two targets are deemed 
+     *            equal [m].
+     * @param oriWeight the weight of the orientation error within
+     *                  the distance [m/rad]; e.g. with 0.1, an
+     *                  error of 0.1 rad counts as much as 1 cm.
+     * @param restTol the largest difference between the joints of 
+     *                two rest postures deemed equal [rad].
+     */
+    iKinCache(const unsigned int ctrlPose, const double tol=1e-6,
+              const double oriWeight=0.1, const double restTol=1e-6);
+
+    /**
+     * Look for a target already solved.
+     * @param xd the target pose in axis-angle representation.
+     * @param q the stored solution in case of hit.
+     * @param qRest the rest posture the solution is required to be 
+     *              found against; empty if the solver has no rest
+     *              task.
+     * @return true iff the target is in the cache and was solved 
+     *         against the same rest posture.
+     */
+    bool lookup(const yarp::sig::Vector &xd, yarp::sig::Vector &q,
+                const yarp::sig::Vector &qRest=yarp::sig::Vector(0)) const;
+
+    /**
+     * Retrieve the solution of the closest target, to be used as 
+     * initial guess for the solver.
+     * @param xd the target pose in axis-angle representation.
+     * @param radius the maximum allowed distance from xd [m].
+     * @param q the solution of the closest target.
+     * @return true iff a target within the given radius is found.
+     */
+    bool getSeed(const yarp::sig::Vector &xd, const double radius,
+                 yarp::sig::Vector &q) const;
+
+    /**
+     * Store a new solution, replacing the existing one if the 
+     * target is already in the cache.
+     * @param xd the target pose in axis-angle representation.
+     * @param q the solution.
+     * @param qRest the rest posture the solution was found against;
+     *              empty if the solver has no rest task.
+     */
+    void insert(const yarp::sig::Vector &xd, const yarp::sig::Vector &q,
+                const yarp::sig::Vector &qRest=yarp::sig::Vector(0));
+
+    /**
+     * Return the number of stored solutions.
+     */
+    size_t size() const { return nodes.size(); }
+
+    /**
+     * Remove all the stored solutions.
+     */
+    void clear() { nodes.clear(); }
+
+    /**
+     * Load the solutions from file.
+     * @param fileName the file name.
+     * @param dof the number of DOF of the chain the solutions are 
+     *            meant for.
+     * @return true/false on success/failure; the cache is left 
+     *         empty if any entry does not match the pose size or
+     *         the DOF.
+     */
+    bool load(const std::string &fileName, const unsigned int dof);
+
+    /**
+     * Save the solutions to file.
+     * @param fileName the file name.
+     * @return true/false on success/failure.
+     */
+    bool save(const std::string &fileName) const;
+};
+
+#endif
+
+
@@ -0,0 +1,259 @@
+/*
+ * Copyright (C) 2019 Fondazione Istituto Italiano di Tecnologia (IIT)
+ * All Rights Reserved.
+ * Authors: Ugo Pattacini <ugo.pattacini@iit.it>
+ */
+
+#include <iKinCache.h>
+
+#include <cmath>
+#include <limits>
+#include <fstream>
+
+#include <yarp/os/Bottle.h>
+#include <iCub/iKin/iKinInv.h>
+
+using namespace std;
+using namespace yarp::os;
+using namespace yarp::sig;
+using namespace iCub::iKin;
+
+/**********************************************************/
+iKinCache::iKinCache(const unsigned int ctrlPose, const double tol,
+                     const double oriWeight, const double restTol) :
+                     ctrlPose(ctrlPose), tol(tol), oriWeight(oriWeight),
+                     restTol(restTol)
+{
+}
+
+/**********************************************************/
+Vector iKinCache::getKey(const Vector &xd) const
+{
+    // the orientation in axis-angle is mapped onto
+    // the rotation vector so as to let the euclidean
+    // distance be meaningful, and then weighted to be
+    // commensurate with the position
+    Vector key((ctrlPose==IKINCTRL_POSE_FULL)?6:3,0.0);
+    for (size_t i=0; (i<3) && (i<xd.length()); i++)
+        key[i]=xd[i];
+
+    if ((key.length()>3) && (xd.length()>=7))
+        for (size_t i=3; i<6; i++)
+            key[i]=oriWeight*xd[6]*xd[i];
+
+    return key;
+}
+
+/**********************************************************/
+void iKinCache::search(const int idx, const unsigned int depth, const Vector &key,
+                       int &best, double &bestDist2) const
+{
+    if (idx<0)
+        return;
+
+    const Node &node=nodes[idx];
+    double dist2=0.0;
+    for (size_t i=0; i<key.length(); i++)
+        dist2+=(key[i]-node.key[i])*(key[i]-node.key[i]);
+
+    if (dist2<bestDist2)
+    {
+        best=idx;
+        bestDist2=dist2;
+    }
+
+    size_t axis=depth%key.length();
+    double d=key[axis]-node.key[axis];
+    int nearIdx=(d<0.0)?node.left:node.right;
+    int farIdx=(d<0.0)?node.right:node.left;
+
+    search(nearIdx,depth+1,key,best,bestDist2);
+
+    // visit the other branch only if the splitting
+    // plane is closer than the current best
+    if (d*d<bestDist2)
+        search(farIdx,depth+1,key,best,bestDist2);
+}
+
+/**********************************************************/
+int iKinCache::nearest(const Vector &xd, double &dist) const
+{
+    int best=-1;
+    double bestDist2=numeric_limits<double>::infinity();
+    if (!nodes.empty())
+        search(0,0,getKey(xd),best,bestDist2);
+
+    dist=sqrt(bestDist2);
+    return best;
+}
+
+/**********************************************************/
+bool iKinCache::lookup(const Vector &xd, Vector &q, const Vector &qRest) const
+{
+    double dist;
+    int idx=nearest(xd,dist);
+    if ((idx<0) || (dist>tol))
+        return false;
+
+    const Vector &stored=nodes[idx].qRest;
+    if (stored.length()!=qRest.length())
+        return false;
+
+    for (size_t i=0; i<qRest.length(); i++)
+        if (fabs(stored[i]-qRest[i])>restTol)
+            return false;
+
+    q=nodes[idx].q;
+    return true;
+}
+
+/**********************************************************/
+bool iKinCache::getSeed(const Vector &xd, const double radius, Vector &q) const
+{
+    double dist;
+    int idx=nearest(xd,dist);
+    if ((idx>=0) && (dist<=radius))
+    {
+        q=nodes[idx].q;
+        return true;
+    }
+    else
+        return false;
+}
+
+/**********************************************************/
+void iKinCache::insert(const Vector &xd, const Vector &q, const Vector &qRest)
+{
+    double dist;
+    int idx=nearest(xd,dist);
+    if ((idx>=0) && (dist<=tol))
+    {
+        nodes[idx].q=q;
+        nodes[idx].qRest=qRest;
+        return;
+    }
+
+    Node node;
+    node.xd=xd;
+    node.key=getKey(xd);
+    node.q=q;
+    node.qRest=qRest;
+    node.left=node.right=-1;
+    nodes.push_back(node);
+
+    int newIdx=(int)nodes.size()-1;
+    if (newIdx==0)
+        return;
+
+    // descend the tree down to the leaf
+    // where the new node is to be attached
+    idx=0;
+    for (unsigned int depth=0;; depth++)
+    {
+        size_t axis=depth%node.key.length();
+        int &child=(node.key[axis]<nodes[idx].key[axis])?
+                   nodes[idx].left:nodes[idx].right;
+        if (child<0)
+        {
+            child=newIdx;
+            break;
+        }
+
+        idx=child;
+    }
+}
+
+/**********************************************************/
+bool iKinCache::load(const string &fileName, const unsigned int dof)
+{
+    ifstream fin(fileName.c_str());
+    if (!fin.is_open())
+        return false;
+
+    clear();
+
+    // a list is accepted only with the given length and all numbers
+    auto toVector=[](const Bottle *b, const size_t len, Vector &v)
+    {
+        if ((b==NULL) || (b->size()!=len))
+            return false;
+
+        v.resize(len);
+        for (size_t i=0; i<len; i++)
+        {
+            if (!b->get(i).isFloat64() && !b->get(i).isInt32())
+                return false;
+            v[i]=b->get(i).asFloat64();
+        }
+
+        return true;
+    };
+
+    string line;
+    while (getline(fin,line))
+    {
+        Bottle b(line);
+        if (b.size()==0)
+            continue;
+
+        // the targets are in axis-angle representation, unless only
+        // the position is indexed, in which case they may be [x y z]
+        Bottle *bxd=b.find("xd").asList();
+        size_t len=((ctrlPose==IKINCTRL_POSE_XYZ) && (bxd!=NULL) && (bxd->size()==3))?3:7;
+
+        Vector xd,q,qRest;
+        if (!toVector(bxd,len,xd) || !toVector(b.find("q").asList(),dof,q))
+        {
+            clear();
+            return false;
+        }
+
+        if (b.check("qRest") && !toVector(b.find("qRest").asList(),dof,qRest))
+        {
+            clear();
+            return false;
+        }
+
+        insert(xd,q,qRest);
+    }
+
+    return true;
+}
+
+/**********************************************************/
+bool iKinCache::save(const string &fileName) const
+{
+    ofstream fout(fileName.c_str());
+    if (!fout.is_open())
+        return false;
+
+    for (auto &node:nodes)
+    {
+        Bottle b;
+        Bottle &bxd=b.addList();
+        bxd.addString("xd");
+        Bottle &xd=bxd.addList();
+        for (size_t i=0; i<node.xd.length(); i++)
+            xd.addFloat64(node.xd[i]);
+
+        Bottle &bq=b.addList();
+        bq.addString("q");
+        Bottle &q=bq.addList();
+        for (size_t i=0; i<node.q.length(); i++)
+            q.addFloat64(node.q[i]);
+
+        if (node.qRest.length()>0)
+        {
+            Bottle &bqRest=b.addList();
+            bqRest.addString("qRest");
+            Bottle &qRest=bqRest.addList();
+            for (size_t i=0; i<node.qRest.length(); i++)
+                qRest.addFloat64(node.qRest[i]);
+        }
+
+        fout<<b.toString()<<endl;
+    }
+
+    return true;
+}
+
@@ -0,0 +1,228 @@
+/**
+ * @ingroup icub_tutorials
+ *
+ * \defgroup icub_multiLimbSolver Multi-limb Batch Solver
+ *
+ * A tutorial on how to host the inverse kinematics solvers of
+ * several limbs in one single process. All the solvers share the
+ * same pool of workers, so that requests addressed to different
+ * limbs (e.g. left and right arm) are served by the same threads
+ * instead of one pool per limb. This bounds the number of threads
+ * only: each IpOpt instance is bound to the chain of its limb, hence
+ * every solver keeps one copy of its limb along with one IpOpt
+ * instance per worker, i.e. parts x threads instances overall, as
+ * many as with one pool per limb of the same size.
+ *
+ * Each limb is served on the port /<name>/<part>/batch:rpc:
+ * \code
+ * multiLimbSolver --parts "(left_arm right_arm)" --threads 4
+ * \endcode
+ * The pool is made up of one worker per part unless --threads
+ * says otherwise, so that the limbs are served concurrently; see
+ * BatchSolver on the linear solver of IpOpt.
+ *
+ * The option --demo streams batches to both arms at the same
+ * time and compares the result with serving them one after the
+ * other; with one single worker the two timings are alike.
+ *
+ * \author Ugo Pattacini
+ *
+ * CopyPolicy: Released under the terms of GPL 2.0 or later
+ */
+
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+
+#include <yarp/os/all.h>
+#include <yarp/sig/all.h>
+#include <iCub/iKin/iKinFwd.h>
+#include <iCub/iKin/iKinHlp.h>
+
+#include <batchSolver.h>
+
+using namespace std;
+using namespace yarp::os;
+using namespace yarp::sig;
+using namespace iCub::iKin;
+
+/****************************************************************/
+class MultiLimbSolver : public RFModule
+{
+    shared_ptr<WorkerPool> pool;
+    vector<unique_ptr<BatchSolver>> solvers;
+    vector<string> parts;
+    string name;
+    int targets;
+
+    /****************************************************************/
+    unique_ptr<iKinLimb> createLimb(const string &part) const
+    {
+        size_t sep=part.find('_');
+        if (sep==string::npos)
+            return nullptr;
+
+        string type=part.substr(0,sep);
+        string kinematics=part.substr(sep+1);
+        if (kinematics=="arm")
+            return unique_ptr<iKinLimb>(new iCubArm(type));
+        else if (kinematics=="leg")
+            return unique_ptr<iKinLimb>(new iCubLeg(type));
+        else
+            return nullptr;
+    }
+
+    /****************************************************************/
+    void demo(const int N)
+    {
+        // one client per limb, each with its own batch of targets
+        vector<unique_ptr<Port>> clients;
+        vector<Bottle> cmds(parts.size());
+        for (size_t i=0; i<parts.size(); i++)
+        {
+            clients.push_back(unique_ptr<Port>(new Port));
+            clients[i]->open("/"+name+"/"+parts[i]+"/demo");
+            Network::connect(clients[i]->getName(),"/"+name+"/"+parts[i]+"/batch:rpc");
+
+            Vector xd(3);
+            xd[0]=-0.3; xd[2]=0.1;
+            cmds[i].addVocab32(BATCHSLV_VOCAB_CMD_BATCH);
+            for (int j=0; j<N; j++)
+            {
+                xd[1]=(parts[i].find("left")==0?-0.1:0.1)*(1.0+j/(double)N);
+                CartesianHelper::addTargetOption(cmds[i].addList(),xd);
+            }
+        }
+
+        double t0=SystemClock::nowSystem();
+        for (size_t i=0; i<parts.size(); i++)
+        {
+            Bottle reply;
+            clients[i]->write(cmds[i],reply);
+        }
+        double dt_seq=SystemClock::nowSystem()-t0;
+
+        t0=SystemClock::nowSystem();
+        vector<thread> streams;
+        for (size_t i=0; i<parts.size(); i++)
+        {
+            streams.push_back(thread([&clients,&cmds,i]()
+            {
+                Bottle reply;
+                clients[i]->write(cmds[i],reply);
+            }));
+        }
+        for (auto &s:streams)
+            s.join();
+        double dt_con=SystemClock::nowSystem()-t0;
+
+        yInfo()<<parts.size()<<"limbs x"<<N<<"targets:"
+               <<"sequential"<<dt_seq<<"[s],"
+               <<"concurrent"<<dt_con<<"[s]";
+
+        for (auto &c:clients)
+            c->close();
+    }
+
+public:
+    /****************************************************************/
+    MultiLimbSolver() : targets(0) { }
+
+    /****************************************************************/
+    bool configure(ResourceFinder &rf) override
+    {
+        name=rf.check("name",Value("multiSolver")).asString();
+
+        parts.clear();
+        if (Bottle *b=rf.find("parts").asList())
+        {
+            for (size_t i=0; i<b->size(); i++)
+                parts.push_back(b->get(i).asString());
+        }
+        else
+        {
+            parts.push_back("left_arm");
+            parts.push_back("right_arm");
+        }
+
+        int nThreads=rf.check("threads",Value((int)parts.size())).asInt32();
+        pool=make_shared<WorkerPool>((unsigned int)std::max(1,nThreads));
+
+        for (auto &part:parts)
+        {
+            unique_ptr<iKinLimb> limb=createLimb(part);
+            if (limb==nullptr)
+            {
+                yError()<<"unknown part"<<part;
+                return false;
+            }
+
+            Property options;
+            options.put("name",name+"/"+part);
+            options.put("pose",rf.check("pose",Value("xyz")).asString());
+            options.put("tol",rf.check("tol",Value(1e-3)).asFloat64());
+            options.put("maxIter",rf.check("maxIter",Value(200)).asInt32());
+
+            solvers.push_back(unique_ptr<BatchSolver>(new BatchSolver(*limb)));
+            if (!solvers.back()->open(options,pool))
+            {
+                yError()<<"unable to open the solver for"<<part;
+                return false;
+            }
+        }
+
+        yInfo()<<parts.size()<<"limbs served by"<<pool->size()<<"workers"
+               <<"with"<<parts.size()*pool->size()<<"IpOpt instances";
+
+        targets=rf.check("demo")?rf.check("targets",Value(100)).asInt32():0;
+        return true;
+    }
+
+    /****************************************************************/
+    double getPeriod() override
+    {
+        return 1.0;
+    }
+
+    /****************************************************************/
+    bool updateModule() override
+    {
+        if (targets>0)
+        {
+            demo(targets);
+            return false;
+        }
+
+        return true;
+    }
+
+    /****************************************************************/
+    bool close() override
+    {
+        // the solvers need to go before the pool they share
+        solvers.clear();
+        pool.reset();
+        return true;
+    }
+};
+
+/****************************************************************/
+int main(int argc, char *argv[])
+{
+    Network yarp;
+    if (!yarp.checkNetwork())
+    {
+        yError()<<"YARP network does not seem to be available";
+        return EXIT_FAILURE;
+    }
+
+    ResourceFinder rf;
+    rf.configure(argc,argv);
+
+    MultiLimbSolver module;
+    return module.runModule(rf);
+}
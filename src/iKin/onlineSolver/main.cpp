@@ -11,12 +11,18 @@
  */ 
 
 #include <string>
+#include <deque>
 #include <iostream>
 #include <iomanip>
 
 #include <yarp/os/Network.h>
 #include <yarp/os/Port.h>
+#include <yarp/os/BufferedPort.h>
 #include <yarp/os/Bottle.h>
+#include <yarp/os/Property.h>
+#include <yarp/os/SystemClock.h>
+#include <yarp/dev/PolyDriver.h>
+#include <yarp/dev/ControlBoardInterfaces.h>
 #include <yarp/sig/Vector.h>
 #include <yarp/math/Math.h>
 
@@ -24,8 +30,11 @@
 #include <iCub/iKin/iKinHlp.h>
 #include <iCub/iKin/iKinSlv.h>
 
+#include <batchSolver.h>
+
 using namespace std;
 using namespace yarp::os;
+using namespace yarp::dev;
 using namespace yarp::sig;
 using namespace yarp::math;
 using namespace iCub::iKin;
@@ -119,8 +128,151 @@ int main()
     cout<<"q [deg] ="<<CartesianHelper::getJointsOption(reply)->toString()<<endl;
     cout<<endl;
 
+    // when many targets need to be evaluated (e.g. by a planner),
+    // they can be sent in one single message to a batch solver that
+    // processes them in parallel and returns all the solutions at once,
+    // sparing one round-trip per target
+    // the batch solver works on its own copy of the limb, which
+    // has to be given the same joints bounds and configuration the
+    // online solver retrieves from the robot, as otherwise the
+    // solutions of the two solvers would not be comparable
+    iCubArm arm("right");
+
+    Property torsoOptions("(device remote_controlboard)");
+    torsoOptions.put("remote","/icubSim/torso");
+    torsoOptions.put("local","/batch/torso");
+
+    Property armOptions("(device remote_controlboard)");
+    armOptions.put("remote","/icubSim/right_arm");
+    armOptions.put("local","/batch/right_arm");
+
+    PolyDriver torsoDriver,armDriver;
+    if (!torsoDriver.open(torsoOptions) || !armDriver.open(armOptions))
+    {
+        onlineSolver.close();
+        return 1;
+    }
+
+    IControlLimits *torsoLim,*armLim;
+    IEncoders *torsoEnc,*armEnc;
+    torsoDriver.view(torsoLim); torsoDriver.view(torsoEnc);
+    armDriver.view(armLim);     armDriver.view(armEnc);
+
+    deque<IControlLimits*> lim;
+    lim.push_back(torsoLim);
+    lim.push_back(armLim);
+    arm.alignJointsBounds(lim);
+
+    // the torso joints come in reversed order within the chain;
+    // the blocked links are set as well through the [] operators
+    int nTorso,nArm;
+    torsoEnc->getAxes(&nTorso);
+    armEnc->getAxes(&nArm);
+    Vector qTorso(nTorso),qArm(nArm);
+    torsoEnc->getEncoders(qTorso.data());
+    armEnc->getEncoders(qArm.data());
+
+    iKinChain &armChain=*arm.asChain();
+    for (unsigned int i=0; i<armChain.getN(); i++)
+        armChain[i].setAng(CTRL_DEG2RAD*((i<3)?qTorso[2-i]:qArm[i-3]));
+
+    torsoDriver.close();
+    armDriver.close();
+
+    BatchSolver batchSolver(arm);
+
+    Property batchOptions;
+    batchOptions.put("name","solver");
+    batchOptions.put("pose","xyz");
+    if (!batchSolver.open(batchOptions))
+    {
+        onlineSolver.close();
+        return 1;
+    }
+
+    Port batch;
+    batch.open("/batch");
+    Network::connect(batch.getName(),"/solver/batch:rpc");
+
+    // timings, iterations and residuals of the served
+    // requests are streamed out by the batch solver
+    BufferedPort<Bottle> telemetry;
+    telemetry.open("/telemetry");
+    Network::connect("/solver/telemetry:o",telemetry.getName());
+
+    // the targets lie on a segment and the torso is enabled for all of them
+    const int N=100;
+    cmd.clear();
+    cmd.addVocab32(BATCHSLV_VOCAB_CMD_BATCH);
+    for (int i=0; i<N; i++)
+    {
+        xd[1]=-0.1+(0.2*i)/(N-1);
+        Bottle &req=cmd.addList();
+        CartesianHelper::addTargetOption(req,xd);
+        CartesianHelper::addDOFOption(req,dof);
+    }
+
+    double t=SystemClock::nowSystem();
+    batch.write(cmd,reply);
+    double dt=SystemClock::nowSystem()-t;
+
+    cout<<"batch of "<<reply.size()-1<<" targets solved in "<<dt<<" [s]"<<endl;
+    if (Bottle *last=reply.get(reply.size()-1).asList())
+    {
+        cout<<"xd      ="<<CartesianHelper::getTargetOption(*last)->toString()<<endl;
+        cout<<"x       ="<<CartesianHelper::getEndEffectorPoseOption(*last)->toString()<<endl;
+        cout<<"q [deg] ="<<CartesianHelper::getJointsOption(*last)->toString()<<endl;
+    }
+    cout<<endl;
+
+    // the same batch can be exchanged in binary format,
+    // once the connection has been switched over
+    cmd.clear();
+    cmd.addVocab32(BATCHSLV_VOCAB_CMD_FORMAT);
+    cmd.addVocab32(BATCHSLV_VOCAB_VAL_BINARY);
+    batch.write(cmd,reply);
+
+    vector<BatchRequest> requests(N);
+    for (int i=0; i<N; i++)
+    {
+        xd[1]=-0.1+(0.2*i)/(N-1);
+        requests[i].xd=xd;
+        requests[i].dof=dof;
+    }
+
+    BatchPacket request,response;
+    request.fromRequests(requests);
+
+    t=SystemClock::nowSystem();
+    batch.write(request,response);
+    dt=SystemClock::nowSystem()-t;
+
+    vector<BatchResult> results;
+    response.toResults(results);
+    cout<<"batch of "<<results.size()<<" targets solved in "<<dt<<" [s] (binary)"<<endl;
+    if (!results.empty())
+    {
+        cout<<"xd      ="<<results.back().xd.toString(3,3)<<endl;
+        cout<<"x       ="<<results.back().x.toString(3,3)<<endl;
+        cout<<"q [deg] ="<<results.back().q.toString(3,3)<<endl;
+    }
+    cout<<endl;
+
+    // the connection can be switched back to Bottles
+    BatchFormat format(BATCHSLV_VOCAB_VAL_BOTTLE);
+    batch.write(format,reply);
+    cout<<"back to Bottle format: "<<reply.toString()<<endl;
+    cout<<endl;
+
+    if (Bottle *stats=telemetry.read())
+        cout<<"telemetry percentiles: "<<stats->findGroup("percentiles").tail().toString()<<endl;
+    cout<<endl;
+
     // close up
+    batchSolver.close();
     onlineSolver.close();
+    batch.close();
+    telemetry.close();
     in.close();
     out.close();
     rpc.close();
@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2019 Fondazione Istituto Italiano di Tecnologia (IIT)
+ * All Rights Reserved.
+ * Authors: Ugo Pattacini <ugo.pattacini@iit.it>
+ */
+
+#ifndef __REACHABILITYMAP_H__
+#define __REACHABILITYMAP_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <iCub/iKin/iKinFwd.h>
+
+/**
+ * This class handles a voxelized map of the positions reachable 
+ * by the end-effector of a limb, where each voxel stores the 
+ * number of sampled configurations that fell inside and the 
+ * maximum translational manipulability attained there. 
+ * The map is generated once offline and then accessed through a
+ * memory-mapped file, so that queries cost O(1). 
+ */
+class ReachabilityMap
+{
+public:
+    /**
+     * The layout of the file header.
+     */
+    struct Header
+    {
+        char     magic[8];
+        uint32_t version;
+        int32_t  size[3];
+        double   origin[3];
+        double   resolution;
+        uint64_t samples;
+        char     description[64];
+    };
+
+protected:
+    const Header   *header;
+    const uint32_t *hits;
+    const float    *manip;
+    std::vector<char> buffer;
+    void  *mapping;
+    size_t length;
+
+    long getIndex(const double *x) const;
+
+public:
+    /**
+     * Constructor.
+     */
+    ReachabilityMap();
+
+    /**
+     * Destructor.
+     */
+    ~ReachabilityMap();
+
+    /**
+     * Generate the map by sampling uniformly the joints space of a
+     * chain: blocked links are kept at their current angle and do 
+     * not contribute to the manipulability. All the threads update
+     * one single grid. 
+     * @param chain the chain.
+     * @param fileName the file where to store the map.
+     * @param resolution the voxel size [m].
+     * @param samples the number of configurations to be sampled.
+     * @param nThreads the number of threads used for the sampling.
+     * @param description a short description stored in the header.
+     * @return true/false on success/failure.
+     */
+    static bool generate(iCub::iKin::iKinChain &chain, const std::string &fileName,
+                         const double resolution, const size_t samples,
+                         const unsigned int nThreads, const std::string &description);
+
+    /**
+     * Map a file generated by generate() in memory.
+     * @param fileName the file name.
+     * @return true/false on success/failure.
+     */
+    bool open(const std::string &fileName);
+
+    /**
+     * Release the memory mapping.
+     */
+    void close();
+
+    /**
+     * Return true iff a map is currently open.
+     */
+    bool isOpen() const { return (header!=NULL); }
+
+    /**
+     * Return the header of the map currently open.
+     */
+    const Header &getHeader() const { return *header; }
+
+    /**
+     * Check whether a position has been reached by any sample.
+     * @param x the position [m].
+     * @return true iff the position is reachable.
+     */
+    bool isReachable(const double *x) const;
+
+    /**
+     * Return the number of samples that fell in the voxel of a 
+     * given position. 
+     * @param x the position [m].
+     * @return the number of samples.
+     */
+    uint32_t getHits(const double *x) const;
+
+    /**
+     * Return the maximum translational manipulability attained in 
+     * the voxel of a given position. 
+     * @param x the position [m].
+     * @return the manipulability (0 if unreachable).
+     */
+    double getManipulability(const double *x) const;
+};
+
+#endif
+
+
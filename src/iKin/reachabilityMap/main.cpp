@@ -0,0 +1,148 @@
+/**
+ * @ingroup icub_tutorials
+ *
+ * \defgroup icub_reachabilityMap Reachability Maps of iCub limbs
+ *
+ * A tutorial on how to precompute the workspace of iCub limbs 
+ * in order to tell straightaway whether a position can be 
+ * reached, without running the inverse kinematics solver. 
+ *
+ * The map is generated with:
+ * \code
+ * reachabilityMap --kinematics arm --type right --file right_arm.map
+ * \endcode
+ * and queried with:
+ * \code
+ * reachabilityMap --file right_arm.map --x "(-0.3 0.1 0.1)"
+ * \endcode
+ *
+ * \author Ugo Pattacini
+ * 
+ * CopyPolicy: Released under the terms of GPL 2.0 or later
+ */
+
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+#include <iostream>
+#include <algorithm>
+
+#include <yarp/os/all.h>
+#include <yarp/sig/all.h>
+#include <iCub/iKin/iKinFwd.h>
+
+#include <reachabilityMap.h>
+
+using namespace std;
+using namespace yarp::os;
+using namespace yarp::sig;
+using namespace iCub::iKin;
+
+/****************************************************************/
+int main(int argc, char *argv[])
+{
+    ResourceFinder rf;
+    rf.configure(argc, argv);
+    if (rf.check("help"))
+    {
+        cout << "Options:" << endl;
+        cout << "--kinematics eye|arm|leg" << endl;
+        cout << "--type left|right|left_v2|..." << endl;
+        cout << "--release: release all the links (e.g. the torso for the arm)" << endl;
+        cout << "--resolution res: voxel size in meters (default: 0.01)" << endl;
+        cout << "--samples n: number of sampled configurations (default: 10000000)" << endl;
+        cout << "--threads n: number of threads (default: all the cores)" << endl;
+        cout << "--file name: the map file (default: \"reachability.map\")" << endl;
+        cout << "--x \"(x y z)\": query the map for the given position instead of generating it" << endl;
+        return EXIT_SUCCESS;
+    }
+
+    string file = rf.check("file", Value("reachability.map")).asString();
+
+    // query mode
+    if (Bottle *b = rf.find("x").asList())
+    {
+        ReachabilityMap map;
+        if (!map.open(file))
+        {
+            cerr << "unable to open the map \"" << file << "\"" << endl;
+            return EXIT_FAILURE;
+        }
+
+        double x[3] = {0.0, 0.0, 0.0};
+        for (size_t i = 0; i < std::min((size_t)3, (size_t)b->size()); i++)
+        {
+            x[i] = b->get(i).asFloat64();
+        }
+
+        double t = SystemClock::nowSystem();
+        bool reachable = map.isReachable(x);
+        double dt = SystemClock::nowSystem() - t;
+
+        cout << "map=\"" << map.getHeader().description << "\"" << endl;
+        cout << "x=(" << x[0] << " " << x[1] << " " << x[2] << ") is "
+             << (reachable ? "reachable" : "not reachable")
+             << " (hits=" << map.getHits(x) << ", manipulability=" << map.getManipulability(x) << ")" << endl;
+        cout << "query answered in " << 1e6 * dt << " [us]" << endl;
+        return EXIT_SUCCESS;
+    }
+
+    // generation mode
+    string kinematics = rf.check("kinematics", Value("arm")).asString();
+    string type = rf.check("type", Value("right")).asString();
+
+    transform(kinematics.begin(), kinematics.end(), kinematics.begin(), ::tolower);
+    transform(type.begin(), type.end(), type.begin(), ::tolower);
+
+    if ((kinematics != "eye") && (kinematics != "arm") && (kinematics != "leg"))
+    {
+        cerr << "unrecognized kinematics \"" << kinematics << "\"" << endl;
+        return EXIT_FAILURE;
+    }
+
+    unique_ptr<iKinLimb> limb;
+    if (kinematics == "eye")
+    {
+        limb = unique_ptr<iKinLimb>(new iCubEye(type));
+    }
+    else if (kinematics == "arm")
+    {
+        limb = unique_ptr<iKinLimb>(new iCubArm(type));
+    }
+    else
+    {
+        limb = unique_ptr<iKinLimb>(new iCubLeg(type));
+    }
+
+    iKinChain* chain = limb->asChain();
+    if (rf.check("release"))
+    {
+        for (size_t i = 0; i < chain->getN(); i++)
+        {
+            chain->releaseLink(i);
+        }
+    }
+
+    double resolution = rf.check("resolution", Value(0.01)).asFloat64();
+    size_t samples = (size_t)rf.check("samples", Value(10000000)).asInt64();
+    unsigned int threads = std::max(1U, thread::hardware_concurrency());
+    threads = (unsigned int)rf.check("threads", Value((int)threads)).asInt32();
+
+    string description = kinematics + "/" + limb->getType();
+    cout << "Generating the map of \"" << description << "\" with " << chain->getDOF()
+         << " DOFs: " << samples << " samples on " << threads << " threads ..." << endl;
+
+    double t = SystemClock::nowSystem();
+    if (!ReachabilityMap::generate(*chain, file, resolution, samples, threads, description))
+    {
+        cerr << "unable to generate the map \"" << file << "\"" << endl;
+        return EXIT_FAILURE;
+    }
+    double dt = SystemClock::nowSystem() - t;
+
+    cout << "Map saved in \"" << file << "\" in " << dt << " [s] ("
+         << 1e9 * dt / samples << " [ns]/sample)" << endl;
+
+    return EXIT_SUCCESS;
+}
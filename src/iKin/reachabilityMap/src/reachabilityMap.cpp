@@ -0,0 +1,310 @@
+/*
+ * Copyright (C) 2019 Fondazione Istituto Italiano di Tecnologia (IIT)
+ * All Rights Reserved.
+ * Authors: Ugo Pattacini <ugo.pattacini@iit.it>
+ */
+
+#include <reachabilityMap.h>
+#include <batchChain.h>
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <random>
+#include <thread>
+#include <fstream>
+
+#if defined(_WIN32)
+    #include <iterator>
+#else
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+#endif
+
+#define REACHABILITYMAP_MAGIC   "RCHMAP"
+#define REACHABILITYMAP_VERSION 1
+
+using namespace std;
+using namespace yarp::sig;
+using namespace iCub::iKin;
+
+/**********************************************************/
+ReachabilityMap::ReachabilityMap() : header(NULL), hits(NULL), manip(NULL),
+                                     mapping(NULL), length(0)
+{
+}
+
+/**********************************************************/
+ReachabilityMap::~ReachabilityMap()
+{
+    close();
+}
+
+/**********************************************************/
+bool ReachabilityMap::generate(iKinChain &chain, const string &fileName,
+                               const double resolution, const size_t samples,
+                               const unsigned int nThreads, const string &description)
+{
+    if ((resolution<=0.0) || (nThreads==0))
+        return false;
+
+    // the batches of the workers, each
+    // sized once through its own copy
+    const size_t B=1024;
+    BatchChain batch(chain,B);
+    size_t N=batch.getN();
+
+    // blocked links keep their current angle
+    // and do not enter the manipulability
+    vector<bool> blocked(N);
+    vector<double> qfix(N);
+    for (size_t i=0; i<N; i++)
+    {
+        blocked[i]=chain.isLinkBlocked((unsigned int)i);
+        qfix[i]=chain[(unsigned int)i].getAng();
+        batch.setActive(i,!blocked[i]);
+    }
+
+    // the grid is centered in the origin of the first link and
+    // encloses the sphere whose radius is the sum of the lengths
+    // of all the links
+    const Matrix &H0=chain.getH0();
+    const Matrix &HN=chain.getHN();
+    double reach=sqrt(HN(0,3)*HN(0,3)+HN(1,3)*HN(1,3)+HN(2,3)*HN(2,3));
+    for (size_t i=0; i<N; i++)
+        reach+=sqrt(batch(i).A*batch(i).A+batch(i).D*batch(i).D);
+
+    Header hdr;
+    memset(&hdr,0,sizeof(hdr));
+    strncpy(hdr.magic,REACHABILITYMAP_MAGIC,sizeof(hdr.magic)-1);
+    strncpy(hdr.description,description.c_str(),sizeof(hdr.description)-1);
+    hdr.version=REACHABILITYMAP_VERSION;
+    hdr.resolution=resolution;
+    hdr.samples=samples;
+    for (int k=0; k<3; k++)
+    {
+        hdr.size[k]=(int32_t)ceil(2.0*reach/resolution)+1;
+        hdr.origin[k]=H0(k,3)-0.5*resolution*hdr.size[k];
+    }
+
+    // one single grid shared by all the workers,
+    // whose voxels are updated atomically
+    const size_t cells=(size_t)hdr.size[0]*hdr.size[1]*hdr.size[2];
+    unique_ptr<atomic<uint32_t>[]> h(new atomic<uint32_t>[cells]);
+    unique_ptr<atomic<float>[]> m(new atomic<float>[cells]);
+    for (size_t i=0; i<cells; i++)
+    {
+        h[i].store(0,memory_order_relaxed);
+        m[i].store(0.0f,memory_order_relaxed);
+    }
+
+    // each worker samples its share of configurations in batches
+    auto worker=[&](const unsigned int id)
+    {
+        BatchChain bc(batch);
+
+        mt19937 gen(id+1);
+        vector<double> q(N*B),w(B);
+
+        size_t todo=samples/nThreads+((id<samples%nThreads)?1:0);
+        while (todo>0)
+        {
+            size_t n=std::min(B,todo);
+            for (size_t i=0; i<N; i++)
+            {
+                uniform_real_distribution<double> dist(batch(i).min,batch(i).max);
+                for (size_t b=0; b<n; b++)
+                    q[i*n+b]=blocked[i]?qfix[i]:dist(gen);
+            }
+
+            bc.compute(n,q.data(),NULL,NULL,w.data());
+
+            const double *p[3]={bc.getPosition(0),bc.getPosition(1),bc.getPosition(2)};
+            for (size_t b=0; b<n; b++)
+            {
+                long idx=0;
+                bool in=true;
+                for (int k=0; k<3; k++)
+                {
+                    long c=(long)floor((p[k][b]-hdr.origin[k])/resolution);
+                    if ((c<0) || (c>=hdr.size[k]))
+                    {
+                        in=false;
+                        break;
+                    }
+                    idx=idx*hdr.size[k]+c;
+                }
+
+                if (in)
+                {
+                    h[idx].fetch_add(1,memory_order_relaxed);
+
+                    float wb=(float)w[b];
+                    float cur=m[idx].load(memory_order_relaxed);
+                    while ((wb>cur) && !m[idx].compare_exchange_weak(cur,wb,memory_order_relaxed));
+                }
+            }
+
+            todo-=n;
+        }
+    };
+
+    vector<thread> pool;
+    for (unsigned int id=0; id<nThreads; id++)
+        pool.push_back(thread(worker,id));
+    for (auto &t:pool)
+        t.join();
+
+    ofstream fout(fileName.c_str(),ios::binary);
+    if (!fout.is_open())
+        return false;
+
+    fout.write((const char*)&hdr,sizeof(hdr));
+
+    // the grid is written out chunk by chunk
+    // through plain buffers
+    const size_t chunk=65536;
+    vector<uint32_t> hbuf(std::min(chunk,cells));
+    for (size_t i=0; i<cells; i+=chunk)
+    {
+        size_t n=std::min(chunk,cells-i);
+        for (size_t j=0; j<n; j++)
+            hbuf[j]=h[i+j].load(memory_order_relaxed);
+        fout.write((const char*)hbuf.data(),n*sizeof(uint32_t));
+    }
+
+    vector<float> mbuf(std::min(chunk,cells));
+    for (size_t i=0; i<cells; i+=chunk)
+    {
+        size_t n=std::min(chunk,cells-i);
+        for (size_t j=0; j<n; j++)
+            mbuf[j]=m[i+j].load(memory_order_relaxed);
+        fout.write((const char*)mbuf.data(),n*sizeof(float));
+    }
+
+    return fout.good();
+}
+
+/**********************************************************/
+bool ReachabilityMap::open(const string &fileName)
+{
+    close();
+
+    const char *data=NULL;
+
+#if defined(_WIN32)
+    // no memory mapping available here:
+    // simply load the whole file
+    ifstream fin(fileName.c_str(),ios::binary);
+    if (!fin.is_open())
+        return false;
+
+    buffer.assign(istreambuf_iterator<char>(fin),istreambuf_iterator<char>());
+    length=buffer.size();
+    data=buffer.data();
+#else
+    int fd=::open(fileName.c_str(),O_RDONLY);
+    if (fd<0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd,&st)<0)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    length=(size_t)st.st_size;
+    void *ptr=mmap(NULL,length,PROT_READ,MAP_SHARED,fd,0);
+    ::close(fd);
+    if (ptr==MAP_FAILED)
+    {
+        length=0;
+        return false;
+    }
+
+    mapping=ptr;
+    data=(const char*)ptr;
+#endif
+
+    // check the consistency of the file
+    const Header *hdr=(const Header*)data;
+    if ((length<sizeof(Header)) || (strncmp(hdr->magic,REACHABILITYMAP_MAGIC,sizeof(hdr->magic))!=0) ||
+        (hdr->version!=REACHABILITYMAP_VERSION))
+    {
+        close();
+        return false;
+    }
+
+    const size_t cells=(size_t)hdr->size[0]*hdr->size[1]*hdr->size[2];
+    if (length!=sizeof(Header)+cells*(sizeof(uint32_t)+sizeof(float)))
+    {
+        close();
+        return false;
+    }
+
+    header=hdr;
+    hits=(const uint32_t*)(data+sizeof(Header));
+    manip=(const float*)(data+sizeof(Header)+cells*sizeof(uint32_t));
+
+    return true;
+}
+
+/**********************************************************/
+void ReachabilityMap::close()
+{
+#if !defined(_WIN32)
+    if (mapping!=NULL)
+        munmap(mapping,length);
+#endif
+
+    buffer.clear();
+    mapping=NULL;
+    length=0;
+    header=NULL;
+    hits=NULL;
+    manip=NULL;
+}
+
+/**********************************************************/
+long ReachabilityMap::getIndex(const double *x) const
+{
+    if (header==NULL)
+        return -1;
+
+    long idx=0;
+    for (int k=0; k<3; k++)
+    {
+        long c=(long)floor((x[k]-header->origin[k])/header->resolution);
+        if ((c<0) || (c>=header->size[k]))
+            return -1;
+        idx=idx*header->size[k]+c;
+    }
+
+    return idx;
+}
+
+/**********************************************************/
+bool ReachabilityMap::isReachable(const double *x) const
+{
+    return (getHits(x)>0);
+}
+
+/**********************************************************/
+uint32_t ReachabilityMap::getHits(const double *x) const
+{
+    long idx=getIndex(x);
+    return ((idx>=0)?hits[idx]:0);
+}
+
+/**********************************************************/
+double ReachabilityMap::getManipulability(const double *x) const
+{
+    long idx=getIndex(x);
+    return ((idx>=0)?manip[idx]:0.0);
+}
+